@@ -214,6 +214,7 @@ void ScalarEnumerationTraits<ELFYAML::ELF_EM>::enumeration(
   ECase(EM_78KOR);
   ECase(EM_56800EX);
   ECase(EM_AMDGPU);
+  ECase(EM_Z80);
   ECase(EM_RISCV);
   ECase(EM_LANAI);
   ECase(EM_BPF);
@@ -643,6 +644,9 @@ void ScalarEnumerationTraits<ELFYAML::ELF_REL>::enumeration(
   case ELF::EM_BPF:
 #include "llvm/BinaryFormat/ELFRelocs/BPF.def"
     break;
+  case ELF::EM_Z80:
+#include "llvm/BinaryFormat/ELFRelocs/Z80.def"
+    break;
   default:
     llvm_unreachable("Unsupported architecture");
   }
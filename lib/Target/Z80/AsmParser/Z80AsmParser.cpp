@@ -0,0 +1,609 @@
+//===-- Z80AsmParser.cpp - Parse Z80 assembly to MCInst instructions ------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file parses Zilog syntax Z80 assembly, as printed by Z80InstPrinter,
+// into MCInsts.  Mnemonics and register names are not case sensitive.
+//
+// Besides the usual dot directives it accepts the ZDS directives written by
+// Z80TargetAsmStreamer and Z80MCAsmInfo: XDEF, XREF, DB, DW, DL, DS and ALIGN.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MCTargetDesc/I8080TargetStreamer.h"
+#include "MCTargetDesc/Z80BaseInfo.h"
+#include "MCTargetDesc/Z80MCTargetDesc.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCParser/AsmLexer.h"
+#include "llvm/MC/MCParser/MCAsmLexer.h"
+#include "llvm/MC/MCParser/MCParsedAsmOperand.h"
+#include "llvm/MC/MCParser/MCTargetAsmParser.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCStreamer.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/MCSymbol.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "z80-asm-parser"
+
+namespace {
+class Z80AsmParser : public MCTargetAsmParser {
+  MCAsmParser &Parser;
+
+#define GET_ASSEMBLER_HEADER
+#include "Z80GenAsmMatcher.inc"
+
+  bool ParseRegister(unsigned &RegNo, SMLoc &StartLoc, SMLoc &EndLoc) override;
+  bool ParseInstruction(ParseInstructionInfo &Info, StringRef Name,
+                        SMLoc NameLoc, OperandVector &Operands) override;
+  bool ParseDirective(AsmToken DirectiveID) override;
+  bool MatchAndEmitInstruction(SMLoc IDLoc, unsigned &Opcode,
+                               OperandVector &Operands, MCStreamer &Out,
+                               uint64_t &ErrorInfo,
+                               bool MatchingInlineAsm) override;
+
+  bool parseZDSDirective(StringRef Directive, SMLoc DirectiveLoc);
+  bool parseDirectiveAssume(SMLoc DirectiveLoc);
+
+  unsigned matchRegister(StringRef Name) const;
+  bool parseOperand(OperandVector &Operands, StringRef Mnemonic);
+  bool parseMemOperand(OperandVector &Operands, StringRef Mnemonic);
+  void fillImpliedOperands(MCInst &Inst);
+
+public:
+  Z80AsmParser(const MCSubtargetInfo &STI, MCAsmParser &Parser,
+               const MCInstrInfo &MII, const MCTargetOptions &Options)
+    : MCTargetAsmParser(Options, STI, MII), Parser(Parser) {
+    MCAsmParserExtension::Initialize(Parser);
+    setAvailableFeatures(ComputeAvailableFeatures(STI.getFeatureBits()));
+  }
+};
+
+/// A parsed Z80 operand.  Besides registers, immediates and tokens, memory is
+/// addressed as (nn), (rr) or (ix+d), and jumps and calls take a condition.
+class Z80Operand : public MCParsedAsmOperand {
+  enum KindTy { k_Token, k_Register, k_Immediate, k_Mem, k_Ptr, k_Off,
+                k_CC } Kind;
+
+  std::string Tok;
+  unsigned Reg = 0;
+  const MCExpr *Expr = nullptr;
+  unsigned CC = 0;
+  SMLoc Start, End;
+
+  Z80Operand(KindTy Kind, SMLoc Start, SMLoc End)
+    : Kind(Kind), Start(Start), End(End) {}
+
+public:
+  bool isToken() const override { return Kind == k_Token; }
+  bool isReg() const override { return Kind == k_Register; }
+  bool isImm() const override { return Kind == k_Immediate; }
+  bool isMem() const override { return Kind == k_Mem; }
+  bool isPtr() const {
+    return Kind == k_Ptr &&
+           (Reg == Z80::HL || Reg == Z80::IX || Reg == Z80::IY);
+  }
+  bool isOff() const {
+    return Kind == k_Off && (Reg == Z80::IX || Reg == Z80::IY);
+  }
+  bool isCC() const { return Kind == k_CC; }
+
+  StringRef getToken() const {
+    assert(isToken() && "Not a token");
+    return Tok;
+  }
+  unsigned getReg() const override {
+    assert((Kind == k_Register || Kind == k_Ptr || Kind == k_Off) &&
+           "Not a register");
+    return Reg;
+  }
+  SMLoc getStartLoc() const override { return Start; }
+  SMLoc getEndLoc() const override { return End; }
+
+  void addExpr(MCInst &Inst, const MCExpr *E) const {
+    if (auto *CE = dyn_cast<MCConstantExpr>(E)) {
+      Inst.addOperand(MCOperand::createImm(CE->getValue()));
+    } else {
+      Inst.addOperand(MCOperand::createExpr(E));
+    }
+  }
+  void addRegOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 1 && "Invalid number of operands!");
+    Inst.addOperand(MCOperand::createReg(getReg()));
+  }
+  void addImmOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 1 && "Invalid number of operands!");
+    addExpr(Inst, Expr);
+  }
+  void addMemOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 1 && "Invalid number of operands!");
+    addExpr(Inst, Expr);
+  }
+  void addPtrOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 1 && "Invalid number of operands!");
+    Inst.addOperand(MCOperand::createReg(Reg));
+  }
+  void addOffOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 2 && "Invalid number of operands!");
+    Inst.addOperand(MCOperand::createReg(Reg));
+    addExpr(Inst, Expr);
+  }
+  void addCCOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 1 && "Invalid number of operands!");
+    Inst.addOperand(MCOperand::createImm(CC));
+  }
+
+  void print(raw_ostream &OS) const override {
+    switch (Kind) {
+    case k_Token:     OS << "Token: " << Tok; break;
+    case k_Register:  OS << "Reg: " << Reg; break;
+    case k_Immediate: OS << "Imm: " << *Expr; break;
+    case k_Mem:       OS << "Mem: (" << *Expr << ')'; break;
+    case k_Ptr:       OS << "Ptr: (" << Reg << ')'; break;
+    case k_Off:       OS << "Off: (" << Reg << " + " << *Expr << ')'; break;
+    case k_CC:        OS << "CC: " << CC; break;
+    }
+  }
+
+  static std::unique_ptr<Z80Operand> CreateToken(StringRef Tok, SMLoc S) {
+    auto Op = std::unique_ptr<Z80Operand>(new Z80Operand(k_Token, S, S));
+    Op->Tok = Tok;
+    return Op;
+  }
+  static std::unique_ptr<Z80Operand> CreateReg(unsigned Reg, SMLoc S,
+                                               SMLoc E) {
+    auto Op = std::unique_ptr<Z80Operand>(new Z80Operand(k_Register, S, E));
+    Op->Reg = Reg;
+    return Op;
+  }
+  static std::unique_ptr<Z80Operand> CreateImm(const MCExpr *Expr, SMLoc S,
+                                               SMLoc E) {
+    auto Op = std::unique_ptr<Z80Operand>(new Z80Operand(k_Immediate, S, E));
+    Op->Expr = Expr;
+    return Op;
+  }
+  static std::unique_ptr<Z80Operand> CreateMem(const MCExpr *Expr, SMLoc S,
+                                               SMLoc E) {
+    auto Op = std::unique_ptr<Z80Operand>(new Z80Operand(k_Mem, S, E));
+    Op->Expr = Expr;
+    return Op;
+  }
+  static std::unique_ptr<Z80Operand> CreatePtr(unsigned Reg, SMLoc S,
+                                               SMLoc E) {
+    auto Op = std::unique_ptr<Z80Operand>(new Z80Operand(k_Ptr, S, E));
+    Op->Reg = Reg;
+    return Op;
+  }
+  static std::unique_ptr<Z80Operand> CreateOff(unsigned Reg,
+                                               const MCExpr *Expr, SMLoc S,
+                                               SMLoc E) {
+    auto Op = std::unique_ptr<Z80Operand>(new Z80Operand(k_Off, S, E));
+    Op->Reg = Reg;
+    Op->Expr = Expr;
+    return Op;
+  }
+  static std::unique_ptr<Z80Operand> CreateCC(unsigned CC, SMLoc S, SMLoc E) {
+    auto Op = std::unique_ptr<Z80Operand>(new Z80Operand(k_CC, S, E));
+    Op->CC = CC;
+    return Op;
+  }
+};
+} // end anonymous namespace
+
+#define GET_REGISTER_MATCHER
+#define GET_SUBTARGET_FEATURE_NAME
+#define GET_MATCHER_IMPLEMENTATION
+#include "Z80GenAsmMatcher.inc"
+
+/// Return the register called Name, in any case, or 0.
+unsigned Z80AsmParser::matchRegister(StringRef Name) const {
+  return MatchRegisterName(Name.lower());
+}
+
+bool Z80AsmParser::ParseRegister(unsigned &RegNo, SMLoc &StartLoc,
+                                 SMLoc &EndLoc) {
+  const AsmToken &Tok = Parser.getTok();
+  StartLoc = Tok.getLoc();
+  EndLoc = Tok.getEndLoc();
+  RegNo = Tok.is(AsmToken::Identifier) ? matchRegister(Tok.getString()) : 0;
+  if (!RegNo) {
+    return Error(StartLoc, "invalid register name");
+  }
+  Parser.Lex();
+  return false;
+}
+
+/// Parse a parenthesized operand: (nn), (rr), (ix+d) or (ix-d).  The only
+/// other uses of parentheses are jp (rr), ex (sp), rr, ld a, (bc) and the
+/// like, and in r, (c) and out (c), r, which are matched token by token.
+bool Z80AsmParser::parseMemOperand(OperandVector &Operands,
+                                   StringRef Mnemonic) {
+  SMLoc S = Parser.getTok().getLoc();
+  Parser.Lex(); // Eat '('.
+
+  const AsmToken &Tok = Parser.getTok();
+  unsigned Reg = Tok.is(AsmToken::Identifier) ? matchRegister(Tok.getString())
+                                              : 0;
+  if (Reg == Z80::SPS || Reg == Z80::BC || Reg == Z80::DE || Reg == Z80::C ||
+      (Reg && Mnemonic == "jp")) {
+    SMLoc RegS = Tok.getLoc(), RegE = Tok.getEndLoc();
+    Parser.Lex();
+    if (Parser.getTok().isNot(AsmToken::RParen)) {
+      return Error(Parser.getTok().getLoc(), "expected ')'");
+    }
+    Operands.push_back(Z80Operand::CreateToken("(", S));
+    Operands.push_back(Z80Operand::CreateReg(Reg, RegS, RegE));
+    Operands.push_back(Z80Operand::CreateToken(")", Parser.getTok().getLoc()));
+    Parser.Lex();
+    return false;
+  }
+
+  const MCExpr *Expr = nullptr;
+  if (Reg) {
+    Parser.Lex();
+    if (Parser.getTok().is(AsmToken::Plus)) {
+      Parser.Lex();
+      if (Parser.parseExpression(Expr)) {
+        return true;
+      }
+    } else if (Parser.getTok().is(AsmToken::Minus)) {
+      if (Parser.parseExpression(Expr)) {
+        return true;
+      }
+    }
+  } else if (Parser.parseExpression(Expr)) {
+    return true;
+  }
+
+  if (Parser.getTok().isNot(AsmToken::RParen)) {
+    return Error(Parser.getTok().getLoc(), "expected ')'");
+  }
+  SMLoc E = Parser.getTok().getEndLoc();
+  Parser.Lex();
+
+  if (!Reg) {
+    Operands.push_back(Z80Operand::CreateMem(Expr, S, E));
+  } else if (Expr) {
+    Operands.push_back(Z80Operand::CreateOff(Reg, Expr, S, E));
+  } else {
+    Operands.push_back(Z80Operand::CreatePtr(Reg, S, E));
+  }
+  return false;
+}
+
+bool Z80AsmParser::parseOperand(OperandVector &Operands, StringRef Mnemonic) {
+  const AsmToken &Tok = Parser.getTok();
+  SMLoc S = Tok.getLoc(), E = Tok.getEndLoc();
+
+  if (Tok.is(AsmToken::LParen)) {
+    return parseMemOperand(Operands, Mnemonic);
+  }
+
+  if (Tok.is(AsmToken::Identifier)) {
+    std::string Name = Tok.getString().lower();
+
+    // af' would otherwise start a character literal, so step the lexer over
+    // the quote by hand.
+    const char *Quote = E.getPointer();
+    if (Name == "af" && *Quote == '\'') {
+      SourceMgr &SM = Parser.getSourceManager();
+      unsigned Buffer = SM.FindBufferContainingLoc(S);
+      static_cast<AsmLexer &>(getLexer())
+        .setBuffer(SM.getMemoryBuffer(Buffer)->getBuffer(), Quote + 1);
+      Parser.Lex();
+      Operands.push_back(Z80Operand::CreateToken("af'", S));
+      return false;
+    }
+
+    // The interrupt and refresh registers only appear as ld a, i and the
+    // like, and are reserved words like the other register names.
+    if (Name == "i" || Name == "r") {
+      Operands.push_back(Z80Operand::CreateToken(Name == "i" ? "i" : "r", S));
+      Parser.Lex();
+      return false;
+    }
+
+    if (unsigned Reg = matchRegister(Name)) {
+      Operands.push_back(Z80Operand::CreateReg(Reg, S, E));
+      Parser.Lex();
+      return false;
+    }
+  }
+
+  const MCExpr *Expr;
+  if (Parser.parseExpression(Expr, E)) {
+    return true;
+  }
+  Operands.push_back(Z80Operand::CreateImm(Expr, S, E));
+  return false;
+}
+
+/// Return true if Name is one of the ZDS directives, which unlike the dot
+/// directives are parsed in place of an instruction.
+static bool isZDSDirective(StringRef Name) {
+  return StringSwitch<bool>(Name)
+    .Cases("xdef", "xref", true)
+    .Cases("db", "dw", "dl", "ds", "align", true)
+    .Default(false);
+}
+
+/// parseZDSDirective
+///  ::= XDEF symbol [, symbol]*
+///  ::= XREF symbol [, symbol]*
+///  ::= (DB | DW | DL) (expression | string) [, (expression | string)]*
+///  ::= DS count [, fill]
+///  ::= ALIGN alignment
+bool Z80AsmParser::parseZDSDirective(StringRef Directive, SMLoc DirectiveLoc) {
+  // Go through the target streamer, so that the directives are printed back
+  // in the same dialect.
+  MCStreamer &Out = getStreamer();
+  auto &TS = static_cast<Z80TargetStreamer &>(*Out.getTargetStreamer());
+
+  if (Directive == "xdef" || Directive == "xref") {
+    return Parser.parseMany([&]() -> bool {
+      StringRef Name;
+      SMLoc Loc = getLexer().getLoc();
+      if (Parser.parseIdentifier(Name)) {
+        return Error(Loc, "expected symbol name");
+      }
+      MCSymbol *Sym = getContext().getOrCreateSymbol(Name);
+      if (Directive == "xref" && Sym->isDefined()) {
+        return Error(Loc, "symbol '" + Name + "' is defined in this file");
+      }
+      if (Directive == "xdef") {
+        TS.emitGlobal(Sym);
+      } else {
+        TS.emitExtern(Sym);
+      }
+      return false;
+    });
+  }
+
+  if (Parser.checkForValidSection()) {
+    return true;
+  }
+
+  if (Directive == "db" || Directive == "dw" || Directive == "dl") {
+    unsigned Size = Directive == "db" ? 1 : Directive == "dw" ? 2 : 4;
+    return Parser.parseMany([&]() -> bool {
+      if (Size == 1 && getLexer().is(AsmToken::String)) {
+        std::string Data;
+        if (Parser.parseEscapedString(Data)) {
+          return true;
+        }
+        Out.EmitBytes(Data);
+        return false;
+      }
+      const MCExpr *Value;
+      SMLoc Loc = getLexer().getLoc();
+      if (Parser.parseExpression(Value)) {
+        return true;
+      }
+      if (const auto *CE = dyn_cast<MCConstantExpr>(Value)) {
+        int64_t IntValue = CE->getValue();
+        if (!isUIntN(8 * Size, IntValue) && !isIntN(8 * Size, IntValue)) {
+          return Error(Loc, "out of range literal value");
+        }
+        Out.EmitIntValue(IntValue, Size);
+      } else {
+        Out.EmitValue(Value, Size, Loc);
+      }
+      return false;
+    });
+  }
+
+  if (Directive == "ds") {
+    const MCExpr *Count;
+    int64_t Fill = 0;
+    SMLoc FillLoc;
+    if (Parser.parseExpression(Count)) {
+      return true;
+    }
+    if (Parser.parseOptionalToken(AsmToken::Comma)) {
+      FillLoc = getLexer().getLoc();
+      if (Parser.parseAbsoluteExpression(Fill)) {
+        return true;
+      }
+    }
+    if (Parser.parseToken(AsmToken::EndOfStatement,
+                          "unexpected token in '" + Directive + "' directive")) {
+      return true;
+    }
+    if (!isUIntN(8, Fill) && !isIntN(8, Fill)) {
+      return Error(FillLoc, "fill value out of range");
+    }
+    int64_t NumBytes;
+    if (!Fill && Count->evaluateAsAbsolute(NumBytes) && NumBytes >= 0) {
+      TS.emitBlock(NumBytes);
+    } else {
+      Out.emitFill(*Count, Fill, DirectiveLoc);
+    }
+    return false;
+  }
+
+  assert(Directive == "align" && "Unknown ZDS directive");
+  int64_t Alignment;
+  SMLoc AlignmentLoc = getLexer().getLoc();
+  if (Parser.parseAbsoluteExpression(Alignment) ||
+      Parser.parseToken(AsmToken::EndOfStatement,
+                        "unexpected token in 'align' directive")) {
+    return true;
+  }
+  if (Alignment <= 0 || !isPowerOf2_64(Alignment)) {
+    return Error(AlignmentLoc, "alignment must be a power of 2");
+  }
+  TS.emitAlign(Alignment);
+  return false;
+}
+
+bool Z80AsmParser::ParseInstruction(ParseInstructionInfo &Info, StringRef Name,
+                                    SMLoc NameLoc, OperandVector &Operands) {
+  std::string Lower = Name.lower();
+  StringRef Mnemonic = Lower;
+  if (isZDSDirective(Mnemonic)) {
+    // Leave Operands empty so that nothing is matched.
+    return parseZDSDirective(Mnemonic, NameLoc);
+  }
+  Operands.push_back(Z80Operand::CreateToken(Mnemonic, NameLoc));
+
+  bool IsJump = StringSwitch<bool>(Mnemonic)
+    .Cases("jp", "jr", "call", "ret", true)
+    .Default(false);
+
+  if (getLexer().isNot(AsmToken::EndOfStatement)) {
+    // A leading condition of a jump, call or return.
+    const AsmToken &Tok = Parser.getTok();
+    if (IsJump && Tok.is(AsmToken::Identifier)) {
+      int CC = StringSwitch<int>(Tok.getString().lower())
+        .Case("nz", Z80::COND_NZ)
+        .Case("z",  Z80::COND_Z)
+        .Case("nc", Z80::COND_NC)
+        .Case("c",  Z80::COND_C)
+        .Case("po", Z80::COND_PO)
+        .Case("pe", Z80::COND_PE)
+        .Case("p",  Z80::COND_P)
+        .Case("m",  Z80::COND_M)
+        .Default(-1);
+      if (CC != -1 && (Mnemonic == "ret" ||
+                       getLexer().peekTok().is(AsmToken::Comma))) {
+        Operands.push_back(Z80Operand::CreateCC(CC, Tok.getLoc(),
+                                                Tok.getEndLoc()));
+        Parser.Lex();
+        if (getLexer().is(AsmToken::Comma)) {
+          Parser.Lex();
+        }
+      }
+    }
+
+    while (getLexer().isNot(AsmToken::EndOfStatement)) {
+      if (parseOperand(Operands, Mnemonic)) {
+        return true;
+      }
+      if (getLexer().is(AsmToken::Comma)) {
+        Parser.Lex();
+      } else if (getLexer().isNot(AsmToken::EndOfStatement)) {
+        return Error(getLexer().getLoc(), "unexpected token in operand");
+      }
+    }
+  }
+  Parser.Lex(); // Consume the EndOfStatement.
+
+  // sub, and, xor, or and cp are usually written without the accumulator.
+  bool ImpliesA = StringSwitch<bool>(Mnemonic)
+    .Cases("sub", "and", "xor", "or", "cp", true)
+    .Default(false);
+  if (ImpliesA && Operands.size() == 2) {
+    Operands.insert(Operands.begin() + 1,
+                    Z80Operand::CreateReg(Z80::A, NameLoc, NameLoc));
+  }
+  return false;
+}
+
+/// parseDirectiveAssume
+///  ::= .assume adl = 0
+/// The z80 only has the mode that the ez80 calls adl = 0.
+bool Z80AsmParser::parseDirectiveAssume(SMLoc DirectiveLoc) {
+  StringRef Name;
+  int64_t ADL;
+  SMLoc Loc = getLexer().getLoc();
+  if (Parser.parseIdentifier(Name) || Name.lower() != "adl") {
+    return Error(Loc, "expected 'adl'");
+  }
+  if (Parser.parseToken(AsmToken::Equal, "expected '='")) {
+    return true;
+  }
+  Loc = getLexer().getLoc();
+  if (Parser.parseAbsoluteExpression(ADL) ||
+      Parser.parseToken(AsmToken::EndOfStatement,
+                        "unexpected token in '.assume' directive")) {
+    return true;
+  }
+  if (ADL) {
+    return Error(Loc, "adl mode is not supported on the z80");
+  }
+  return false;
+}
+
+bool Z80AsmParser::ParseDirective(AsmToken DirectiveID) {
+  StringRef IDVal = DirectiveID.getIdentifier();
+  if (IDVal.lower() == ".assume") {
+    return parseDirectiveAssume(DirectiveID.getLoc());
+  }
+  return true;
+}
+
+/// Operands that are not written, such as the flags result of alu ops, are
+/// given the only register they can be.
+void Z80AsmParser::fillImpliedOperands(MCInst &Inst) {
+  const MCInstrDesc &Desc = MII.get(Inst.getOpcode());
+  const MCRegisterInfo *MRI = getContext().getRegisterInfo();
+  for (unsigned I = 0, E = Inst.getNumOperands(); I != E; ++I) {
+    if (I >= Desc.getNumOperands() || !Inst.getOperand(I).isImm()) {
+      continue;
+    }
+    int RC = Desc.OpInfo[I].RegClass;
+    if (RC < 0 || Desc.OpInfo[I].isLookupPtrRegClass()) {
+      continue;
+    }
+    const MCRegisterClass &Class = MRI->getRegClass(RC);
+    if (Class.getNumRegs() == 1) {
+      Inst.getOperand(I) = MCOperand::createReg(Class.getRegister(0));
+    }
+  }
+}
+
+bool Z80AsmParser::MatchAndEmitInstruction(SMLoc IDLoc, unsigned &Opcode,
+                                           OperandVector &Operands,
+                                           MCStreamer &Out,
+                                           uint64_t &ErrorInfo,
+                                           bool MatchingInlineAsm) {
+  // ZDS directives are emitted as they are parsed.
+  if (Operands.empty()) {
+    return false;
+  }
+
+  MCInst Inst;
+  switch (MatchInstructionImpl(Operands, Inst, ErrorInfo, MatchingInlineAsm)) {
+  case Match_Success:
+    fillImpliedOperands(Inst);
+    Inst.setLoc(IDLoc);
+    Opcode = Inst.getOpcode();
+    Out.EmitInstruction(Inst, getSTI());
+    return false;
+  case Match_MissingFeature:
+    return Error(IDLoc, "instruction requires a CPU feature not currently "
+                        "enabled");
+  case Match_InvalidOperand: {
+    SMLoc ErrorLoc = IDLoc;
+    if (ErrorInfo != ~0ULL) {
+      if (ErrorInfo >= Operands.size()) {
+        return Error(IDLoc, "too few operands for instruction");
+      }
+      ErrorLoc = Operands[ErrorInfo]->getStartLoc();
+      if (ErrorLoc == SMLoc()) {
+        ErrorLoc = IDLoc;
+      }
+    }
+    return Error(ErrorLoc, "invalid operand for instruction");
+  }
+  case Match_MnemonicFail:
+    return Error(IDLoc, "invalid instruction mnemonic");
+  }
+  llvm_unreachable("Unknown match type detected!");
+}
+
+extern "C" void LLVMInitializeZ80AsmParser() {
+  RegisterMCAsmParser<Z80AsmParser> X(getTheZ80Target());
+}
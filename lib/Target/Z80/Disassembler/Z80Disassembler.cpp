@@ -0,0 +1,507 @@
+//===-- Z80Disassembler.cpp - Disassembler for Z80 ------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the Z80Disassembler class, the inverse of
+// Z80MCCodeEmitter.
+//
+// Each opcode page, unprefixed, cb and ed, is described by a list of opcode
+// patterns, from which a table of 256 entries is built.  An entry says which
+// field of the opcode or which following bytes fill each operand.  A dd or fd
+// prefix turns hl into ix or iy, (hl) into (ix+d) and, undocumented, h and l
+// into the index register halves.  An indexed cb instruction takes the
+// displacement before the opcode, and with a register other than (hl) also
+// copies the result to that register, which is undocumented as well.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MCTargetDesc/Z80MCTargetDesc.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCDisassembler/MCDisassembler.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Support/TargetRegistry.h"
+#include <iterator>
+#include <memory>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "z80-disassembler"
+
+typedef MCDisassembler::DecodeStatus DecodeStatus;
+
+namespace {
+/// Where an explicit operand comes from.  Tied operands are not listed, they
+/// repeat the operand that they are tied to.
+enum OperandField : uint8_t {
+  FNone,
+  FRegY,   ///< 8-bit register in bits 5-3.
+  FRegZ,   ///< 8-bit register in bits 2-0.
+  FRegP,   ///< bc, de, hl or sp in bits 5-4.
+  FIdx,    ///< hl, or ix or iy after a prefix.
+  FPtr,    ///< (hl), or (ix+d) after a prefix.
+  FImm8,   ///< Byte following the opcode.
+  FImm16,  ///< Little endian word following the opcode.
+  FRel8,   ///< Displacement of jr and djnz.
+  FCondY,  ///< Condition in bits 5-3.
+  FCondJR, ///< Condition of jr in bits 4-3.
+  FBit,    ///< Bit number in bits 5-3.
+  FRst,    ///< Target of rst, bits 5-3 as they are.
+  FMode    ///< Interrupt mode in bits 5-3.
+};
+
+/// The opcodes that match Value under Mask, if not matched by an earlier
+/// pattern.
+struct OpcodePattern {
+  uint8_t Value, Mask;
+  uint16_t Opcode;
+  /// Opcode of the (ix+d) form, for instructions taking (hl).
+  uint16_t IdxOpcode;
+  bool Undoc;
+  OperandField Fields[3];
+};
+} // end anonymous namespace
+
+static const OpcodePattern MainPatterns[] = {
+  // x = 0
+  { 0x00, 0xFF, Z80::NOP },
+  { 0x08, 0xFF, Z80::EXAF },
+  { 0x10, 0xFF, Z80::DJNZ,     0,           false, { FRel8 } },
+  { 0x18, 0xFF, Z80::JR,       0,           false, { FRel8 } },
+  { 0x20, 0xE7, Z80::JRCC,     0,           false, { FRel8, FCondJR } },
+  { 0x31, 0xFF, Z80::LD16SPi,  0,           false, { FImm16 } },
+  { 0x01, 0xCF, Z80::LD16ri,   0,           false, { FRegP, FImm16 } },
+  { 0x29, 0xFF, Z80::ADD16aa,  0,           false, { FIdx } },
+  { 0x39, 0xFF, Z80::ADD16SP,  0,           false, { FIdx } },
+  { 0x09, 0xCF, Z80::ADD16ao,  0,           false, { FIdx, FRegP } },
+  { 0x02, 0xFF, Z80::LD8BCa },
+  { 0x12, 0xFF, Z80::LD8DEa },
+  { 0x22, 0xFF, Z80::LD16ma,   0,           false, { FImm16, FIdx } },
+  { 0x32, 0xFF, Z80::LD8ma,    0,           false, { FImm16 } },
+  { 0x0A, 0xFF, Z80::LD8aBC },
+  { 0x1A, 0xFF, Z80::LD8aDE },
+  { 0x2A, 0xFF, Z80::LD16am,   0,           false, { FIdx, FImm16 } },
+  { 0x3A, 0xFF, Z80::LD8am,    0,           false, { FImm16 } },
+  { 0x33, 0xFF, Z80::INC16SP },
+  { 0x03, 0xCF, Z80::INC16r,   0,           false, { FRegP } },
+  { 0x3B, 0xFF, Z80::DEC16SP },
+  { 0x0B, 0xCF, Z80::DEC16r,   0,           false, { FRegP } },
+  { 0x34, 0xFF, Z80::INC8p,    Z80::INC8o,  false, { FPtr } },
+  { 0x04, 0xC7, Z80::INC8r,    0,           false, { FRegY } },
+  { 0x35, 0xFF, Z80::DEC8p,    Z80::DEC8o,  false, { FPtr } },
+  { 0x05, 0xC7, Z80::DEC8r,    0,           false, { FRegY } },
+  { 0x36, 0xFF, Z80::LD8pi,    Z80::LD8oi,  false, { FPtr, FImm8 } },
+  { 0x06, 0xC7, Z80::LD8ri,    0,           false, { FRegY, FImm8 } },
+  { 0x07, 0xFF, Z80::RLCA },
+  { 0x0F, 0xFF, Z80::RRCA },
+  { 0x17, 0xFF, Z80::RLA },
+  { 0x1F, 0xFF, Z80::RRA },
+  { 0x27, 0xFF, Z80::DAA },
+  { 0x2F, 0xFF, Z80::CPL8 },
+  { 0x37, 0xFF, Z80::SCF },
+  { 0x3F, 0xFF, Z80::CCF },
+
+  // x = 1
+  { 0x76, 0xFF, Z80::HALT },
+  { 0x70, 0xF8, Z80::LD8pg,    Z80::LD8og,  false, { FPtr, FRegZ } },
+  { 0x46, 0xC7, Z80::LD8gp,    Z80::LD8go,  false, { FRegY, FPtr } },
+  { 0x40, 0xC0, Z80::LD8gg,    0,           false, { FRegY, FRegZ } },
+
+  // x = 2, and the immediate forms from x = 3
+  { 0x86, 0xFF, Z80::ADD8ap,   Z80::ADD8ao, false, { FPtr } },
+  { 0x80, 0xF8, Z80::ADD8ar,   0,           false, { FRegZ } },
+  { 0xC6, 0xFF, Z80::ADD8ai,   0,           false, { FImm8 } },
+  { 0x8E, 0xFF, Z80::ADC8ap,   Z80::ADC8ao, false, { FPtr } },
+  { 0x88, 0xF8, Z80::ADC8ar,   0,           false, { FRegZ } },
+  { 0xCE, 0xFF, Z80::ADC8ai,   0,           false, { FImm8 } },
+  { 0x96, 0xFF, Z80::SUB8ap,   Z80::SUB8ao, false, { FPtr } },
+  { 0x90, 0xF8, Z80::SUB8ar,   0,           false, { FRegZ } },
+  { 0xD6, 0xFF, Z80::SUB8ai,   0,           false, { FImm8 } },
+  { 0x9E, 0xFF, Z80::SBC8ap,   Z80::SBC8ao, false, { FPtr } },
+  { 0x98, 0xF8, Z80::SBC8ar,   0,           false, { FRegZ } },
+  { 0xDE, 0xFF, Z80::SBC8ai,   0,           false, { FImm8 } },
+  { 0xA6, 0xFF, Z80::AND8ap,   Z80::AND8ao, false, { FPtr } },
+  { 0xA0, 0xF8, Z80::AND8ar,   0,           false, { FRegZ } },
+  { 0xE6, 0xFF, Z80::AND8ai,   0,           false, { FImm8 } },
+  { 0xAE, 0xFF, Z80::XOR8ap,   Z80::XOR8ao, false, { FPtr } },
+  { 0xA8, 0xF8, Z80::XOR8ar,   0,           false, { FRegZ } },
+  { 0xEE, 0xFF, Z80::XOR8ai,   0,           false, { FImm8 } },
+  { 0xB6, 0xFF, Z80::OR8ap,    Z80::OR8ao,  false, { FPtr } },
+  { 0xB0, 0xF8, Z80::OR8ar,    0,           false, { FRegZ } },
+  { 0xF6, 0xFF, Z80::OR8ai,    0,           false, { FImm8 } },
+  { 0xBE, 0xFF, Z80::CP8ap,    Z80::CP8ao,  false, { FPtr } },
+  { 0xB8, 0xF8, Z80::CP8ar,    0,           false, { FRegZ } },
+  { 0xFE, 0xFF, Z80::CP8ai,    0,           false, { FImm8 } },
+
+  // x = 3, leaving out the cb, dd, ed and fd prefixes
+  { 0xC9, 0xFF, Z80::RET },
+  { 0xC0, 0xC7, Z80::RETCC,    0,           false, { FCondY } },
+  { 0xF1, 0xFF, Z80::POP16AF },
+  { 0xC1, 0xCF, Z80::POP16r,   0,           false, { FRegP } },
+  { 0xF5, 0xFF, Z80::PUSH16AF },
+  { 0xC5, 0xCF, Z80::PUSH16r,  0,           false, { FRegP } },
+  { 0xD9, 0xFF, Z80::EXX },
+  { 0xE9, 0xFF, Z80::JP16r,    0,           false, { FIdx } },
+  { 0xF9, 0xFF, Z80::LD16SP,   0,           false, { FIdx } },
+  { 0xC3, 0xFF, Z80::JP16,     0,           false, { FImm16 } },
+  { 0xC2, 0xC7, Z80::JP16CC,   0,           false, { FImm16, FCondY } },
+  { 0xD3, 0xFF, Z80::OUT8ma,   0,           false, { FImm8 } },
+  { 0xDB, 0xFF, Z80::IN8am,    0,           false, { FImm8 } },
+  { 0xE3, 0xFF, Z80::EX16SP,   0,           false, { FIdx } },
+  { 0xEB, 0xFF, Z80::EX16DE },
+  { 0xF3, 0xFF, Z80::DI },
+  { 0xFB, 0xFF, Z80::EI },
+  { 0xCD, 0xFF, Z80::CALL16i,  0,           false, { FImm16 } },
+  { 0xC4, 0xC7, Z80::CALL16CC, 0,           false, { FImm16, FCondY } },
+  { 0xC7, 0xC7, Z80::RST,      0,           false, { FRst } },
+};
+
+static const OpcodePattern CBPatterns[] = {
+  { 0x06, 0xFF, Z80::RLC8p,    Z80::RLC8o,  false, { FPtr } },
+  { 0x00, 0xF8, Z80::RLC8r,    0,           false, { FRegZ } },
+  { 0x0E, 0xFF, Z80::RRC8p,    Z80::RRC8o,  false, { FPtr } },
+  { 0x08, 0xF8, Z80::RRC8r,    0,           false, { FRegZ } },
+  { 0x16, 0xFF, Z80::RL8p,     Z80::RL8o,   false, { FPtr } },
+  { 0x10, 0xF8, Z80::RL8r,     0,           false, { FRegZ } },
+  { 0x1E, 0xFF, Z80::RR8p,     Z80::RR8o,   false, { FPtr } },
+  { 0x18, 0xF8, Z80::RR8r,     0,           false, { FRegZ } },
+  { 0x26, 0xFF, Z80::SLA8p,    Z80::SLA8o,  false, { FPtr } },
+  { 0x20, 0xF8, Z80::SLA8r,    0,           false, { FRegZ } },
+  { 0x2E, 0xFF, Z80::SRA8p,    Z80::SRA8o,  false, { FPtr } },
+  { 0x28, 0xF8, Z80::SRA8r,    0,           false, { FRegZ } },
+  { 0x36, 0xFF, Z80::SLL8p,    Z80::SLL8o,  true,  { FPtr } },
+  { 0x30, 0xF8, Z80::SLL8r,    0,           true,  { FRegZ } },
+  { 0x3E, 0xFF, Z80::SRL8p,    Z80::SRL8o,  false, { FPtr } },
+  { 0x38, 0xF8, Z80::SRL8r,    0,           false, { FRegZ } },
+  { 0x46, 0xC7, Z80::BIT8bp,   Z80::BIT8bo, false, { FBit, FPtr } },
+  { 0x40, 0xC0, Z80::BIT8bg,   0,           false, { FBit, FRegZ } },
+  { 0x86, 0xC7, Z80::RES8bp,   Z80::RES8bo, false, { FBit, FPtr } },
+  { 0x80, 0xC0, Z80::RES8bg,   0,           false, { FRegZ, FBit } },
+  { 0xC6, 0xC7, Z80::SET8bp,   Z80::SET8bo, false, { FBit, FPtr } },
+  { 0xC0, 0xC0, Z80::SET8bg,   0,           false, { FRegZ, FBit } },
+};
+
+static const OpcodePattern EDPatterns[] = {
+  { 0x70, 0xFF, Z80::IN8fc,    0,           true },
+  { 0x40, 0xC7, Z80::IN8rc,    0,           false, { FRegY } },
+  { 0x71, 0xFF, Z80::OUT8c0,   0,           true },
+  { 0x41, 0xC7, Z80::OUT8cr,   0,           false, { FRegY } },
+  { 0x62, 0xFF, Z80::SBC16aa },
+  { 0x72, 0xFF, Z80::SBC16SP },
+  { 0x42, 0xCF, Z80::SBC16ao,  0,           false, { FRegP } },
+  { 0x6A, 0xFF, Z80::ADC16aa },
+  { 0x7A, 0xFF, Z80::ADC16SP },
+  { 0x4A, 0xCF, Z80::ADC16ao,  0,           false, { FRegP } },
+  { 0x63, 0xFF, Z80::LD16ma,   0,           true,  { FImm16, FIdx } },
+  { 0x73, 0xFF, Z80::LD16mSP,  0,           false, { FImm16 } },
+  { 0x43, 0xCF, Z80::LD16mo,   0,           false, { FImm16, FRegP } },
+  { 0x6B, 0xFF, Z80::LD16am,   0,           true,  { FIdx, FImm16 } },
+  { 0x7B, 0xFF, Z80::LD16SPm,  0,           false, { FImm16 } },
+  { 0x4B, 0xCF, Z80::LD16om,   0,           false, { FRegP, FImm16 } },
+  { 0x44, 0xFF, Z80::NEG8 },
+  { 0x44, 0xC7, Z80::NEG8,     0,           true },
+  { 0x45, 0xFF, Z80::RETN },
+  { 0x4D, 0xFF, Z80::RETI },
+  { 0x45, 0xC7, Z80::RETN,     0,           true },
+  { 0x46, 0xFF, Z80::IM,       0,           false, { FMode } },
+  { 0x56, 0xFF, Z80::IM,       0,           false, { FMode } },
+  { 0x5E, 0xFF, Z80::IM,       0,           false, { FMode } },
+  { 0x46, 0xC7, Z80::IM,       0,           true,  { FMode } },
+  { 0x47, 0xFF, Z80::LD8ia },
+  { 0x4F, 0xFF, Z80::LD8ra },
+  { 0x57, 0xFF, Z80::LD8ai },
+  { 0x5F, 0xFF, Z80::LD8ar },
+  { 0x67, 0xFF, Z80::RRD },
+  { 0x6F, 0xFF, Z80::RLD },
+  { 0xA0, 0xFF, Z80::LDI },
+  { 0xA1, 0xFF, Z80::CPI },
+  { 0xA2, 0xFF, Z80::INI },
+  { 0xA3, 0xFF, Z80::OUTI },
+  { 0xA8, 0xFF, Z80::LDD },
+  { 0xA9, 0xFF, Z80::CPD },
+  { 0xAA, 0xFF, Z80::IND },
+  { 0xAB, 0xFF, Z80::OUTD },
+  { 0xB0, 0xFF, Z80::LDIR },
+  { 0xB1, 0xFF, Z80::CPIR },
+  { 0xB2, 0xFF, Z80::INIR },
+  { 0xB3, 0xFF, Z80::OTIR },
+  { 0xB8, 0xFF, Z80::LDDR },
+  { 0xB9, 0xFF, Z80::CPDR },
+  { 0xBA, 0xFF, Z80::INDR },
+  { 0xBB, 0xFF, Z80::OTDR },
+};
+
+namespace {
+typedef const OpcodePattern *OpcodeTable[256];
+
+class Z80Disassembler : public MCDisassembler {
+  std::unique_ptr<const MCInstrInfo> MCII;
+  OpcodeTable MainTable, CBTable, EDTable;
+
+public:
+  Z80Disassembler(const MCSubtargetInfo &STI, MCContext &Ctx,
+                  const MCInstrInfo *MCII);
+
+  DecodeStatus getInstruction(MCInst &MI, uint64_t &Size,
+                              ArrayRef<uint8_t> Bytes, uint64_t Address,
+                              raw_ostream &VStream,
+                              raw_ostream &CStream) const override;
+};
+} // end anonymous namespace
+
+/// Fill Table with the first of Patterns that matches each opcode.
+template <size_t N>
+static void buildTable(const OpcodePattern (&Patterns)[N], OpcodeTable &Table) {
+  for (unsigned Op = 0; Op != 256; ++Op) {
+    Table[Op] = nullptr;
+    for (const OpcodePattern &P : Patterns) {
+      if ((Op & P.Mask) == P.Value) {
+        Table[Op] = &P;
+        break;
+      }
+    }
+  }
+}
+
+Z80Disassembler::Z80Disassembler(const MCSubtargetInfo &STI, MCContext &Ctx,
+                                 const MCInstrInfo *MCII)
+  : MCDisassembler(STI, Ctx), MCII(MCII) {
+  buildTable(MainPatterns, MainTable);
+  buildTable(CBPatterns, CBTable);
+  buildTable(EDPatterns, EDTable);
+}
+
+/// Return the undocumented form of an (ix+d) cb instruction that also copies
+/// its result to a register.  bit has no result, and ignores the register.
+static unsigned getIndexedCopyOpcode(unsigned Opc) {
+  switch (Opc) {
+  default: llvm_unreachable("Unexpected indexed cb opcode");
+  case Z80::RLC8o: return Z80::RLC8og;
+  case Z80::RRC8o: return Z80::RRC8og;
+  case Z80::RL8o:  return Z80::RL8og;
+  case Z80::RR8o:  return Z80::RR8og;
+  case Z80::SLA8o: return Z80::SLA8og;
+  case Z80::SRA8o: return Z80::SRA8og;
+  case Z80::SLL8o: return Z80::SLL8og;
+  case Z80::SRL8o: return Z80::SRL8og;
+  case Z80::BIT8bo: return Z80::BIT8bo;
+  case Z80::RES8bo: return Z80::RES8bog;
+  case Z80::SET8bo: return Z80::SET8bog;
+  }
+}
+
+DecodeStatus Z80Disassembler::getInstruction(MCInst &MI, uint64_t &Size,
+                                             ArrayRef<uint8_t> Bytes,
+                                             uint64_t Address,
+                                             raw_ostream &VStream,
+                                             raw_ostream &CStream) const {
+  unsigned Pos = 0;
+  auto ReadByte = [&](uint8_t &Byte) {
+    if (Pos == Bytes.size()) {
+      return false;
+    }
+    Byte = Bytes[Pos++];
+    return true;
+  };
+
+  Size = 0;
+  uint8_t Op;
+  if (!ReadByte(Op)) {
+    return Fail;
+  }
+
+  // A dd or fd prefix followed by another prefix does nothing, so it is left
+  // for the caller to skip.
+  unsigned IndexReg = 0;
+  if (Op == 0xDD || Op == 0xFD) {
+    IndexReg = Op == 0xDD ? Z80::IX : Z80::IY;
+    if (!ReadByte(Op)) {
+      return Fail;
+    }
+    if (Op == 0xDD || Op == 0xED || Op == 0xFD) {
+      Size = 1;
+      return Fail;
+    }
+  }
+
+  const OpcodePattern *Entry;
+  uint8_t Disp = 0;
+  bool HasDisp = false, Copy = false;
+  if (Op == 0xCB) {
+    if (IndexReg) {
+      if (!ReadByte(Disp)) {
+        return Fail;
+      }
+      HasDisp = true;
+    }
+    if (!ReadByte(Op)) {
+      return Fail;
+    }
+    // Indexed cb instructions all address (ix+d), whatever bits 2-0 say.
+    Copy = IndexReg && (Op & 7) != 6;
+    Entry = CBTable[IndexReg ? (Op & ~7) | 6 : Op];
+  } else if (Op == 0xED) {
+    if (!ReadByte(Op)) {
+      return Fail;
+    }
+    Entry = EDTable[Op];
+  } else {
+    Entry = MainTable[Op];
+  }
+  if (!Entry) {
+    Size = Pos;
+    return Fail;
+  }
+
+  bool Indexed = IndexReg && Entry->IdxOpcode;
+  bool UsesIndex = Indexed, Undoc = Entry->Undoc || Copy;
+  unsigned Opcode = Indexed ? Entry->IdxOpcode : Entry->Opcode;
+  SmallVector<OperandField, 4> Fields;
+  if (Copy) {
+    Opcode = getIndexedCopyOpcode(Opcode);
+    // bit doesn't write to the register.
+    if (Opcode != Z80::BIT8bo) {
+      Fields.push_back(FRegZ);
+    }
+  }
+  Fields.append(std::begin(Entry->Fields), std::end(Entry->Fields));
+
+  static const unsigned Reg8s[] = {
+    Z80::B, Z80::C, Z80::D, Z80::E, Z80::H, Z80::L, Z80::NoRegister, Z80::A
+  };
+  static const unsigned Modes[] = { 0, 0, 1, 2, 0, 0, 1, 2 };
+  unsigned Y = Op >> 3 & 7;
+  unsigned Z = Op & 7;
+
+  auto GetReg8 = [&](unsigned Field) -> unsigned {
+    unsigned Reg = Reg8s[Field];
+    // Outside of (ix+d) instructions, a prefix selects the index register
+    // halves in place of h and l.
+    if (IndexReg && !Indexed && (Reg == Z80::H || Reg == Z80::L)) {
+      UsesIndex = Undoc = true;
+      if (IndexReg == Z80::IX) {
+        return Reg == Z80::H ? Z80::IXH : Z80::IXL;
+      }
+      return Reg == Z80::H ? Z80::IYH : Z80::IYL;
+    }
+    return Reg;
+  };
+  auto GetIdx = [&]() -> unsigned {
+    if (IndexReg) {
+      UsesIndex = true;
+      return IndexReg;
+    }
+    return Z80::HL;
+  };
+
+  const MCInstrDesc &Desc = MCII->get(Opcode);
+  const OperandField *Field = Fields.begin();
+  for (unsigned I = 0, E = Desc.getNumOperands(); I != E; ++I) {
+    int TiedTo = Desc.getOperandConstraint(I, MCOI::TIED_TO);
+    if (TiedTo >= 0) {
+      MI.addOperand(MI.getOperand(TiedTo));
+      continue;
+    }
+    assert(Field != Fields.end() && *Field != FNone &&
+           "Missing operand field");
+    uint8_t Lo, Hi;
+    switch (*Field++) {
+    case FNone:
+      llvm_unreachable("Missing operand field");
+    case FRegY:
+      MI.addOperand(MCOperand::createReg(GetReg8(Y)));
+      break;
+    case FRegZ:
+      MI.addOperand(MCOperand::createReg(GetReg8(Z)));
+      break;
+    case FRegP:
+      switch (Y >> 1) {
+      case 0: MI.addOperand(MCOperand::createReg(Z80::BC)); break;
+      case 1: MI.addOperand(MCOperand::createReg(Z80::DE)); break;
+      case 2: MI.addOperand(MCOperand::createReg(GetIdx())); break;
+      case 3: MI.addOperand(MCOperand::createReg(Z80::SPS)); break;
+      }
+      break;
+    case FIdx:
+      MI.addOperand(MCOperand::createReg(GetIdx()));
+      break;
+    case FPtr:
+      if (!Indexed) {
+        MI.addOperand(MCOperand::createReg(Z80::HL));
+        break;
+      }
+      if (!HasDisp && !ReadByte(Disp)) {
+        return Fail;
+      }
+      HasDisp = true;
+      MI.addOperand(MCOperand::createReg(IndexReg));
+      MI.addOperand(MCOperand::createImm(int8_t(Disp)));
+      ++I; // The displacement is an operand of its own.
+      break;
+    case FImm8:
+      if (!ReadByte(Lo)) {
+        return Fail;
+      }
+      MI.addOperand(MCOperand::createImm(Lo));
+      break;
+    case FImm16:
+      if (!ReadByte(Lo) || !ReadByte(Hi)) {
+        return Fail;
+      }
+      MI.addOperand(MCOperand::createImm(Hi << 8 | Lo));
+      break;
+    case FRel8:
+      if (!ReadByte(Lo)) {
+        return Fail;
+      }
+      MI.addOperand(MCOperand::createImm(int8_t(Lo)));
+      break;
+    case FCondY:
+      MI.addOperand(MCOperand::createImm(Y));
+      break;
+    case FCondJR:
+      MI.addOperand(MCOperand::createImm(Y & 3));
+      break;
+    case FBit:
+      MI.addOperand(MCOperand::createImm(Y));
+      break;
+    case FRst:
+      MI.addOperand(MCOperand::createImm(Op & 0x38));
+      break;
+    case FMode:
+      MI.addOperand(MCOperand::createImm(Modes[Y]));
+      break;
+    }
+  }
+  MI.setOpcode(Opcode);
+
+  // A prefix that doesn't change the instruction is skipped on its own.
+  if (IndexReg && !UsesIndex) {
+    MI.clear();
+    Size = 1;
+    return Fail;
+  }
+  Size = Pos;
+  if (Undoc && !STI.getFeatureBits()[Z80::FeatureUndoc]) {
+    return Fail;
+  }
+  return Success;
+}
+
+static MCDisassembler *createZ80Disassembler(const Target &T,
+                                             const MCSubtargetInfo &STI,
+                                             MCContext &Ctx) {
+  return new Z80Disassembler(STI, Ctx, T.createMCInstrInfo());
+}
+
+extern "C" void LLVMInitializeZ80Disassembler() {
+  TargetRegistry::RegisterMCDisassembler(getTheZ80Target(),
+                                         createZ80Disassembler);
+}
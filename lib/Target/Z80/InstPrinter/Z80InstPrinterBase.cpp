@@ -17,6 +17,7 @@
 #include "llvm/MC/MCInst.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/MathExtras.h"
 using namespace llvm;
 
 #define DEBUG_TYPE "asm-printer"
@@ -81,7 +82,12 @@ void Z80InstPrinterBase::printOff(const MCInst *MI, unsigned Op,
 void Z80InstPrinterBase::printAddr(const MCInst *MI, unsigned Op,
                                    raw_ostream &OS) {
   printOperand(MI, Op, OS);
-  int8_t Off = MI->getOperand(Op + 1).getImm();
-  assert(Off == MI->getOperand(Op + 1).getImm() && "Offset out of range!");
-  OS << " + " << int(MI->getOperand(Op + 1).getImm());
+  const MCOperand &Off = MI->getOperand(Op + 1);
+  if (!Off.isImm()) {
+    OS << " + ";
+    printOperand(MI, Op + 1, OS);
+    return;
+  }
+  assert(isInt<8>(Off.getImm()) && "Offset out of range!");
+  OS << " + " << int(Off.getImm());
 }
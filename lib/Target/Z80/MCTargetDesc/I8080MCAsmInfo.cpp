@@ -21,17 +21,20 @@ void Z80MCAsmInfo::anchor() { }
 Z80MCAsmInfo::Z80MCAsmInfo(const Triple &T) {
   //bool Is16Bit = T.isArch16Bit() || T.getEnvironment() == Triple::CODE16;
   CodePointerSize = CalleeSaveStackSlotSize = 2; // Is16Bit ? 2 : 3;
-  MaxInstLength = 6;
+  MaxInstLength = 4; // dd cb d op
   DollarIsPC = true;
-  SeparatorString = nullptr;
+  // Statements are never joined on a line, but the parser needs a separator.
+  SeparatorString = "\n";
   CommentString = ";";
-  PrivateGlobalPrefix = PrivateLabelPrefix = "";
+  // Local labels must not reach the object file symbol table.
+  PrivateGlobalPrefix = PrivateLabelPrefix = ".L";
   Code16Directive = ".assume\tadl = 0";
   //Code24Directive = ".assume\tadl = 1";
   Code32Directive = Code64Directive = nullptr;
   AssemblerDialect = 0; //!Is16Bit;
   SupportsQuotedNames = false;
-  ZeroDirective = AsciiDirective = AscizDirective = nullptr;
+  ZeroDirective = "\tDS\t";
+  AsciiDirective = AscizDirective = nullptr;
   Data8bitsDirective = "\tDB\t";
   Data16bitsDirective = "\tDW\t";
   //Data24bitsDirective = "\tDW24\t";
@@ -42,7 +45,7 @@ Z80MCAsmInfo::Z80MCAsmInfo(const Triple &T) {
   HasFunctionAlignment = false;
   HasDotTypeDotSizeDirective = false;
   WeakDirective = nullptr;
-  UseIntegratedAssembler = false;
+  UseIntegratedAssembler = true;
   WeakDirective = nullptr;
   UseLogicalShr = false;
 }
@@ -58,6 +58,10 @@ MCSubtargetInfo *Z80_MC::createZ80MCSubtargetInfo(const Triple &TT,
     }
   }
 
+  if (CPU.empty()) {
+    CPU = "generic";
+  }
+
   return createZ80MCSubtargetInfoImpl(TT, CPU, ArchFS);
 }
 
@@ -107,6 +111,46 @@ static MCInstPrinter *createZ80MCInstPrinter(const Triple &TT,
   }
 }
 
+namespace {
+class Z80MCInstrAnalysis : public MCInstrAnalysis {
+public:
+  explicit Z80MCInstrAnalysis(const MCInstrInfo *MCII)
+    : MCInstrAnalysis(MCII) {}
+
+  bool evaluateBranch(const MCInst &Inst, uint64_t Addr, uint64_t Size,
+                      uint64_t &Target) const override {
+    switch (Inst.getOpcode()) {
+    default:
+      return false;
+    // Displacements are relative to the next instruction.
+    case Z80::JR:
+    case Z80::JRCC:
+    case Z80::DJNZ:
+      if (!Inst.getOperand(0).isImm()) {
+        return false;
+      }
+      Target = (Addr + Size + Inst.getOperand(0).getImm()) & 0xFFFF;
+      return true;
+    case Z80::JP16:
+    case Z80::JP16CC:
+    case Z80::CALL16i:
+    case Z80::CALL16CC:
+    // rst is a one byte call to its operand.
+    case Z80::RST:
+      if (!Inst.getOperand(0).isImm()) {
+        return false;
+      }
+      Target = Inst.getOperand(0).getImm() & 0xFFFF;
+      return true;
+    }
+  }
+};
+} // end anonymous namespace
+
+static MCInstrAnalysis *createZ80MCInstrAnalysis(const MCInstrInfo *Info) {
+  return new Z80MCInstrAnalysis(Info);
+}
+
 static MCTargetStreamer *createAsmTargetStreamer(MCStreamer &S,
                                                  formatted_raw_ostream &OS,
                                                  MCInstPrinter * /*InstPrint*/,
@@ -114,6 +158,11 @@ static MCTargetStreamer *createAsmTargetStreamer(MCStreamer &S,
   return new Z80TargetAsmStreamer(S, OS);
 }
 
+static MCTargetStreamer *
+createObjectTargetStreamer(MCStreamer &S, const MCSubtargetInfo &STI) {
+  return new Z80TargetELFStreamer(S);
+}
+
 extern "C" void LLVMInitializeZ80TargetMC() {
   for (Target *T : {&getTheZ80Target()/*, &getTheEZ80Target()*/}) {
     // Register the MC asm info.
@@ -132,15 +181,23 @@ extern "C" void LLVMInitializeZ80TargetMC() {
     // Register the MCInstPrinter.
     TargetRegistry::RegisterMCInstPrinter(*T, createZ80MCInstPrinter);
 
+    // Register the MC instruction analyzer.
+    TargetRegistry::RegisterMCInstrAnalysis(*T, createZ80MCInstrAnalysis);
+
     // Register the asm target streamer.
     TargetRegistry::RegisterAsmTargetStreamer(*T, createAsmTargetStreamer);
+
+    // Register the obj target streamer.
+    TargetRegistry::RegisterObjectTargetStreamer(*T,
+                                                 createObjectTargetStreamer);
   }
 
-  //TargetRegistry::RegisterMCAsmBackend(getTheZ80Target(), createZ80AsmBackend);
-#if 0
-  TargetRegistry::RegisterMCAsmBackend(getTheEZ80Target(),
-                                       createEZ80AsmBackend);
-#endif // 0
+  // Register the code emitter.
+  TargetRegistry::RegisterMCCodeEmitter(getTheZ80Target(),
+                                        createZ80MCCodeEmitter);
+
+  // Register the asm backend.
+  TargetRegistry::RegisterMCAsmBackend(getTheZ80Target(), createZ80AsmBackend);
 }
 
 unsigned llvm::getZ80SuperRegisterOrZero(unsigned Reg) {
@@ -50,6 +50,16 @@ public:
   void emitExtern(MCSymbol *Symbol) override;
 };
 
+class Z80TargetELFStreamer final : public Z80TargetStreamer {
+public:
+  explicit Z80TargetELFStreamer(MCStreamer &S);
+
+  void emitAlign(unsigned ByteAlignment) override;
+  void emitBlock(uint64_t NumBytes) override;
+  void emitGlobal(MCSymbol *Symbol) override;
+  void emitExtern(MCSymbol *Symbol) override;
+};
+
 } // end namespace llvm
 
 #endif // LLVM_LIB_TARGET_Z80_MCTARGETDESC_Z80TARGETSTREAMER_H
@@ -0,0 +1,185 @@
+//===-- Z80AsmBackend.cpp - Z80 Assembler Backend -------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the Z80AsmBackend class, which applies fixups and
+// relaxes jr to jp when its target is out of reach.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MCTargetDesc/Z80BaseInfo.h"
+#include "MCTargetDesc/Z80FixupKinds.h"
+#include "MCTargetDesc/Z80MCTargetDesc.h"
+#include "llvm/MC/MCAsmBackend.h"
+#include "llvm/MC/MCAssembler.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCELFObjectWriter.h"
+#include "llvm/MC/MCFixupKindInfo.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/MCValue.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+namespace {
+class Z80AsmBackend : public MCAsmBackend {
+  uint8_t OSABI;
+
+public:
+  explicit Z80AsmBackend(uint8_t OSABI)
+    : MCAsmBackend(support::little), OSABI(OSABI) {}
+
+  std::unique_ptr<MCObjectTargetWriter>
+  createObjectTargetWriter() const override {
+    return createZ80ELFObjectWriter(OSABI);
+  }
+
+  unsigned getNumFixupKinds() const override {
+    return Z80::NumTargetFixupKinds;
+  }
+
+  const MCFixupKindInfo &getFixupKindInfo(MCFixupKind Kind) const override;
+
+  void applyFixup(const MCAssembler &Asm, const MCFixup &Fixup,
+                  const MCValue &Target, MutableArrayRef<char> Data,
+                  uint64_t Value, bool IsResolved,
+                  const MCSubtargetInfo *STI) const override;
+
+  bool mayNeedRelaxation(const MCInst &Inst,
+                         const MCSubtargetInfo &STI) const override;
+  bool fixupNeedsRelaxation(const MCFixup &Fixup, uint64_t Value,
+                            const MCRelaxableFragment *DF,
+                            const MCAsmLayout &Layout) const override;
+  void relaxInstruction(const MCInst &Inst, const MCSubtargetInfo &STI,
+                        MCInst &Res) const override;
+
+  bool writeNopData(raw_ostream &OS, uint64_t Count) const override;
+};
+} // end anonymous namespace
+
+const MCFixupKindInfo &Z80AsmBackend::getFixupKindInfo(MCFixupKind Kind) const {
+  const static MCFixupKindInfo Infos[Z80::NumTargetFixupKinds] = {
+    // This table *must* be in the order that the fixup_* kinds are defined in
+    // Z80FixupKinds.h.
+    //
+    // Name                 Offset (bits) Size (bits)  Flags
+    { "fixup_8",            0,            8,           0 },
+    { "fixup_8_dis",        0,            8,           0 },
+    { "fixup_8_pcrel",      0,            8,           MCFixupKindInfo::FKF_IsPCRel },
+    { "fixup_16",           0,            16,          0 },
+  };
+
+  if (Kind < FirstTargetFixupKind) {
+    return MCAsmBackend::getFixupKindInfo(Kind);
+  }
+
+  assert(unsigned(Kind - FirstTargetFixupKind) < getNumFixupKinds() &&
+         "Invalid kind!");
+  return Infos[Kind - FirstTargetFixupKind];
+}
+
+void Z80AsmBackend::applyFixup(const MCAssembler &Asm, const MCFixup &Fixup,
+                               const MCValue &Target,
+                               MutableArrayRef<char> Data, uint64_t Value,
+                               bool IsResolved,
+                               const MCSubtargetInfo *STI) const {
+  MCContext &Ctx = Asm.getContext();
+  unsigned Size;
+  switch (unsigned(Fixup.getKind())) {
+  default:
+    llvm_unreachable("Unknown fixup kind!");
+  case FK_Data_1:
+  case Z80::fixup_8:
+    Size = 1;
+    if (!isUIntN(8, Value) && !isIntN(8, Value)) {
+      Ctx.reportError(Fixup.getLoc(), "value out of range for 8-bit fixup");
+    }
+    break;
+  case Z80::fixup_8_dis:
+    Size = 1;
+    if (!isIntN(8, Value)) {
+      Ctx.reportError(Fixup.getLoc(), "index displacement out of range");
+    }
+    break;
+  case FK_PCRel_1:
+  case Z80::fixup_8_pcrel:
+    Size = 1;
+    // The displacement is taken from the end of the instruction, which is just
+    // past the fixup.
+    Value -= 1;
+    if (IsResolved && !isIntN(8, Value)) {
+      Ctx.reportError(Fixup.getLoc(), "branch target out of range");
+    }
+    break;
+  case FK_Data_2:
+  case Z80::fixup_16:
+    Size = 2;
+    break;
+  case FK_Data_4:
+    Size = 4;
+    break;
+  }
+  if (!Value) {
+    return;
+  }
+
+  unsigned Offset = Fixup.getOffset();
+  assert(Offset + Size <= Data.size() && "Invalid fixup offset!");
+  for (unsigned I = 0; I != Size; ++I) {
+    Data[Offset + I] = uint8_t(Value >> (I * 8));
+  }
+}
+
+bool Z80AsmBackend::mayNeedRelaxation(const MCInst &Inst,
+                                      const MCSubtargetInfo &STI) const {
+  switch (Inst.getOpcode()) {
+  default:
+    return false;
+  case Z80::JR:
+  case Z80::JRCC:
+    return Inst.getOperand(0).isExpr();
+  }
+}
+
+bool Z80AsmBackend::fixupNeedsRelaxation(const MCFixup &Fixup, uint64_t Value,
+                                         const MCRelaxableFragment *DF,
+                                         const MCAsmLayout &Layout) const {
+  return !isIntN(8, int64_t(Value) - 1);
+}
+
+void Z80AsmBackend::relaxInstruction(const MCInst &Inst,
+                                     const MCSubtargetInfo &STI,
+                                     MCInst &Res) const {
+  Res = Inst;
+  switch (Inst.getOpcode()) {
+  default:
+    llvm_unreachable("Unexpected instruction to relax");
+  case Z80::JR:
+    Res.setOpcode(Z80::JP16);
+    break;
+  case Z80::JRCC:
+    Res.setOpcode(Z80::JP16CC);
+    break;
+  }
+}
+
+bool Z80AsmBackend::writeNopData(raw_ostream &OS, uint64_t Count) const {
+  OS.write_zeros(Count);
+  return true;
+}
+
+MCAsmBackend *llvm::createZ80AsmBackend(const Target &T,
+                                        const MCSubtargetInfo &STI,
+                                        const MCRegisterInfo &MRI,
+                                        const MCTargetOptions &Options) {
+  uint8_t OSABI =
+    MCELFObjectTargetWriter::getOSABI(STI.getTargetTriple().getOS());
+  return new Z80AsmBackend(OSABI);
+}
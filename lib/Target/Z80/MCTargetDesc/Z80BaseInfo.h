@@ -0,0 +1,75 @@
+//===-- Z80BaseInfo.h - Top level definitions for Z80 MC --------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains small standalone helper functions and enum definitions
+// for the Z80 target useful for the compiler back-end and the MC libraries.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_Z80_MCTARGETDESC_Z80BASEINFO_H
+#define LLVM_LIB_TARGET_Z80_MCTARGETDESC_Z80BASEINFO_H
+
+#include "llvm/MC/MCInstrDesc.h"
+
+namespace llvm {
+namespace Z80 {
+// Z80 specific condition code. These correspond to Z80_*_COND in
+// Z80InstrInfo.td. They must be kept in synch.
+enum CondCode {
+  COND_NZ = 0,
+  COND_Z = 1,
+  COND_NC = 2,
+  COND_C = 3,
+  LAST_SIMPLE_COND = COND_C,
+
+  COND_PO = 4,
+  COND_PE = 5,
+  COND_P = 6,
+  COND_M = 7,
+  LAST_VALID_COND = COND_M,
+
+  COND_INVALID
+};
+} // end namespace Z80;
+
+namespace Z80II {
+enum {
+  PrefixShift = 0,
+  NoPrefix = 0,
+  CBPrefix = 1,
+  DDPrefix = 2,
+  DDCBPrefix = 3,
+  EDPrefix = 4,
+  FDPrefix = 5,
+  FDCBPrefix = 6,
+  AnyIndexPrefix = 7,
+  PrefixMask = 7,
+  IndexedIndexPrefix = 8,
+
+  HasOff = 1 << 4,
+  HasImm = 1 << 5,
+  ImmSizeShift = 6,
+  ImmSizeMask = 3,
+
+  OpcodeShift = 8,
+  OpcodeMask = 0xFF,
+
+  NotTakenShift = 16,
+  NotTakenMask = 0x1F
+};
+
+/// Return the T-states taken by a conditional branch that falls through, or
+/// by a block instruction that stops repeating, or 0 for anything else.
+inline unsigned getNotTakenCycles(const MCInstrDesc &Desc) {
+  return Desc.TSFlags >> NotTakenShift & NotTakenMask;
+}
+} // end namespace Z80II;
+} // end namespace llvm;
+
+#endif
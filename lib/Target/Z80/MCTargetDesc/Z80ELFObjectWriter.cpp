@@ -0,0 +1,65 @@
+//===-- Z80ELFObjectWriter.cpp - Z80 ELF Writer ---------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file maps Z80 fixups to the ELF relocations used by binutils.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MCTargetDesc/Z80FixupKinds.h"
+#include "MCTargetDesc/Z80MCTargetDesc.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCELFObjectWriter.h"
+#include "llvm/MC/MCFixup.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/MC/MCValue.h"
+#include "llvm/Support/ErrorHandling.h"
+using namespace llvm;
+
+namespace {
+class Z80ELFObjectWriter : public MCELFObjectTargetWriter {
+public:
+  explicit Z80ELFObjectWriter(uint8_t OSABI)
+    : MCELFObjectTargetWriter(/*Is64Bit=*/false, OSABI, ELF::EM_Z80,
+                              /*HasRelocationAddend=*/true) {}
+
+protected:
+  unsigned getRelocType(MCContext &Ctx, const MCValue &Target,
+                        const MCFixup &Fixup, bool IsPCRel) const override;
+};
+} // end anonymous namespace
+
+unsigned Z80ELFObjectWriter::getRelocType(MCContext &Ctx,
+                                          const MCValue &Target,
+                                          const MCFixup &Fixup,
+                                          bool IsPCRel) const {
+  switch (unsigned(Fixup.getKind())) {
+  default:
+    Ctx.reportError(Fixup.getLoc(), "unsupported relocation");
+    return ELF::R_Z80_NONE;
+  case FK_Data_1:
+  case Z80::fixup_8:
+    return ELF::R_Z80_8;
+  case Z80::fixup_8_dis:
+    return ELF::R_Z80_8_DIS;
+  case FK_PCRel_1:
+  case Z80::fixup_8_pcrel:
+    return ELF::R_Z80_8_PCREL;
+  case FK_Data_2:
+  case Z80::fixup_16:
+    return ELF::R_Z80_16;
+  case FK_Data_4:
+    return ELF::R_Z80_32;
+  }
+}
+
+std::unique_ptr<MCObjectTargetWriter>
+llvm::createZ80ELFObjectWriter(uint8_t OSABI) {
+  return llvm::make_unique<Z80ELFObjectWriter>(OSABI);
+}
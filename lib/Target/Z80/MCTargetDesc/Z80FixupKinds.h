@@ -15,8 +15,21 @@
 namespace llvm {
 namespace Z80 {
 enum Fixups {
+  // 8-bit absolute value, as in ld a, n.
+  fixup_8 = FirstTargetFixupKind,
+
+  // 8-bit signed displacement of an (ix+d) or (iy+d) operand.
+  fixup_8_dis,
+
+  // 8-bit pc-relative displacement of jr and djnz, relative to the end of the
+  // instruction.
+  fixup_8_pcrel,
+
+  // 16-bit absolute value, as in ld hl, nn and jp nn.
+  fixup_16,
+
   // Marker
-  LastTargetFixupKind = FirstTargetFixupKind,
+  LastTargetFixupKind,
   NumTargetFixupKinds = LastTargetFixupKind - FirstTargetFixupKind
 };
 }
@@ -0,0 +1,313 @@
+//===-- Z80MCCodeEmitter.cpp - Convert Z80 code to machine code -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the Z80MCCodeEmitter class.
+//
+// An instruction is encoded as
+//
+//   [dd|fd] [cb|ed] opcode [d] [n [n]]
+//
+// except that indexed cb instructions put the displacement before the opcode,
+// as in dd cb d opcode.  A dd or fd prefix is added whenever an operand is ix
+// or iy, or one of their halves, and in that case an instruction with an
+// (hl) form takes a displacement, which is 0 unless the operand is (ix+d).
+//
+//===----------------------------------------------------------------------===//
+
+#include "MCTargetDesc/Z80BaseInfo.h"
+#include "MCTargetDesc/Z80FixupKinds.h"
+#include "MCTargetDesc/Z80MCTargetDesc.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/MC/MCCodeEmitter.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCFixup.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "mccodeemitter"
+
+STATISTIC(MCNumEmitted, "Number of MC instructions emitted");
+
+namespace {
+class Z80MCCodeEmitter : public MCCodeEmitter {
+  const MCInstrInfo &MCII;
+  const MCRegisterInfo &MRI;
+
+public:
+  Z80MCCodeEmitter(const MCInstrInfo &MCII, const MCRegisterInfo &MRI,
+                   MCContext &Ctx)
+    : MCII(MCII), MRI(MRI) {}
+  Z80MCCodeEmitter(const Z80MCCodeEmitter &) = delete;
+  Z80MCCodeEmitter &operator=(const Z80MCCodeEmitter &) = delete;
+  ~Z80MCCodeEmitter() override = default;
+
+  void encodeInstruction(const MCInst &MI, raw_ostream &OS,
+                         SmallVectorImpl<MCFixup> &Fixups,
+                         const MCSubtargetInfo &STI) const override;
+
+private:
+  /// getIndexPrefix - Return 0xDD or 0xFD if an explicit operand of MI is ix
+  /// or iy, or one of their halves, and 0 otherwise.
+  uint8_t getIndexPrefix(const MCInst &MI) const;
+
+  /// getOpcode - Return the opcode byte of MI, with any register or condition
+  /// fields filled in.
+  uint8_t getOpcode(const MCInst &MI, uint8_t Base) const;
+
+  unsigned getRegEncoding(const MCInst &MI, unsigned OpNo) const {
+    return MRI.getEncodingValue(MI.getOperand(OpNo).getReg());
+  }
+
+  void emitByte(uint8_t Byte, unsigned &CurByte, raw_ostream &OS) const {
+    OS << char(Byte);
+    ++CurByte;
+  }
+
+  /// emitValue - Emit Size bytes of Op, little endian, recording a fixup of
+  /// kind Kind if it cannot be evaluated yet.
+  void emitValue(const MCOperand &Op, unsigned Size, MCFixupKind Kind,
+                 unsigned &CurByte, raw_ostream &OS,
+                 SmallVectorImpl<MCFixup> &Fixups, SMLoc Loc) const;
+};
+} // end anonymous namespace
+
+uint8_t Z80MCCodeEmitter::getIndexPrefix(const MCInst &MI) const {
+  // Lowered instructions carry their implicit operands as well.
+  unsigned NumOps = MCII.get(MI.getOpcode()).getNumOperands();
+  for (unsigned I = 0; I != NumOps; ++I) {
+    const MCOperand &Op = MI.getOperand(I);
+    if (!Op.isReg() || !Op.getReg()) {
+      continue;
+    }
+    if (MRI.isSubRegisterEq(Z80::IX, Op.getReg())) {
+      return 0xDD;
+    }
+    if (MRI.isSubRegisterEq(Z80::IY, Op.getReg())) {
+      return 0xFD;
+    }
+  }
+  return 0;
+}
+
+uint8_t Z80MCCodeEmitter::getOpcode(const MCInst &MI, uint8_t Base) const {
+  switch (MI.getOpcode()) {
+  default:
+    return Base;
+
+  // ld r, r'
+  case Z80::LD8gg:
+    return Base | getRegEncoding(MI, 0) << 3 | getRegEncoding(MI, 1);
+
+  // Destination register in bits 5-3.
+  case Z80::LD8ri:
+  case Z80::LD8gp:
+  case Z80::LD8go:
+  case Z80::IN8rc:
+  case Z80::OUT8cr:
+    return Base | getRegEncoding(MI, 0) << 3;
+
+  // Source register in bits 2-0.
+  case Z80::LD8pg:
+    return Base | getRegEncoding(MI, 1);
+  case Z80::LD8og:
+    return Base | getRegEncoding(MI, 2);
+  case Z80::ADD8ar: case Z80::ADC8ar: case Z80::SUB8ar: case Z80::SBC8ar:
+  case Z80::AND8ar: case Z80::XOR8ar: case Z80::OR8ar: case Z80::CP8ar:
+    return Base | getRegEncoding(MI, 0);
+
+  // inc and dec keep the operation in bits 2-0 and the operand in bits 5-3,
+  // which is 6 for (hl).
+  case Z80::INC8r: case Z80::DEC8r:
+    return getRegEncoding(MI, 0) << 3 | Base;
+  case Z80::INC8p: case Z80::DEC8p:
+  case Z80::INC8o: case Z80::DEC8o:
+    return 6 << 3 | Base;
+
+  // cb rotates and shifts the other way around.
+  case Z80::RLC8r: case Z80::RRC8r: case Z80::RL8r: case Z80::RR8r:
+  case Z80::SLA8r: case Z80::SRA8r: case Z80::SLL8r: case Z80::SRL8r:
+  case Z80::RLC8og: case Z80::RRC8og: case Z80::RL8og: case Z80::RR8og:
+  case Z80::SLA8og: case Z80::SRA8og: case Z80::SLL8og: case Z80::SRL8og:
+    return Base << 3 | getRegEncoding(MI, 0);
+  case Z80::RLC8p: case Z80::RRC8p: case Z80::RL8p: case Z80::RR8p:
+  case Z80::SLA8p: case Z80::SRA8p: case Z80::SLL8p: case Z80::SRL8p:
+  case Z80::RLC8o: case Z80::RRC8o: case Z80::RL8o: case Z80::RR8o:
+  case Z80::SLA8o: case Z80::SRA8o: case Z80::SLL8o: case Z80::SRL8o:
+    return Base << 3 | 6;
+
+  // bit, res and set put the bit number between the operation and the
+  // operand.
+  case Z80::BIT8bg:
+    return Base | MI.getOperand(0).getImm() << 3 | getRegEncoding(MI, 1);
+  case Z80::BIT8bp: case Z80::BIT8bo:
+  case Z80::RES8bp: case Z80::RES8bo:
+  case Z80::SET8bp: case Z80::SET8bo:
+    return Base | MI.getOperand(0).getImm() << 3 | 6;
+  case Z80::RES8bg: case Z80::RES8bog:
+  case Z80::SET8bg: case Z80::SET8bog:
+    return Base | MI.getOperand(1).getImm() << 3 | getRegEncoding(MI, 0);
+
+  // Register pair in bits 5-4.
+  case Z80::LD16ri:
+  case Z80::LD16om:
+  case Z80::POP16r:
+  case Z80::PUSH16r:
+  case Z80::INC16r:
+  case Z80::DEC16r:
+  case Z80::SBC16ao:
+  case Z80::ADC16ao:
+    return Base | getRegEncoding(MI, 0) << 4;
+  case Z80::LD16mo:
+    return Base | getRegEncoding(MI, 1) << 4;
+  case Z80::ADD16ao:
+    return Base | getRegEncoding(MI, 2) << 4;
+  case Z80::SBC16aa:
+  case Z80::ADC16aa:
+    return Base | MRI.getEncodingValue(Z80::HL) << 4;
+
+  // Condition in bits 5-3.
+  case Z80::JRCC:
+    assert(MI.getOperand(1).getImm() <= Z80::LAST_SIMPLE_COND &&
+           "jr only takes nz, z, nc and c");
+    return 0x20 | MI.getOperand(1).getImm() << 3;
+  case Z80::JP16CC:
+    return 0xC2 | MI.getOperand(1).getImm() << 3;
+  case Z80::CALL16CC:
+    return Base | MI.getOperand(1).getImm() << 3;
+  case Z80::RETCC:
+    return Base | MI.getOperand(0).getImm() << 3;
+
+  case Z80::RST:
+    assert(!(MI.getOperand(0).getImm() & ~0x38) && "Invalid rst target");
+    return Base | MI.getOperand(0).getImm();
+  case Z80::IM: {
+    static const uint8_t Modes[] = { 0x46, 0x56, 0x5E };
+    assert(unsigned(MI.getOperand(0).getImm()) < 3 && "Invalid interrupt mode");
+    return Modes[MI.getOperand(0).getImm()];
+  }
+  }
+}
+
+void Z80MCCodeEmitter::emitValue(const MCOperand &Op, unsigned Size,
+                                 MCFixupKind Kind, unsigned &CurByte,
+                                 raw_ostream &OS,
+                                 SmallVectorImpl<MCFixup> &Fixups,
+                                 SMLoc Loc) const {
+  int64_t Value = 0;
+  if (Op.isImm()) {
+    Value = Op.getImm();
+  } else if (!Op.getExpr()->evaluateAsAbsolute(Value)) {
+    Fixups.push_back(MCFixup::create(CurByte, Op.getExpr(), Kind, Loc));
+  }
+  for (unsigned I = 0; I != Size; ++I) {
+    emitByte(Value >> (I * 8), CurByte, OS);
+  }
+}
+
+void Z80MCCodeEmitter::encodeInstruction(const MCInst &MI, raw_ostream &OS,
+                                         SmallVectorImpl<MCFixup> &Fixups,
+                                         const MCSubtargetInfo &STI) const {
+  const MCInstrDesc &Desc = MCII.get(MI.getOpcode());
+  uint64_t TSFlags = Desc.TSFlags;
+  if (Desc.isPseudo()) {
+    report_fatal_error("Cannot encode pseudo instruction " +
+                       Twine(MCII.getName(MI.getOpcode())));
+  }
+
+  uint8_t IndexPrefix = getIndexPrefix(MI);
+  uint8_t Prefix = 0;
+  if (!(TSFlags & Z80II::IndexedIndexPrefix)) {
+    switch (TSFlags >> Z80II::PrefixShift & Z80II::PrefixMask) {
+    case Z80II::CBPrefix:
+      Prefix = 0xCB;
+      break;
+    case Z80II::DDCBPrefix:
+      IndexPrefix = 0xDD;
+      Prefix = 0xCB;
+      break;
+    case Z80II::FDCBPrefix:
+      IndexPrefix = 0xFD;
+      Prefix = 0xCB;
+      break;
+    case Z80II::EDPrefix:
+      Prefix = 0xED;
+      break;
+    case Z80II::DDPrefix:
+      IndexPrefix = 0xDD;
+      break;
+    case Z80II::FDPrefix:
+      IndexPrefix = 0xFD;
+      break;
+    }
+  }
+  uint8_t Opcode =
+    getOpcode(MI, TSFlags >> Z80II::OpcodeShift & Z80II::OpcodeMask);
+
+  // Find the displacement of an (ix+d) operand, and the immediate.
+  int DispOp = -1, ImmOp = -1;
+  for (unsigned I = 0, E = Desc.getNumOperands(); I != E; ++I) {
+    if (Desc.OpInfo[I].isLookupPtrRegClass() && Desc.OpInfo[I].RegClass == 2) {
+      DispOp = ++I;
+    } else if (ImmOp < 0 && !MI.getOperand(I).isReg()) {
+      ImmOp = I;
+    }
+  }
+  MCOperand ZeroDisp = MCOperand::createImm(0);
+  const MCOperand &Disp = DispOp < 0 ? ZeroDisp : MI.getOperand(DispOp);
+  bool HasDisp = IndexPrefix && TSFlags & Z80II::HasOff;
+
+  unsigned CurByte = 0;
+  if (IndexPrefix) {
+    emitByte(IndexPrefix, CurByte, OS);
+  }
+  if (Prefix) {
+    emitByte(Prefix, CurByte, OS);
+  }
+  if (Prefix == 0xCB && HasDisp) {
+    emitValue(Disp, 1, MCFixupKind(Z80::fixup_8_dis), CurByte, OS, Fixups,
+              MI.getLoc());
+    emitByte(Opcode, CurByte, OS);
+  } else {
+    emitByte(Opcode, CurByte, OS);
+    if (HasDisp) {
+      emitValue(Disp, 1, MCFixupKind(Z80::fixup_8_dis), CurByte, OS, Fixups,
+                MI.getLoc());
+    }
+  }
+
+  if (TSFlags & Z80II::HasImm) {
+    assert(ImmOp >= 0 && "Missing immediate operand");
+    unsigned Size = TSFlags >> Z80II::ImmSizeShift & Z80II::ImmSizeMask;
+    MCFixupKind Kind;
+    if (Desc.OpInfo[ImmOp].OperandType == MCOI::OPERAND_PCREL) {
+      Kind = MCFixupKind(Z80::fixup_8_pcrel);
+    } else if (Size == 1) {
+      Kind = MCFixupKind(Z80::fixup_8);
+    } else {
+      Size = 2;
+      Kind = MCFixupKind(Z80::fixup_16);
+    }
+    emitValue(MI.getOperand(ImmOp), Size, Kind, CurByte, OS, Fixups,
+              MI.getLoc());
+  }
+
+  ++MCNumEmitted;
+}
+
+MCCodeEmitter *llvm::createZ80MCCodeEmitter(const MCInstrInfo &MCII,
+                                            const MCRegisterInfo &MRI,
+                                            MCContext &Ctx) {
+  return new Z80MCCodeEmitter(MCII, MRI, Ctx);
+}
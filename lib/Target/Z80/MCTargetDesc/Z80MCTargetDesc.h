@@ -45,7 +45,6 @@ MCSubtargetInfo *createZ80MCSubtargetInfo(const Triple &TT, StringRef CPU,
                                           StringRef FS);
 }
 
-#if 0
 MCCodeEmitter *createZ80MCCodeEmitter(const MCInstrInfo &MCII,
                                       const MCRegisterInfo &MRI,
                                       MCContext &Ctx);
@@ -54,19 +53,9 @@ MCAsmBackend *createZ80AsmBackend(const Target &T,
                                   const MCSubtargetInfo &STI,
                                   const MCRegisterInfo &MRI,
                                   const MCTargetOptions &Options);
-MCAsmBackend *createZ80AsmBackend(const Target &T, const MCRegisterInfo &MRI,
-                                  const Triple &TT, StringRef CPU,
-                                  const MCTargetOptions &Options);
-MCAsmBackend *createEZ80AsmBackend(const Target &T, const MCRegisterInfo &MRI,
-                                   const Triple &TT, StringRef CPU,
-                                   const MCTargetOptions &Options);
-
-/// Construct a Z80 OMF object writer.
-std::unique_ptr<MCObjectWriter> createZ80OMFObjectWriter(raw_pwrite_stream &OS);
-#endif // 0
 
 /// Construct a Z80 ELF object writer.
-std::unique_ptr<MCObjectTargetWriter> createZ80ELFObjectWriter();
+std::unique_ptr<MCObjectTargetWriter> createZ80ELFObjectWriter(uint8_t OSABI);
 
 unsigned getZ80SuperRegisterOrZero(unsigned Reg);
 } // End llvm namespace
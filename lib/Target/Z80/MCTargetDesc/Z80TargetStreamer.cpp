@@ -47,3 +47,22 @@ void Z80TargetAsmStreamer::emitExtern(MCSymbol *Symbol) {
   Symbol->print(OS, MAI);
   OS << '\n';
 }
+
+Z80TargetELFStreamer::Z80TargetELFStreamer(MCStreamer &S)
+  : Z80TargetStreamer(S) {}
+
+void Z80TargetELFStreamer::emitAlign(unsigned ByteAlignment) {
+  getStreamer().EmitValueToAlignment(ByteAlignment);
+}
+
+void Z80TargetELFStreamer::emitBlock(uint64_t NumBytes) {
+  getStreamer().EmitZeros(NumBytes);
+}
+
+void Z80TargetELFStreamer::emitGlobal(MCSymbol *Symbol) {
+  getStreamer().EmitSymbolAttribute(Symbol, MCSA_Global);
+}
+
+void Z80TargetELFStreamer::emitExtern(MCSymbol *Symbol) {
+  // Undefined symbols are already external in ELF.
+}
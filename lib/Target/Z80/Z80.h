@@ -22,6 +22,11 @@
 namespace llvm {
 class Z80TargetMachine;
 class FunctionPass;
+class ModulePass;
+
+/// Return a pass that picks the functions whose stack objects are kept in
+/// static storage, because they can never be active twice.
+ModulePass *createZ80StaticLocalsPass();
 
 /// This pass converts a legalized DAG into a Z80-specific DAG, ready for
 /// instruction scheduling.
@@ -39,6 +44,30 @@ FunctionPass *createZ80ExpandPseudoPass();
 
 /// Return a pass that optimizes instructions after register selection.
 FunctionPass *createZ80MachineLateOptimization();
+
+/// Return a pass that follows the values held in registers after register
+/// allocation and reuses them for constants and copies.
+FunctionPass *createZ80KnownValuesPass();
+
+/// Return a pass that keeps values spilled within a block in the shadow
+/// registers, when compiled code may use them.
+FunctionPass *createZ80ShadowSpillsPass();
+
+/// Return a pass that replaces the exit test of loops with a known trip count
+/// by a byte counter, or a pair of them, counted down to zero.
+FunctionPass *createZ80LoopCountersPass();
+
+/// Return a pass that prepares loops counting a byte down to zero to be
+/// closed with djnz, by hinting the counter to b.
+FunctionPass *createZ80HardwareLoopsPass();
+
+/// Return a pass that merges dec b and jp nz into djnz once the block layout
+/// is final.
+FunctionPass *createZ80FormDJNZPass();
+
+/// Return a pass that picks jr or jp for each branch by reach and cost.  It
+/// must run last, once no code moves anymore.
+FunctionPass *createZ80BranchSelectorPass();
 } // end namespace llvm;
 
 #endif
@@ -14,11 +14,19 @@
 
 #include "Z80AsmPrinter.h"
 #include "Z80.h"
+#include "Z80MachineFunctionInfo.h"
+#include "Z80StaticLocals.h"
+#include "Z80TargetObjectFile.h"
+#include "InstPrinter/Z80InstPrinter.h"
 #include "MCTargetDesc/I8080TargetStreamer.h"
+#include "llvm/CodeGen/MachineFrameInfo.h"
+#include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/Target/TargetLoweringObjectFile.h"
 #include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCExpr.h"
 #include "llvm/MC/MCStreamer.h"
 #include "llvm/Support/TargetRegistry.h"
+#include <algorithm>
 using namespace llvm;
 
 //===----------------------------------------------------------------------===//
@@ -48,6 +56,7 @@ void Z80AsmPrinter::emitInlineAsmEnd(const MCSubtargetInfo &StartInfo,
 }
 
 void Z80AsmPrinter::EmitEndOfAsmFile(Module &M) {
+  emitStaticFrames(M);
   Z80TargetStreamer *TS =
     static_cast<Z80TargetStreamer *>(OutStreamer->getTargetStreamer());
   for (const auto &Symbol : OutContext.getSymbols())
@@ -56,6 +65,61 @@ void Z80AsmPrinter::EmitEndOfAsmFile(Module &M) {
     }
 }
 
+void Z80AsmPrinter::EmitFunctionBodyEnd() {
+  // The size of a static frame is only known once the function is compiled.
+  const auto *FuncInfo = MF->getInfo<Z80MachineFunctionInfo>();
+  if (const char *Frame = FuncInfo->getStaticFrame())
+    if (unsigned Size = MF->getFrameInfo().getStackSize())
+      StaticFrames.push_back(
+        {&MF->getFunction(), GetExternalSymbolSymbol(Frame), Size, 0});
+}
+
+/// emitStaticFrames - Lay out the static frames of the module in one block,
+/// where the frames of functions that are never active at the same time
+/// overlap.  The largest frames are placed first, each at the lowest offset
+/// at which it doesn't overlap the frame of a function that may be active
+/// with it.
+void Z80AsmPrinter::emitStaticFrames(Module &M) {
+  if (StaticFrames.empty())
+    return;
+  Z80CallGraph CG(M);
+  std::stable_sort(StaticFrames.begin(), StaticFrames.end(),
+                   [](const StaticFrame &A, const StaticFrame &B) {
+                     return A.Size > B.Size;
+                   });
+  unsigned Size = 0;
+  for (auto I = StaticFrames.begin(), E = StaticFrames.end(); I != E; ++I) {
+    bool Moved;
+    do {
+      Moved = false;
+      for (auto P = StaticFrames.begin(); P != I; ++P)
+        if (!CG.canOverlap(I->F, P->F) && I->Offset < P->Offset + P->Size &&
+            P->Offset < I->Offset + I->Size) {
+          I->Offset = P->Offset + P->Size;
+          Moved = true;
+        }
+    } while (Moved);
+    Size = std::max(Size, I->Offset + I->Size);
+  }
+
+  Z80TargetStreamer *TS =
+    static_cast<Z80TargetStreamer *>(OutStreamer->getTargetStreamer());
+  OutStreamer->SwitchSection(
+    static_cast<const Z80TargetObjectFile &>(getObjFileLowering())
+    .getStaticFrameSection());
+  MCSymbol *Base = OutContext.createTempSymbol("frames", true);
+  OutStreamer->EmitLabel(Base);
+  TS->emitBlock(Size);
+  for (const StaticFrame &Frame : StaticFrames)
+    OutStreamer->EmitAssignment(
+      Frame.Symbol,
+      MCBinaryExpr::createAdd(MCSymbolRefExpr::create(Base, OutContext),
+                              MCConstantExpr::create(Frame.Offset, OutContext),
+                              OutContext));
+  OutStreamer->AddBlankLine();
+  StaticFrames.clear();
+}
+
 void Z80AsmPrinter::EmitGlobalVariable(const GlobalVariable *GV) {
   Z80TargetStreamer *TS =
     static_cast<Z80TargetStreamer *>(OutStreamer->getTargetStreamer());
@@ -105,6 +169,89 @@ void Z80AsmPrinter::EmitGlobalVariable(const GlobalVariable *GV) {
   OutStreamer->AddBlankLine();
 }
 
+void Z80AsmPrinter::printOperand(const MachineInstr *MI, unsigned OpNo,
+                                 raw_ostream &OS) {
+  const MachineOperand &MO = MI->getOperand(OpNo);
+  switch (MO.getType()) {
+  default:
+    llvm_unreachable("unknown operand type");
+  case MachineOperand::MO_Register:
+    OS << Z80InstPrinter::getRegisterName(MO.getReg());
+    return;
+  case MachineOperand::MO_Immediate:
+    OS << MO.getImm();
+    return;
+  case MachineOperand::MO_MachineBasicBlock:
+    MO.getMBB()->getSymbol()->print(OS, MAI);
+    return;
+  case MachineOperand::MO_GlobalAddress:
+    getSymbol(MO.getGlobal())->print(OS, MAI);
+    break;
+  case MachineOperand::MO_ExternalSymbol:
+    GetExternalSymbolSymbol(MO.getSymbolName())->print(OS, MAI);
+    break;
+  case MachineOperand::MO_BlockAddress:
+    GetBlockAddressSymbol(MO.getBlockAddress())->print(OS, MAI);
+    break;
+  }
+  if (MO.getOffset()) {
+    OS << " + " << MO.getOffset();
+  }
+}
+
+/// PrintAsmOperand - Print out an operand for an inline asm expression.  The
+/// L and H modifiers select the low and high half of a register pair.
+bool Z80AsmPrinter::PrintAsmOperand(const MachineInstr *MI, unsigned OpNo,
+                                    unsigned AsmVariant,
+                                    const char *ExtraCode, raw_ostream &OS) {
+  const MachineOperand &MO = MI->getOperand(OpNo);
+  if (ExtraCode && ExtraCode[0]) {
+    if (ExtraCode[1]) {
+      return true; // Unknown modifier.
+    }
+    switch (ExtraCode[0]) {
+    default:
+      // See if this is a generic print operand
+      return AsmPrinter::PrintAsmOperand(MI, OpNo, AsmVariant, ExtraCode, OS);
+    case 'L':
+    case 'H': {
+      if (!MO.isReg()) {
+        return true;
+      }
+      const TargetRegisterInfo &TRI = *MF->getSubtarget().getRegisterInfo();
+      unsigned SubReg = TRI.getSubReg(
+          MO.getReg(), ExtraCode[0] == 'L' ? Z80::sub_low : Z80::sub_high);
+      if (!SubReg) {
+        return true;
+      }
+      OS << Z80InstPrinter::getRegisterName(SubReg);
+      return false;
+    }
+    }
+  }
+  printOperand(MI, OpNo, OS);
+  return false;
+}
+
+/// PrintAsmMemoryOperand - Print out a memory operand for an inline asm
+/// expression, as (nn) for an 'm' operand and (ix + d) for an 'o' operand.
+bool Z80AsmPrinter::PrintAsmMemoryOperand(const MachineInstr *MI,
+                                          unsigned OpNo, unsigned AsmVariant,
+                                          const char *ExtraCode,
+                                          raw_ostream &OS) {
+  if (ExtraCode && ExtraCode[0]) {
+    return true; // Unknown modifier.
+  }
+  OS << '(';
+  printOperand(MI, OpNo, OS);
+  if (OpNo + 1 < MI->getNumOperands() && MI->getOperand(OpNo).isReg() &&
+      MI->getOperand(OpNo + 1).isImm()) {
+    OS << " + " << MI->getOperand(OpNo + 1).getImm();
+  }
+  OS << ')';
+  return false;
+}
+
 // Force static initialization.
 extern "C" void LLVMInitializeZ80AsmPrinter() {
   RegisterAsmPrinter<Z80AsmPrinter> X(getTheZ80Target());
@@ -12,12 +12,23 @@
 
 #include "Z80Subtarget.h"
 #include "llvm/CodeGen/AsmPrinter.h"
+#include <vector>
 
 namespace llvm {
 
 class LLVM_LIBRARY_VISIBILITY Z80AsmPrinter : public AsmPrinter {
   const Z80Subtarget *Subtarget;
 
+  /// StaticFrame - The static frame of a function of the module, and its
+  /// place in the storage shared by all of them.
+  struct StaticFrame {
+    const Function *F;
+    MCSymbol *Symbol;
+    unsigned Size;
+    unsigned Offset;
+  };
+  std::vector<StaticFrame> StaticFrames;
+
 public:
   explicit Z80AsmPrinter(TargetMachine &TM,
                          std::unique_ptr<MCStreamer> Streamer)
@@ -33,8 +44,20 @@ public:
   void emitInlineAsmEnd(const MCSubtargetInfo &StartInfo,
                         const MCSubtargetInfo *EndInfo) const override;
   void EmitEndOfAsmFile(Module &M) override;
+  void EmitFunctionBodyEnd() override;
   void EmitGlobalVariable(const GlobalVariable *GV) override;
   void EmitInstruction(const MachineInstr *MI) override;
+
+  bool PrintAsmOperand(const MachineInstr *MI, unsigned OpNo,
+                       unsigned AsmVariant, const char *ExtraCode,
+                       raw_ostream &OS) override;
+  bool PrintAsmMemoryOperand(const MachineInstr *MI, unsigned OpNo,
+                             unsigned AsmVariant, const char *ExtraCode,
+                             raw_ostream &OS) override;
+
+private:
+  void emitStaticFrames(Module &M);
+  void printOperand(const MachineInstr *MI, unsigned OpNo, raw_ostream &OS);
 };
 } // End llvm namespace
 
@@ -0,0 +1,213 @@
+//===-- Z80BranchSelector.cpp - Pick relative or absolute branches --------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains a pass that turns the jq/jqcc branch pseudos into either
+// a two byte jr or a three byte jp.  A jr only reaches -126..+129 bytes from
+// its own address and only exists for the nz, z, nc and c conditions.
+//
+// Every branch starts out as a jp.  Those that should become a jr are shrunk
+// whenever their target is in reach, and since shrinking only ever brings
+// blocks closer together this is repeated until nothing changes.
+//
+// When optimizing for size a jr is always preferred.  Otherwise its cost is
+// weighed against a jp using the schedule model, where a jp takes 10 cycles
+// either way, while a jr takes 12 when taken and 7 when not.  That makes a
+// conditional jr faster whenever it is taken less than 3 times in 5, and an
+// unconditional one never faster.
+//
+// This pass should be run last, just before the assembly printer.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Z80.h"
+#include "Z80InstrInfo.h"
+#include "Z80Subtarget.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineBranchProbabilityInfo.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/TargetSchedule.h"
+#include "llvm/Support/CommandLine.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "z80-branch-select"
+
+static cl::opt<bool>
+    BranchSelectEnabled("z80-branch-select", cl::Hidden, cl::init(true),
+                        cl::desc("Use relative branches when in reach"));
+
+STATISTIC(NumRelative, "Number of branches emitted as jr");
+STATISTIC(NumAbsolute, "Number of branches emitted as jp");
+
+namespace {
+class Z80BranchSelector : public MachineFunctionPass {
+public:
+  Z80BranchSelector() : MachineFunctionPass(ID) {}
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<MachineBranchProbabilityInfo>();
+    MachineFunctionPass::getAnalysisUsage(AU);
+  }
+
+  MachineFunctionProperties getRequiredProperties() const override {
+    return MachineFunctionProperties().set(
+             MachineFunctionProperties::Property::NoVRegs);
+  }
+
+  StringRef getPassName() const override {
+    return "Z80 Branch Selector";
+  }
+
+private:
+  unsigned getCycles(unsigned Opc, BranchProbability Taken) const;
+  bool wantsRelative(const MachineInstr &MI) const;
+  void measureFunction(MachineFunction &MF,
+                       SmallVectorImpl<unsigned> &BlockOffsets) const;
+  bool shrinkBranches(SmallVectorImpl<unsigned> &BlockOffsets);
+
+  const TargetInstrInfo *TII;
+  const MachineBranchProbabilityInfo *MBPI;
+  TargetSchedModel SchedModel;
+  SmallVector<MachineInstr *, 32> Candidates;
+  bool OptSize;
+  static char ID;
+};
+
+char Z80BranchSelector::ID = 0;
+} // end anonymous namespace
+
+FunctionPass *llvm::createZ80BranchSelectorPass() {
+  return new Z80BranchSelector();
+}
+
+/// Return the expected cycles, scaled by 2^16, of branch Opc when it is taken
+/// with probability Taken.
+unsigned Z80BranchSelector::getCycles(unsigned Opc,
+                                      BranchProbability Taken) const {
+  unsigned TakenCycles = SchedModel.computeInstrLatency(Opc);
+  unsigned NotTakenCycles = Z80II::getNotTakenCycles(TII->get(Opc));
+  return Taken.scale(TakenCycles << 16) +
+         Taken.getCompl().scale(NotTakenCycles << 16);
+}
+
+/// Return true if MI, a jq or jqcc, would be better off as a jr.
+bool Z80BranchSelector::wantsRelative(const MachineInstr &MI) const {
+  if (MI.getOpcode() == Z80::JQ) {
+    return OptSize || SchedModel.computeInstrLatency(Z80::JR) <
+                      SchedModel.computeInstrLatency(Z80::JP16);
+  }
+  if (MI.getOperand(1).getImm() > Z80::LAST_SIMPLE_COND) {
+    return false;
+  }
+  if (OptSize) {
+    return true;
+  }
+  const MachineBasicBlock *MBB = MI.getParent();
+  BranchProbability Taken =
+    MBPI->getEdgeProbability(MBB, MI.getOperand(0).getMBB());
+  return getCycles(Z80::JRCC, Taken) < getCycles(Z80::JP16CC, Taken);
+}
+
+/// Fill in the offset of each block given the current branch sizes.
+void Z80BranchSelector::measureFunction(
+    MachineFunction &MF, SmallVectorImpl<unsigned> &BlockOffsets) const {
+  unsigned Offset = 0;
+  for (auto &MBB : MF) {
+    BlockOffsets[MBB.getNumber()] = Offset;
+    for (auto &MI : MBB) {
+      Offset += TII->getInstSizeInBytes(MI);
+    }
+  }
+}
+
+/// Turn every candidate whose target is in reach into a jr.
+bool Z80BranchSelector::shrinkBranches(
+    SmallVectorImpl<unsigned> &BlockOffsets) {
+  bool Changed = false;
+  for (MachineInstr *&MI : Candidates) {
+    if (!MI) {
+      continue;
+    }
+    MachineBasicBlock *MBB = MI->getParent();
+    unsigned Offset = BlockOffsets[MBB->getNumber()];
+    for (auto I = MBB->begin(); &*I != MI; ++I) {
+      Offset += TII->getInstSizeInBytes(*I);
+    }
+    MachineBasicBlock *Dest = MI->getOperand(0).getMBB();
+    int64_t Distance = int64_t(BlockOffsets[Dest->getNumber()]) - Offset;
+    if (Distance < -126 || Distance > 129) {
+      continue;
+    }
+    MachineInstrBuilder MIB;
+    if (MI->getOpcode() == Z80::JQ) {
+      MIB = BuildMI(*MBB, MI, MI->getDebugLoc(), TII->get(Z80::JR))
+        .addMBB(Dest);
+    } else {
+      MIB = BuildMI(*MBB, MI, MI->getDebugLoc(), TII->get(Z80::JRCC))
+        .addMBB(Dest).addImm(MI->getOperand(1).getImm());
+    }
+    LLVM_DEBUG(dbgs() << "Relative: "; MIB->dump());
+    MI->eraseFromParent();
+    MI = nullptr;
+    ++NumRelative;
+    Changed = true;
+  }
+  return Changed;
+}
+
+bool Z80BranchSelector::runOnMachineFunction(MachineFunction &MF) {
+  TII = MF.getSubtarget().getInstrInfo();
+  MBPI = &getAnalysis<MachineBranchProbabilityInfo>();
+  SchedModel.init(&MF.getSubtarget());
+  OptSize = MF.getFunction().getAttributes()
+    .hasAttribute(AttributeList::FunctionIndex, Attribute::OptimizeForSize);
+
+  bool Changed = false;
+  Candidates.clear();
+  for (auto &MBB : MF) {
+    for (auto &MI : MBB.terminators()) {
+      unsigned Opc = MI.getOpcode();
+      if (Opc != Z80::JQ && Opc != Z80::JQCC) {
+        continue;
+      }
+      if (BranchSelectEnabled && wantsRelative(MI)) {
+        Candidates.push_back(&MI);
+      }
+    }
+  }
+
+  if (!Candidates.empty()) {
+    SmallVector<unsigned, 16> BlockOffsets(MF.getNumBlockIDs());
+    bool Shrunk;
+    do {
+      measureFunction(MF, BlockOffsets);
+      Shrunk = shrinkBranches(BlockOffsets);
+      Changed |= Shrunk;
+    } while (Shrunk);
+  }
+
+  // Whatever is left becomes a jp.
+  for (auto &MBB : MF) {
+    for (auto I = MBB.getFirstTerminator(), E = MBB.end(); I != E;) {
+      MachineInstr &MI = *I++;
+      unsigned Opc;
+      switch (MI.getOpcode()) {
+      default: continue;
+      case Z80::JQ:   Opc = Z80::JP16;   break;
+      case Z80::JQCC: Opc = Z80::JP16CC; break;
+      }
+      MI.setDesc(TII->get(Opc));
+      ++NumAbsolute;
+      Changed = true;
+    }
+  }
+  return Changed;
+}
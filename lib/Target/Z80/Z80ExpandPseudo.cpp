@@ -16,24 +16,9 @@
 #include "Z80.h"
 #include "Z80InstrInfo.h"
 #include "Z80Subtarget.h"
-#include "../../CodeGen/LiveDebugVariables.h"
-#include "../../CodeGen/SpillPlacement.h"
-#include "llvm/CodeGen/CalcSpillWeights.h"
-#include "llvm/CodeGen/EdgeBundles.h"
-#include "llvm/CodeGen/LiveStacks.h"
-#include "llvm/CodeGen/LiveIntervals.h"
-#include "llvm/CodeGen/LiveRangeEdit.h"
-#include "llvm/CodeGen/LiveRegMatrix.h"
-//#include "llvm/CodeGen/LiveStackAnalysis.h"
-#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
-#include "llvm/CodeGen/MachineDominators.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
-#include "llvm/CodeGen/MachineInstr.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
-#include "llvm/CodeGen/MachineLoopInfo.h"
-#include "llvm/CodeGen/MachineRegisterInfo.h"
-#include "llvm/CodeGen/RegAllocRegistry.h"
-#include "llvm/CodeGen/VirtRegMap.h"
 using namespace llvm;
 
 #define DEBUG_TYPE "z80-pseudo"
@@ -46,35 +31,8 @@ public:
   bool runOnMachineFunction(MachineFunction &MF) override;
 
   MachineFunctionProperties getRequiredProperties() const override {
-    return MachineFunctionProperties()
-           .set(MachineFunctionProperties::Property::TracksLiveness);
-  }
-
-  void getAnalysisUsage(AnalysisUsage &AU) const override {
-    AU.setPreservesCFG();
-    AU.addRequired<MachineBlockFrequencyInfo>();
-    AU.addPreserved<MachineBlockFrequencyInfo>();
-    //AU.addRequired<AAResultsWrapperPass>();
-    //AU.addPreserved<AAResultsWrapperPass>();
-    AU.addRequired<LiveIntervals>();
-    AU.addPreserved<LiveIntervals>();
-    AU.addRequired<SlotIndexes>();
-    AU.addPreserved<SlotIndexes>();
-    //AU.addRequired<LiveDebugVariables>();
-    //AU.addPreserved<LiveDebugVariables>();
-    AU.addRequired<LiveStacks>();
-    AU.addPreserved<LiveStacks>();
-    AU.addRequired<MachineDominatorTree>();
-    AU.addPreserved<MachineDominatorTree>();
-    AU.addRequired<MachineLoopInfo>();
-    AU.addPreserved<MachineLoopInfo>();
-    AU.addRequired<VirtRegMap>();
-    AU.addPreserved<VirtRegMap>();
-    AU.addRequired<LiveRegMatrix>();
-    AU.addPreserved<LiveRegMatrix>();
-    AU.addRequired<EdgeBundles>();
-    AU.addRequired<SpillPlacement>();
-    MachineFunctionPass::getAnalysisUsage(AU);
+    return MachineFunctionProperties().set(
+             MachineFunctionProperties::Property::NoVRegs);
   }
 
   StringRef getPassName() const override {
@@ -84,8 +42,12 @@ public:
 private:
 //  void ExpandCmp(MachineInstr &MI, MachineBasicBlock &MBB);
 //  void ExpandCmp0(MachineInstr &MI, MachineBasicBlock &MBB);
-//  bool ExpandMI(MachineBasicBlock::iterator &MI, MachineBasicBlock &MBB);
-//  bool ExpandMBB(MachineBasicBlock &MBB);
+  MachineBasicBlock *InsertBlockAfter(MachineBasicBlock &MBB);
+  MachineBasicBlock *SplitAfter(MachineInstr &MI, MachineBasicBlock &MBB);
+  void ExpandLDI(MachineInstr &MI, MachineBasicBlock &MBB);
+  void ExpandFillSP(MachineInstr &MI, MachineBasicBlock &MBB);
+  bool ExpandMI(MachineBasicBlock::iterator &MI, MachineBasicBlock &MBB);
+  bool ExpandMBB(MachineBasicBlock &MBB);
 
   const TargetInstrInfo *TII;
   static char ID;
@@ -125,38 +87,170 @@ FunctionPass *llvm::createZ80ExpandPseudoPass() {
 //  //  .addReg(MI.getOperand(0).getReg());
 //}
 //
-//bool Z80ExpandPseudo::ExpandMI(MachineBasicBlock::iterator &MI,
-//                               MachineBasicBlock &MBB) {
-//  switch (MI->getOpcode()) {
-//  default: return false;
-//  case Z80::CP16ao:
-//    //case Z80::CP24ao:
-//    ExpandCmp(*MI, MBB);
-//    break;
-//  case Z80::CP16a0:
-//    //case Z80::CP24a0:
-//    ExpandCmp0(*MI, MBB);
-//    break;
-//  }
-//  return false;
-//  MI = MBB.erase(MI);
-//  return true;
-//}
-//
-//bool Z80ExpandPseudo::ExpandMBB(MachineBasicBlock &MBB) {
-//  bool Modified = false;
-//  for (auto I = MBB.begin(), E = MBB.end(); I != E; ++I) {
-//    Modified |= ExpandMI(I, MBB);
-//  }
-//  return Modified;
-//}
+/// Create an empty block laid out right after MBB.
+MachineBasicBlock *Z80ExpandPseudo::InsertBlockAfter(MachineBasicBlock &MBB) {
+  MachineFunction &MF = *MBB.getParent();
+  MachineBasicBlock *NewMBB = MF.CreateMachineBasicBlock(MBB.getBasicBlock());
+  MF.insert(++MBB.getIterator(), NewMBB);
+  return NewMBB;
+}
+
+/// Move everything after MI into a new block laid out right after MBB.
+MachineBasicBlock *Z80ExpandPseudo::SplitAfter(MachineInstr &MI,
+                                               MachineBasicBlock &MBB) {
+  MachineBasicBlock *NewMBB = InsertBlockAfter(MBB);
+  NewMBB->splice(NewMBB->begin(), &MBB,
+                 std::next(MachineBasicBlock::iterator(MI)), MBB.end());
+  NewMBB->transferSuccessorsAndUpdatePHIs(&MBB);
+  return NewMBB;
+}
+
+/// Copy with ldi, fully unrolled for short blocks, where bc is not set up.
+/// Longer ones do the odd bytes first and then loop over 16 ldi at a time
+/// until p/v says bc is 0, which is still over 20% faster than ldir.
+void Z80ExpandPseudo::ExpandLDI(MachineInstr &MI, MachineBasicBlock &MBB) {
+  const unsigned Unroll = 16;
+  DebugLoc DL = MI.getDebugLoc();
+  unsigned Count = MI.getOperand(0).getImm();
+  bool Loop = MI.getOpcode() == Z80::LDI16Loop;
+  assert(Loop == (Count > Unroll) && "Wrong block copy for the count");
+  for (unsigned I = Loop ? Count % Unroll : Count; I; --I) {
+    MachineInstr *LDI = BuildMI(MBB, MI, DL, TII->get(Z80::LDI));
+    if (!Loop) {
+      LDI->findRegisterUseOperand(Z80::BC)->setIsUndef();
+    }
+  }
+  if (!Loop) {
+    return;
+  }
+  MachineBasicBlock *DoneMBB = SplitAfter(MI, MBB);
+  MachineBasicBlock *LoopMBB = InsertBlockAfter(MBB);
+  MBB.addSuccessor(LoopMBB);
+  LoopMBB->addSuccessor(LoopMBB);
+  LoopMBB->addSuccessor(DoneMBB);
+  for (unsigned I = 0; I != Unroll; ++I) {
+    BuildMI(LoopMBB, DL, TII->get(Z80::LDI));
+  }
+  BuildMI(LoopMBB, DL, TII->get(Z80::JQCC)).addMBB(LoopMBB)
+    .addImm(Z80::COND_PE);
+  LivePhysRegs LiveRegs;
+  computeAndAddLiveIns(LiveRegs, *DoneMBB);
+  computeAndAddLiveIns(LiveRegs, *LoopMBB);
+}
+
+/// Fill with push de from hl downwards.  Interrupts are disabled while sp
+/// points into the block, and only enabled again if ld a, i said they were.
+/// That holds off maskable interrupts for the whole fill, about 190 T-states
+/// per 32 bytes, so up to some 48000 T-states for 8K.  A nonmaskable one
+/// still pushes its return address below sp, which is harmless inside the
+/// block but writes the two bytes below it near the end of the fill.
+void Z80ExpandPseudo::ExpandFillSP(MachineInstr &MI, MachineBasicBlock &MBB) {
+  const unsigned Unroll = 16;
+  DebugLoc DL = MI.getDebugLoc();
+  unsigned Count = MI.getOperand(0).getImm();
+  assert(Count / Unroll <= 256 && "Too many iterations for djnz");
+  BuildMI(MBB, MI, DL, TII->get(Z80::LD8ai));
+  BuildMI(MBB, MI, DL, TII->get(Z80::DI));
+  BuildMI(MBB, MI, DL, TII->get(Z80::LD16ri), Z80::IY).addImm(0);
+  BuildMI(MBB, MI, DL, TII->get(Z80::ADD16SP), Z80::IY).addReg(Z80::IY);
+  BuildMI(MBB, MI, DL, TII->get(Z80::LD16SP)).addReg(Z80::HL);
+  MachineBasicBlock *DoneMBB = SplitAfter(MI, MBB);
+  MachineBasicBlock *TailMBB = &MBB, *LoopMBB = nullptr;
+  if (Count > 2 * Unroll) {
+    BuildMI(MBB, MI, DL, TII->get(Z80::LD8ri), Z80::B)
+      .addImm(Count / Unroll % 256);
+    LoopMBB = InsertBlockAfter(MBB);
+    TailMBB = InsertBlockAfter(*LoopMBB);
+    MBB.addSuccessor(LoopMBB);
+    LoopMBB->addSuccessor(LoopMBB);
+    LoopMBB->addSuccessor(TailMBB);
+    for (unsigned I = 0; I != Unroll; ++I) {
+      BuildMI(LoopMBB, DL, TII->get(Z80::PUSH16r)).addReg(Z80::DE);
+    }
+    BuildMI(LoopMBB, DL, TII->get(Z80::DJNZ)).addMBB(LoopMBB);
+    Count %= Unroll;
+  }
+  for (; Count; --Count) {
+    BuildMI(TailMBB, DL, TII->get(Z80::PUSH16r)).addReg(Z80::DE);
+  }
+  BuildMI(TailMBB, DL, TII->get(Z80::LD16SP)).addReg(Z80::IY);
+  BuildMI(TailMBB, DL, TII->get(Z80::JQCC)).addMBB(DoneMBB)
+    .addImm(Z80::COND_PO);
+  MachineBasicBlock *EnableMBB = InsertBlockAfter(*TailMBB);
+  BuildMI(EnableMBB, DL, TII->get(Z80::EI));
+  TailMBB->addSuccessor(EnableMBB);
+  TailMBB->addSuccessor(DoneMBB);
+  EnableMBB->addSuccessor(DoneMBB);
+  LivePhysRegs LiveRegs;
+  computeAndAddLiveIns(LiveRegs, *DoneMBB);
+  computeAndAddLiveIns(LiveRegs, *EnableMBB);
+  if (LoopMBB) {
+    computeAndAddLiveIns(LiveRegs, *TailMBB);
+    computeAndAddLiveIns(LiveRegs, *LoopMBB);
+  }
+}
+
+/// Expand the pseudo instructions that have to survive prologue/epilogue
+/// insertion.  Tail calls are returns until the epilogue has been emitted in
+/// front of them, only then do they become plain jumps.
+bool Z80ExpandPseudo::ExpandMI(MachineBasicBlock::iterator &MI,
+                               MachineBasicBlock &MBB) {
+  switch (MI->getOpcode()) {
+  default: return false;
+  case Z80::LDI16:
+  case Z80::LDI16Loop:
+  case Z80::FillSP16:
+    if (MI->getOpcode() != Z80::FillSP16) {
+      ExpandLDI(*MI, MBB);
+    } else {
+      ExpandFillSP(*MI, MBB);
+    }
+    // The rest of the block may have moved, so continue with the next one.
+    MI->getParent()->erase(MI);
+    MI = MBB.end();
+    return true;
+  case Z80::TCRETURN16i: {
+      MachineOperand &Tgt = MI->getOperand(0);
+      MachineInstrBuilder MIB =
+        BuildMI(MBB, MI, MI->getDebugLoc(), TII->get(Z80::JP16));
+      if (Tgt.isGlobal()) {
+        MIB.addGlobalAddress(Tgt.getGlobal(), Tgt.getOffset(),
+                             Tgt.getTargetFlags());
+      } else if (Tgt.isSymbol()) {
+        MIB.addExternalSymbol(Tgt.getSymbolName(), Tgt.getTargetFlags());
+      } else {
+        MIB.addImm(Tgt.getImm());
+      }
+      break;
+    }
+  case Z80::TCRETURN16r:
+    BuildMI(MBB, MI, MI->getDebugLoc(), TII->get(Z80::JP16r))
+    .addReg(MI->getOperand(0).getReg(), RegState::Kill);
+    break;
+  }
+  // Keep the argument registers live into the jump.
+  std::prev(MI)->copyImplicitOps(*MBB.getParent(), *MI);
+  MI = MBB.erase(MI);
+  return true;
+}
+
+bool Z80ExpandPseudo::ExpandMBB(MachineBasicBlock &MBB) {
+  bool Modified = false;
+  for (auto I = MBB.begin(), E = MBB.end(); I != E;) {
+    if (!ExpandMI(I, MBB)) {
+      ++I;
+      continue;
+    }
+    Modified = true;
+  }
+  return Modified;
+}
 
 bool Z80ExpandPseudo::runOnMachineFunction(MachineFunction &MF) {
-  getAnalysis<LiveIntervals>().addKillFlags(&getAnalysis<VirtRegMap>());
   TII = MF.getSubtarget().getInstrInfo();
   bool Modified = false;
-//  for (auto &MBB : MF) {
-//    Modified |= ExpandMBB(MBB);
-//  }
+  for (auto &MBB : MF) {
+    Modified |= ExpandMBB(MBB);
+  }
   return Modified;
 }
@@ -16,13 +16,28 @@
 #include "Z80InstrInfo.h"
 #include "Z80MachineFunctionInfo.h"
 #include "Z80Subtarget.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallSet.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
 #include "llvm/CodeGen/RegisterScavenging.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Target/TargetMachine.h"
 using namespace llvm;
 
+static cl::opt<unsigned>
+SPFrameMaxAccesses("z80-sp-frame-max-accesses",
+                   cl::desc("Address the frame relative to SP in functions "
+                            "with at most this many stack accesses"),
+                   cl::init(3), cl::Hidden);
+static cl::opt<unsigned>
+SPFrameMaxSize("z80-sp-frame-max-size",
+               cl::desc("Address the frame relative to SP in functions with "
+                        "at most this many bytes of stack objects"),
+               cl::init(16), cl::Hidden);
+
 Z80FrameLowering::Z80FrameLowering(const Z80Subtarget &STI)
   : TargetFrameLowering(StackGrowsDown, 1, -2),
     STI(STI), TII(*STI.getInstrInfo()), TRI(STI.getRegisterInfo()),
@@ -31,354 +46,737 @@ Z80FrameLowering::Z80FrameLowering(const Z80Subtarget &STI)
 
 /// hasFP - Return true if the specified function should have a dedicated frame
 /// pointer register.  This is true if the function has variable sized allocas
-/// or if frame pointer elimination is disabled.
+/// or if frame pointer elimination is disabled, and otherwise if it has stack
+/// objects that are neither addressed relative to SP nor in a static frame.
 bool Z80FrameLowering::hasFP(const MachineFunction &MF) const {
-  return MF.getTarget().Options.DisableFramePointerElim(MF) ||
-         MF.getFrameInfo().hasStackObjects();
+  const MachineFrameInfo &MFI = MF.getFrameInfo();
+  if (MF.getTarget().Options.DisableFramePointerElim(MF) ||
+      MFI.hasVarSizedObjects())
+    return true;
+  const auto &FuncInfo = *MF.getInfo<Z80MachineFunctionInfo>();
+  return MFI.hasStackObjects() && !FuncInfo.usesSPRelativeFrame() &&
+         !FuncInfo.getStaticFrame();
 }
-//
-//void Z80FrameLowering::BuildStackAdjustment(MachineFunction &MF,
-//                                            MachineBasicBlock &MBB,
-//                                            MachineBasicBlock::iterator MI,
-//                                            DebugLoc DL, unsigned ScratchReg,
-//                                            int Offset, int FPOffset,
-//                                            bool UnknownOffset) const {
-//  if (!Offset) {
-//    return;
-//  }
-//
-//  // Optimal if we are trying to set SP = FP
-//  //   LD SP, FP
-//  if (UnknownOffset || (FPOffset >= 0 && FPOffset == Offset)) {
-//    assert(hasFP(MF) && "This function doesn't have a frame pointer");
-//    BuildMI(MBB, MI, DL, TII.get(Z80::LD16SP))
-//    .addReg(TRI->getFrameRegister(MF));
-//    return;
-//  }
-//
-//  bool OptSize = MF.getFunction().getAttributes()
-//                 .hasAttribute(AttributeList::FunctionIndex, Attribute::OptimizeForSize);
-//
-//#if 0
-//  uint32_t IncDecCount = std::abs(Offset);
-//  const MCInstrDesc &MCID = TII.get(Offset >= 0 ? Z80::INC16SP : Z80::DEC16SP);
-//  while (IncDecCount--) {
-//    BuildMI(MBB, MI, DL, MCID);
-//  }
-//
-//  // ------------------------------------------------
-//#else
-//  bool Is24Bit = false;
-//
-//  // Optimal for small offsets
-//  //   POP/PUSH HL for every SlotSize bytes
-//  unsigned SmallCost = OptSize ? 1 : Is24Bit ? 4 : Offset >= 0 ? 10 : 11;
-//  uint32_t PopPushCount = std::abs(Offset) / SlotSize;
-//  SmallCost *= PopPushCount;
-//  //   INC/DEC SP for remaining bytes
-//  uint32_t IncDecCount = std::abs(Offset) % SlotSize;
-//  SmallCost += (OptSize || Is24Bit ? 1 : 6) * IncDecCount;
-//
-//  // Optimal for large offsets
-//  //   LD HL, Offset
-//  unsigned LargeCost = OptSize || Is24Bit ? 1 + SlotSize : 10;
-//  //   ADD HL, SP
-//  LargeCost += OptSize || Is24Bit ? 1 : 11;
-//  //   LD SP, HL
-//  LargeCost += OptSize || Is24Bit ? 1 : 6;
-//
-//  // Optimal for medium offsets
-//  //   LEA HL, FP - Offset - FPOffset
-//  //   LD SP, HL
-//  bool CanUseLEA = false; // STI.hasEZ80Ops() && FPOffset >= 0 &&
-//  // isInt<8>(Offset - FPOffset) && hasFP(MF);
-//  unsigned LEACost = CanUseLEA ? 4 : LargeCost;
-//
-//  // Prefer smaller version
-//  if (SmallCost <= LargeCost && SmallCost <= LEACost) {
-//    while (PopPushCount--)
-//      BuildMI(MBB, MI, DL, TII.get(Offset >= 0 ? Z80::POP16r : Z80::PUSH16r))
-//      .addReg(ScratchReg, getDefRegState(Offset >= 0) |
-//              getDeadRegState(Offset >= 0) | getUndefRegState(Offset < 0));
-//    while (IncDecCount--) {
-//      BuildMI(MBB, MI, DL, TII.get(Offset >= 0 ? Z80::INC16SP : Z80::DEC16SP));
-//    }
-//    return;
-//  }
-//
-//  if (LargeCost <= LEACost) {
-//    BuildMI(MBB, MI, DL, TII.get(Z80::LD16ri),
-//            ScratchReg).addImm(Offset);
-//    BuildMI(MBB, MI, DL, TII.get(Z80::ADD16SP),
-//            ScratchReg).addReg(ScratchReg);
-//  } else {
-//    assert(CanUseLEA && hasFP(MF) && "Can't use lea");
-//    //BuildMI(MBB, MI, DL, TII.get(Z80::LEA16ro),
-//    //        ScratchReg).addReg(TRI->getFrameRegister(MF))
-//    //  .addImm(Offset - FPOffset);
-//  }
-//  BuildMI(MBB, MI, DL, TII.get(Z80::LD16SP))
-//  .addReg(ScratchReg, RegState::Kill);
-//#endif
-//}
-//
+
+/// reservesFP - Spill slots only appear during register allocation, so
+/// whether the function has stack objects, and with it hasFP, isn't known
+/// when the reserved registers are frozen.  IX is kept unless the frame was
+/// chosen to be addressed relative to SP or static, even if it then goes
+/// unused.
+bool Z80FrameLowering::reservesFP(const MachineFunction &MF) const {
+  const MachineFrameInfo &MFI = MF.getFrameInfo();
+  if (MF.getTarget().Options.DisableFramePointerElim(MF) ||
+      MFI.hasVarSizedObjects())
+    return true;
+  const auto &FuncInfo = *MF.getInfo<Z80MachineFunctionInfo>();
+  return !FuncInfo.usesSPRelativeFrame() && !FuncInfo.getStaticFrame();
+}
+
+/// getStackFrameSize - Return the size of the part of the frame below the
+/// callee-saved registers that is allocated on the stack.  A static frame has
+/// none.
+unsigned Z80FrameLowering::getStackFrameSize(const MachineFunction &MF) const {
+  if (MF.getInfo<Z80MachineFunctionInfo>()->getStaticFrame())
+    return 0;
+  return MF.getFrameInfo().getStackSize();
+}
+
+/// canSimplifyCallFramePseudos - The call frame pseudos can only be removed
+/// before frame indices are eliminated when the frame is addressed relative to
+/// the frame pointer.  Otherwise the arguments pushed for a call have to be
+/// tracked to find the SP offset of a stack object.
+bool Z80FrameLowering::canSimplifyCallFramePseudos(
+  const MachineFunction &MF) const {
+  return hasFP(MF);
+}
+
+/// needsFrameIndexResolution - The call frame pseudos that are left have to be
+/// eliminated even when there are no stack objects to resolve.
+bool Z80FrameLowering::needsFrameIndexResolution(
+  const MachineFunction &MF) const {
+  const MachineFrameInfo &MFI = MF.getFrameInfo();
+  return MFI.hasStackObjects() || MFI.adjustsStack();
+}
+
+/// getFrameIndexReference - Return the frame register and the offset from it
+/// of a stack object, outside of call sequences.  IX points at its saved
+/// value, just above the locals, and the return address is above that.
+/// Without a frame pointer the locals are at the bottom of the frame, and the
+/// callee-saved registers are between them and the return address.  The
+/// locals of a static frame are at the same offsets from the start of its
+/// storage instead, and the arguments are right above the callee-saved
+/// registers.
+int Z80FrameLowering::getFrameIndexReference(const MachineFunction &MF,
+                                             int FI,
+                                             unsigned &FrameReg) const {
+  const MachineFrameInfo &MFI = MF.getFrameInfo();
+  FrameReg = TRI->getFrameRegister(MF);
+  int Offset = MFI.getObjectOffset(FI) - getOffsetOfLocalArea();
+  if (hasFP(MF)) {
+    if (FI < 0)
+      Offset += SlotSize;
+    return Offset;
+  }
+  if (FI >= 0)
+    return Offset + MFI.getStackSize();
+  return Offset + getStackFrameSize(MF) + SlotSize +
+         MF.getInfo<Z80MachineFunctionInfo>()->getCalleeSavedFrameSize();
+}
+
+/// shouldUseSPRelativeFrame - Called at the end of instruction selection, when
+/// the spill slots aren't known yet.  An access to the frame relative to SP
+/// takes ld hl,d / add hl,sp before the (hl) form of the instruction, about 2
+/// bytes and 9 T-states more than the (ix+d) form, or pop rr / push rr for the
+/// slot on top of the stack.  If the pointer and the flags are live, they are
+/// also pushed and popped around it, up to 4 more bytes and 42 more T-states
+/// with HL, which is most likely for the reload of a spilled value.  Setting
+/// up and restoring IX takes 12 bytes and 68 T-states, and IX is lost to the
+/// register allocator.  So an SP-relative frame pays off for small frames that
+/// are accessed a few times.
+///
+/// Only IX survives a call, so each value used after a call in a block counts
+/// as a reload, and its first one also as a store to a spill slot.
+bool Z80FrameLowering::shouldUseSPRelativeFrame(
+  const MachineFunction &MF) const {
+  const MachineFrameInfo &MFI = MF.getFrameInfo();
+  if (MF.getTarget().getOptLevel() == CodeGenOpt::None ||
+      MF.getTarget().Options.DisableFramePointerElim(MF) ||
+      MFI.hasVarSizedObjects() || MFI.hasOpaqueSPAdjustment() ||
+      MFI.estimateStackSize(MF) > SPFrameMaxSize)
+    return false;
+  unsigned Accesses = 0;
+  SmallSet<unsigned, 8> Spilled;
+  for (const MachineBasicBlock &MBB : MF) {
+    bool AfterCall = false;
+    SmallSet<unsigned, 8> Available;
+    for (const MachineInstr &MI : MBB) {
+      // Inline asm can't address an SP-relative frame.
+      if (MI.isInlineAsm())
+        return false;
+      if (MI.isDebugInstr())
+        continue;
+      for (const MachineOperand &MO : MI.operands()) {
+        if (MO.isFI()) {
+          ++Accesses;
+          continue;
+        }
+        if (!AfterCall || !MO.isReg() || !MO.isUse() ||
+            !TargetRegisterInfo::isVirtualRegister(MO.getReg()))
+          continue;
+        if (Available.insert(MO.getReg()).second)
+          Accesses += Spilled.insert(MO.getReg()).second ? 2 : 1;
+      }
+      if (MI.isCall()) {
+        AfterCall = true;
+        Available.clear();
+      }
+      for (const MachineOperand &MO : MI.defs())
+        if (TargetRegisterInfo::isVirtualRegister(MO.getReg()))
+          Available.insert(MO.getReg());
+    }
+  }
+  return Accesses <= SPFrameMaxAccesses;
+}
+
+/// shouldUseStaticFrame - Called at the end of instruction selection, like
+/// shouldUseSPRelativeFrame.  Z80StaticLocals has checked that the function
+/// is never active twice.  The arguments stay on the stack, and are addressed
+/// relative to SP.
+bool Z80FrameLowering::shouldUseStaticFrame(const MachineFunction &MF) const {
+  const MachineFrameInfo &MFI = MF.getFrameInfo();
+  if (!MF.getFunction().hasFnAttribute("z80-static-frame") ||
+      MF.getTarget().Options.DisableFramePointerElim(MF) ||
+      MFI.hasVarSizedObjects() || MFI.hasOpaqueSPAdjustment())
+    return false;
+  // Inline asm can't address a static frame.
+  for (const MachineBasicBlock &MBB : MF)
+    for (const MachineInstr &MI : MBB)
+      if (MI.isInlineAsm())
+        return false;
+  return true;
+}
+
+/// isClobberable - Return true if Reg may be used as a scratch register in
+/// the prologue or epilogue: it is neither reserved nor a callee-saved
+/// register that isn't saved.
+bool Z80FrameLowering::isClobberable(const MachineFunction &MF,
+                                     unsigned Reg) const {
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  if (MRI.isReserved(Reg))
+    return false;
+  const std::vector<CalleeSavedInfo> &CSI =
+    MF.getFrameInfo().getCalleeSavedInfo();
+  for (const MCPhysReg *CSR = MRI.getCalleeSavedRegs(); *CSR; ++CSR)
+    if (TRI->regsOverlap(*CSR, Reg) &&
+        none_of(CSI, [&](const CalleeSavedInfo &Info) {
+          return Info.getReg() == *CSR;
+        }))
+      return false;
+  return true;
+}
+
+/// findScratchReg - Return the first of Regs that is known to be dead before
+/// MI and may be clobbered, or 0 if there is none.
+unsigned Z80FrameLowering::findScratchReg(MachineBasicBlock &MBB,
+                                          MachineBasicBlock::iterator MI,
+                                          ArrayRef<MCPhysReg> Regs) const {
+  for (MCPhysReg Reg : Regs)
+    if (isClobberable(*MBB.getParent(), Reg) &&
+        MBB.computeRegisterLiveness(TRI, Reg, MI) ==
+        MachineBasicBlock::LQR_Dead)
+      return Reg;
+  return 0;
+}
+
+void Z80FrameLowering::BuildStackAdjustment(MachineFunction &MF,
+                                            MachineBasicBlock &MBB,
+                                            MachineBasicBlock::iterator MI,
+                                            DebugLoc DL, unsigned ScratchReg,
+                                            int Offset, int FPOffset,
+                                            bool UnknownOffset) const {
+  if (!Offset) {
+    return;
+  }
+
+  // Optimal if we are trying to set SP = FP
+  //   LD SP, FP
+  if (UnknownOffset || (FPOffset >= 0 && FPOffset == Offset)) {
+    assert(hasFP(MF) && "This function doesn't have a frame pointer");
+    BuildMI(MBB, MI, DL, TII.get(Z80::LD16SP))
+    .addReg(TRI->getFrameRegister(MF));
+    return;
+  }
+
+  bool OptSize = MF.getFunction().optForSize();
+  bool Alloc = Offset < 0;
+  unsigned Size = std::abs(Offset);
+
+  // For small offsets
+  //   PUSH/POP rr for every SlotSize bytes
+  //   DEC/INC SP for the remaining byte
+  // Any pair can be pushed undefined, so allocation pushes AF unless the
+  // scratch register is cheaper.  Deallocation needs a dead pair to pop into,
+  // and otherwise only increments SP.
+  unsigned SlotReg = 0;
+  if (Alloc)
+    SlotReg = Z80::GR16RegClass.contains(ScratchReg) ? ScratchReg
+                                                       : unsigned(Z80::AF);
+  else if (Z80::R16RegClass.contains(ScratchReg))
+    SlotReg = ScratchReg;
+  bool IsIndex = Z80::IR16RegClass.contains(SlotReg);
+  Z80::Cost SlotCost = Alloc ? (IsIndex ? Z80::Cost(2, 15) : Z80::Cost(1, 11))
+                             : (IsIndex ? Z80::Cost(2, 14) : Z80::Cost(1, 10));
+  unsigned SlotCount = SlotReg ? Size / SlotSize : 0;
+  unsigned IncDecCount = Size - SlotCount * SlotSize;
+  Z80::Cost SmallCost = SlotCost * SlotCount + Z80::Cost(1, 6) * IncDecCount;
+
+  // For large offsets
+  //   LD rr, Offset
+  //   ADD rr, SP
+  //   LD SP, rr
+  // which needs an address register and clobbers the flags.
+  bool CanUseLarge = Z80::AIR16RegClass.contains(ScratchReg) &&
+    MBB.computeRegisterLiveness(TRI, Z80::F, MI) == MachineBasicBlock::LQR_Dead;
+  Z80::Cost LargeCost = Z80::IR16RegClass.contains(ScratchReg)
+                      ? Z80::Cost(8, 39) : Z80::Cost(5, 27);
+
+  if (!CanUseLarge || !LargeCost.isBetter(SmallCost, OptSize)) {
+    while (SlotCount--) {
+      if (SlotReg == Z80::AF) {
+        BuildMI(MBB, MI, DL, TII.get(Z80::PUSH16AF))
+        ->findRegisterUseOperand(Z80::AF)->setIsUndef();
+      } else {
+        BuildMI(MBB, MI, DL, TII.get(Alloc ? Z80::PUSH16r : Z80::POP16r))
+        .addReg(SlotReg, getDefRegState(!Alloc) | getDeadRegState(!Alloc) |
+                getUndefRegState(Alloc));
+      }
+    }
+    while (IncDecCount--) {
+      BuildMI(MBB, MI, DL, TII.get(Alloc ? Z80::DEC16SP : Z80::INC16SP));
+    }
+    return;
+  }
+
+  BuildMI(MBB, MI, DL, TII.get(Z80::LD16ri),
+          ScratchReg).addImm(Offset);
+  BuildMI(MBB, MI, DL, TII.get(Z80::ADD16SP),
+          ScratchReg).addReg(ScratchReg);
+  BuildMI(MBB, MI, DL, TII.get(Z80::LD16SP))
+  .addReg(ScratchReg, RegState::Kill);
+}
+
+/// getFrameTopOffset - Return the offset from the top of the local frame of
+/// the byte stored by MI, if it stores into a local stack object, and 0
+/// otherwise.
+int Z80FrameLowering::getFrameTopOffset(const MachineInstr &MI) const {
+  const MachineOperand &FI = MI.getOperand(0);
+  if (!FI.isFI() || FI.getIndex() < 0)
+    return 0;
+  const MachineFrameInfo &MFI = MI.getParent()->getParent()->getFrameInfo();
+  return MFI.getObjectOffset(FI.getIndex()) - getOffsetOfLocalArea() +
+    MI.getOperand(1).getImm();
+}
+
+static bool isByteStoreToFrame(const MachineInstr &MI) {
+  switch (MI.getOpcode()) {
+  case Z80::LD8or: case Z80::LD8og: case Z80::LD8oi:
+    return MI.getOperand(0).isFI();
+  default:
+    return false;
+  }
+}
+
+/// Returns true if MI may access the frame or the stack, or otherwise can't be
+/// moved across the allocation of the frame.
+static bool blocksFrameInits(const MachineInstr &MI, const TargetInstrInfo &TII,
+                             const TargetRegisterInfo *TRI) {
+  if (MI.isCall() || MI.isTerminator() || MI.isInlineAsm() ||
+      MI.hasUnmodeledSideEffects() || TII.isFrameInstr(MI) ||
+      MI.readsRegister(Z80::SPS, TRI) || MI.modifiesRegister(Z80::SPS, TRI))
+    return true;
+  for (const MachineOperand &MO : MI.operands())
+    if (MO.isFI())
+      return true;
+  return false;
+}
+
+/// findFrameInits - Collect the stores starting at MI that fill the frame
+/// from the top down, before anything else can touch it, so that the frame
+/// can be built by pushing the stored values.  Returns the point where the
+/// rest of the frame has to be allocated.
+MachineBasicBlock::iterator
+Z80FrameLowering::findFrameInits(MachineBasicBlock &MBB,
+                                 MachineBasicBlock::iterator MI,
+                                 SmallVectorImpl<FrameInit> &Inits) const {
+  int Bottom = -int(MBB.getParent()->getFrameInfo().getStackSize());
+  MachineBasicBlock::iterator E = MBB.end();
+  for (int Top = -int(SlotSize); Top >= Bottom;) {
+    MI = skipDebugInstructionsForward(MI, E);
+    if (MI == E)
+      break;
+    FrameInit Init;
+    Init.Kill = Init.LoadImm = false;
+    Init.Imm = 0;
+    if (MI->getOpcode() == Z80::LD88or && getFrameTopOffset(*MI) == Top) {
+      const MachineOperand &Src = MI->getOperand(2);
+      Init.Stores.push_back(&*MI);
+      Init.Reg = Src.getReg();
+      Init.Kill = Src.isKill();
+    } else if (isByteStoreToFrame(*MI)) {
+      // Both halves have to be stored back to back, in either order.
+      MachineBasicBlock::iterator NI =
+        skipDebugInstructionsForward(std::next(MI), E);
+      if (NI == E || !isByteStoreToFrame(*NI))
+        break;
+      MachineInstr *Lo = &*MI, *Hi = &*NI;
+      if (getFrameTopOffset(*Lo) != Top)
+        std::swap(Lo, Hi);
+      if (getFrameTopOffset(*Lo) != Top || getFrameTopOffset(*Hi) != Top + 1)
+        break;
+      const MachineOperand &LoSrc = Lo->getOperand(2);
+      const MachineOperand &HiSrc = Hi->getOperand(2);
+      if (LoSrc.isImm() && HiSrc.isImm()) {
+        Init.Reg = findScratchReg(MBB, MI, {Z80::DE, Z80::BC, Z80::HL});
+        if (!Init.Reg)
+          break;
+        Init.Kill = Init.LoadImm = true;
+        Init.Imm = (LoSrc.getImm() & 0xFF) | (HiSrc.getImm() & 0xFF) << 8;
+      } else if (LoSrc.isReg() && HiSrc.isReg()) {
+        Init.Reg = TRI->getMatchingSuperReg(LoSrc.getReg(), Z80::sub_low,
+                                            &Z80::R16RegClass);
+        if (!Init.Reg || Init.Reg != TRI->getMatchingSuperReg(
+              HiSrc.getReg(), Z80::sub_high, &Z80::R16RegClass))
+          break;
+        Init.Kill = LoSrc.isKill() && HiSrc.isKill();
+      } else {
+        break;
+      }
+      Init.Stores.push_back(&*MI);
+      Init.Stores.push_back(&*NI);
+      MI = NI;
+    } else if (blocksFrameInits(*MI, TII, TRI)) {
+      break;
+    } else {
+      ++MI;
+      continue;
+    }
+    Inits.push_back(Init);
+    ++MI;
+    Top -= SlotSize;
+  }
+  return MI;
+}
+
+/// buildFrameInits - Replace the stores found by findFrameInits with pushes.
+void Z80FrameLowering::buildFrameInits(MachineBasicBlock &MBB,
+                                       ArrayRef<FrameInit> Inits) const {
+  for (const FrameInit &Init : Inits) {
+    MachineInstr *Last = Init.Stores.back();
+    DebugLoc DL = Last->getDebugLoc();
+    if (Init.LoadImm)
+      BuildMI(MBB, Last, DL, TII.get(Z80::LD16ri), Init.Reg).addImm(Init.Imm);
+    BuildMI(MBB, Last, DL, TII.get(Z80::PUSH16r))
+    .addReg(Init.Reg, getKillRegState(Init.Kill));
+    for (MachineInstr *Store : Init.Stores)
+      Store->eraseFromParent();
+  }
+}
+
 /// emitPrologue - Push callee-saved registers onto the stack, which
 /// automatically adjust the stack pointer. Adjust the stack pointer to allocate
 /// space for local variables.
+///
+/// When optimizing, the top of the frame is built by pushing the values that
+/// the function stores there first, see findFrameInits.
 void Z80FrameLowering::emitPrologue(MachineFunction &MF,
                                     MachineBasicBlock &MBB) const {
-//  MachineBasicBlock::iterator MI = MBB.begin();
-//
-//  // Debug location must be unknown since the first debug location is used
-//  // to determine the end of the prologue.
-//  DebugLoc DL;
-//
-//  MachineFrameInfo &MFI = MF.getFrameInfo();
-//  int StackSize = -int(MFI.getStackSize());
-//  unsigned ScratchReg = Z80::HL;
-//
-//  // skip callee-saved saves
-//  while (MI != MBB.end() && MI->getFlag(MachineInstr::FrameSetup)) {
-//    ++MI;
-//  }
-//
-//  int FPOffset = -1;
-//  if (hasFP(MF)) {
-//    if (MF.getFunction().getAttributes().hasAttribute(
-//          AttributeList::FunctionIndex, Attribute::OptimizeForSize)) {
-//      if (StackSize) {
-//        BuildMI(MBB, MI, DL, TII.get(Z80::LD16ri),
-//                ScratchReg).addImm(StackSize);
-//        BuildMI(MBB, MI, DL, TII.get(Z80::CALL16i))
-//        .addExternalSymbol("_frameset").addReg(ScratchReg,
-//                                               RegState::ImplicitKill);
-//        return;
-//      }
-//      BuildMI(MBB, MI, DL, TII.get(Z80::CALL16i))
-//      .addExternalSymbol("_frameset0");
-//      return;
-//    }
-//    unsigned FrameReg = TRI->getFrameRegister(MF);
-//    BuildMI(MBB, MI, DL, TII.get(Z80::PUSH16r))
-//    .addReg(FrameReg);
-//    BuildMI(MBB, MI, DL, TII.get(Z80::LD16ri),
-//            FrameReg)
-//    .addImm(0);
-//    BuildMI(MBB, MI, DL, TII.get(Z80::ADD16SP),
-//            FrameReg).addReg(FrameReg);
-//    FPOffset = 0;
-//  }
-//  BuildStackAdjustment(MF, MBB, MI, DL, ScratchReg, StackSize, FPOffset);
+  MachineBasicBlock::iterator MI = MBB.begin();
+
+  // Debug location must be unknown since the first debug location is used
+  // to determine the end of the prologue.
+  DebugLoc DL;
+
+  unsigned FrameSize = getStackFrameSize(MF);
+  int StackSize = -int(FrameSize);
+
+  // skip callee-saved saves
+  while (MI != MBB.end() && MI->getFlag(MachineInstr::FrameSetup)) {
+    ++MI;
+  }
+
+  SmallVector<FrameInit, 8> Inits;
+  MachineBasicBlock::iterator InitEnd = MI;
+  if (FrameSize && MF.getTarget().getOptLevel() != CodeGenOpt::None)
+    InitEnd = findFrameInits(MBB, MI, Inits);
+
+  int FPOffset = -1;
+  if (hasFP(MF)) {
+    if (MF.getFunction().getAttributes().hasAttribute(
+          AttributeList::FunctionIndex, Attribute::OptimizeForSize)) {
+      if (StackSize && Inits.empty()) {
+        BuildMI(MBB, MI, DL, TII.get(Z80::LD16ri),
+                Z80::HL).addImm(StackSize);
+        BuildMI(MBB, MI, DL, TII.get(Z80::CALL16i))
+        .addExternalSymbol("_frameset").addReg(Z80::HL,
+                                               RegState::ImplicitKill);
+        return;
+      }
+      BuildMI(MBB, MI, DL, TII.get(Z80::CALL16i))
+      .addExternalSymbol("_frameset0");
+    } else {
+      unsigned FrameReg = TRI->getFrameRegister(MF);
+      BuildMI(MBB, MI, DL, TII.get(Z80::PUSH16r))
+      .addReg(FrameReg);
+      BuildMI(MBB, MI, DL, TII.get(Z80::LD16ri),
+              FrameReg)
+      .addImm(0);
+      BuildMI(MBB, MI, DL, TII.get(Z80::ADD16SP),
+              FrameReg).addReg(FrameReg);
+      FPOffset = 0;
+    }
+  }
+
+  if (Inits.empty()) {
+    // HL may hold an argument, fall back to IY or to pushes if it does.
+    BuildStackAdjustment(MF, MBB, MI, DL,
+                         findScratchReg(MBB, MI, {Z80::HL, Z80::IY}),
+                         StackSize, FPOffset);
+    return;
+  }
+
+  // Allocate what isn't pushed where the pushes end.
+  buildFrameInits(MBB, Inits);
+  int Rest = StackSize + int(Inits.size() * SlotSize);
+  if (Rest)
+    BuildStackAdjustment(MF, MBB, InitEnd, DL,
+                         findScratchReg(MBB, InitEnd, {Z80::HL, Z80::IY}),
+                         Rest);
 }
 
 void Z80FrameLowering::emitEpilogue(MachineFunction &MF,
                                     MachineBasicBlock &MBB) const {
-//  MachineBasicBlock::iterator MI = MBB.getFirstTerminator();
-//  DebugLoc DL = MBB.findDebugLoc(MI);
-//
-//  MachineFrameInfo &MFI = MF.getFrameInfo();
-//  int StackSize = int(MFI.getStackSize());
-//
-//  const TargetRegisterClass *ScratchRC = &Z80::AIR16RegClass;
-//  TargetRegisterClass::iterator ScratchReg = ScratchRC->begin();
-//  for (; MI->readsRegister(TRI->getSubReg(*ScratchReg, Z80::sub_low), TRI);
-//       ++ScratchReg)
-//    assert(ScratchReg != ScratchRC->end() &&
-//           "Could not allocate a scratch register!");
-//  assert((hasFP(MF) || *ScratchReg != TRI->getFrameRegister(MF)) &&
-//         "Cannot allocate csr as scratch register!");
-//
-//  // skip callee-saved restores
-//  while (MI != MBB.begin())
-//    if (!(--MI)->getFlag(MachineInstr::FrameDestroy)) {
-//      ++MI;
-//      break;
-//    }
-//
-//  // consume stack adjustment
-//  while (MI != MBB.begin()) {
-//    MachineBasicBlock::iterator PI = std::prev(MI);
-//    unsigned Opc = PI->getOpcode();
-//    if (Opc == Z80::POP16r &&
-//        PI->getOperand(0).isDead()) {
-//      StackSize += SlotSize;
-//    } else if (Opc == Z80::LD16SP) {
-//      unsigned Reg = PI->getOperand(0).getReg();
-//      if (PI == MBB.begin()) {
-//        break;
-//      }
-//      MachineBasicBlock::iterator AI = std::prev(PI);
-//      Opc = AI->getOpcode();
-//      if (AI == MBB.begin() || Opc != Z80::ADD16SP ||
-//          AI->getOperand(0).getReg() != Reg ||
-//          AI->getOperand(1).getReg() != Reg) {
-//        break;
-//      }
-//      MachineBasicBlock::iterator LI = std::prev(AI);
-//      Opc = LI->getOpcode();
-//      if (Opc != Z80::LD16ri ||
-//          LI->getOperand(0).getReg() != Reg) {
-//        break;
-//      }
-//      StackSize += LI->getOperand(1).getImm();
-//      LI->removeFromParent();
-//      AI->removeFromParent();
-//    } else {
-//      break;
-//    }
-//    PI->removeFromParent();
-//  }
-//
-//  bool HasFP = hasFP(MF);
-//  BuildStackAdjustment(MF, MBB, MI, DL, *ScratchReg, StackSize,
-//                       HasFP ? StackSize : -1, MFI.hasVarSizedObjects());
-//  if (HasFP)
-//    BuildMI(MBB, MI, DL, TII.get(Z80::POP16r),
-//            TRI->getFrameRegister(MF));
+  MachineBasicBlock::iterator MI = MBB.getFirstTerminator();
+  DebugLoc DL = MBB.findDebugLoc(MI);
+
+  MachineFrameInfo &MFI = MF.getFrameInfo();
+  int StackSize = int(getStackFrameSize(MF));
+
+  // Prefer HL, which can also add SP, then the other pairs to pop into.
+  unsigned ScratchReg = 0;
+  for (MCPhysReg Reg : {Z80::HL, Z80::DE, Z80::BC, Z80::IY})
+    if ((MI == MBB.end() || !MI->readsRegister(Reg, TRI)) &&
+        isClobberable(MF, Reg)) {
+      ScratchReg = Reg;
+      break;
+    }
+
+  // skip callee-saved restores
+  while (MI != MBB.begin())
+    if (!(--MI)->getFlag(MachineInstr::FrameDestroy)) {
+      ++MI;
+      break;
+    }
+
+  // consume stack adjustment
+  while (MI != MBB.begin()) {
+    MachineBasicBlock::iterator PI = std::prev(MI);
+    unsigned Opc = PI->getOpcode();
+    if (Opc == Z80::POP16r &&
+        PI->getOperand(0).isDead()) {
+      StackSize += SlotSize;
+    } else if (Opc == Z80::INC16SP) {
+      StackSize += 1;
+    } else if (Opc == Z80::LD16SP) {
+      unsigned Reg = PI->getOperand(0).getReg();
+      if (PI == MBB.begin()) {
+        break;
+      }
+      MachineBasicBlock::iterator AI = std::prev(PI);
+      Opc = AI->getOpcode();
+      if (AI == MBB.begin() || Opc != Z80::ADD16SP ||
+          AI->getOperand(0).getReg() != Reg ||
+          AI->getOperand(1).getReg() != Reg) {
+        break;
+      }
+      MachineBasicBlock::iterator LI = std::prev(AI);
+      Opc = LI->getOpcode();
+      if (Opc != Z80::LD16ri ||
+          LI->getOperand(0).getReg() != Reg) {
+        break;
+      }
+      StackSize += LI->getOperand(1).getImm();
+      LI->removeFromParent();
+      AI->removeFromParent();
+    } else {
+      break;
+    }
+    PI->removeFromParent();
+  }
+
+  bool HasFP = hasFP(MF);
+  BuildStackAdjustment(MF, MBB, MI, DL, ScratchReg, StackSize,
+                       HasFP ? StackSize : -1, MFI.hasVarSizedObjects());
+  if (HasFP)
+    BuildMI(MBB, MI, DL, TII.get(Z80::POP16r),
+            TRI->getFrameRegister(MF));
+
+  // There is no RET n, so a callee-pop function has to move the return
+  // address out of the way, drop its stack arguments and push it back.
+  // Neither DE nor BC are return or callee-saved registers.  A tail callee
+  // pops the same amount itself.
+  unsigned BytesToPop =
+    MF.getInfo<Z80MachineFunctionInfo>()->getBytesToPopOnReturn();
+  MachineBasicBlock::iterator Term = MBB.getFirstTerminator();
+  if (BytesToPop && !Term->isCall()) {
+    assert(!Term->readsRegister(Z80::DE, TRI) &&
+           !Term->readsRegister(Z80::BC, TRI) &&
+           "Return uses a register needed to pop the arguments");
+    BuildMI(MBB, Term, DL, TII.get(Z80::POP16r), Z80::DE);
+    BuildStackAdjustment(MF, MBB, Term, DL, Z80::BC, BytesToPop);
+    BuildMI(MBB, Term, DL, TII.get(Z80::PUSH16r))
+    .addReg(Z80::DE, RegState::Kill);
+  }
+}
+
+// Only non-nested non-nmi interrupts can use shadow registers, and only if
+// compiled code leaves them alone.
+static bool shouldUseShadow(const MachineFunction &MF) {
+  const Function &F = MF.getFunction();
+  return F.getFnAttribute("interrupt").getValueAsString() == "Generic" &&
+         !MF.getSubtarget<Z80Subtarget>().usesShadowRegs();
+}
+
+// If compiled code keeps values in the shadow registers, an interrupt handler
+// that calls functions has to save them.
+static bool shouldSaveShadow(const MachineFunction &MF) {
+  return MF.getFunction().hasFnAttribute("interrupt") &&
+         MF.getSubtarget<Z80Subtarget>().usesShadowRegs() &&
+         MF.getFrameInfo().hasCalls();
+}
+
+/// Build ex af, af' or exx.  The registers swapped in the prologue and the
+/// epilogue don't hold values of the function.
+static void buildExchange(MachineBasicBlock &MBB,
+                          MachineBasicBlock::iterator MI, DebugLoc DL,
+                          const TargetInstrInfo &TII, unsigned Opc,
+                          MachineInstr::MIFlag Flag) {
+  MachineInstrBuilder MIB = BuildMI(MBB, MI, DL, TII.get(Opc)).setMIFlag(Flag);
+  for (MachineOperand &MO : MIB->implicit_operands())
+    if (MO.isUse())
+      MO.setIsUndef();
+}
+
+void Z80FrameLowering::shadowCalleeSavedRegisters(
+  MachineBasicBlock &MBB, MachineBasicBlock::iterator MI, DebugLoc DL,
+  MachineInstr::MIFlag Flag, const std::vector<CalleeSavedInfo> &CSI) const {
+  assert(shouldUseShadow(*MBB.getParent()) &&
+         "Can't use shadow registers in this function.");
+  bool SaveAF = false, SaveG = false;
+  for (unsigned i = 0, e = CSI.size(); i != e; ++i) {
+    unsigned Reg = CSI[i].getReg();
+    if (Reg == Z80::AF) {
+      SaveAF = true;
+    } else if (Z80::GR16RegClass.contains(Reg)) {
+      SaveG = true;
+    }
+  }
+  if (SaveAF)
+    buildExchange(MBB, MI, DL, TII, Z80::EXAF, Flag);
+  if (SaveG)
+    buildExchange(MBB, MI, DL, TII, Z80::EXX, Flag);
+}
+
+/// saveShadowRegisters - Push the shadow registers, or pop them when Flag is
+/// FrameDestroy, by swapping them in around the pushes or pops.
+void Z80FrameLowering::saveShadowRegisters(
+  MachineBasicBlock &MBB, MachineBasicBlock::iterator MI, DebugLoc DL,
+  MachineInstr::MIFlag Flag) const {
+  if (Flag == MachineInstr::FrameSetup) {
+    buildExchange(MBB, MI, DL, TII, Z80::EXAF, Flag);
+    BuildMI(MBB, MI, DL, TII.get(Z80::PUSH16AF)).setMIFlag(Flag);
+    buildExchange(MBB, MI, DL, TII, Z80::EXAF, Flag);
+    buildExchange(MBB, MI, DL, TII, Z80::EXX, Flag);
+    for (MCPhysReg Reg : {Z80::BC, Z80::DE, Z80::HL})
+      BuildMI(MBB, MI, DL, TII.get(Z80::PUSH16r)).addReg(Reg).setMIFlag(Flag);
+    buildExchange(MBB, MI, DL, TII, Z80::EXX, Flag);
+    return;
+  }
+  buildExchange(MBB, MI, DL, TII, Z80::EXX, Flag);
+  for (MCPhysReg Reg : {Z80::HL, Z80::DE, Z80::BC})
+    BuildMI(MBB, MI, DL, TII.get(Z80::POP16r), Reg).setMIFlag(Flag);
+  buildExchange(MBB, MI, DL, TII, Z80::EXX, Flag);
+  buildExchange(MBB, MI, DL, TII, Z80::EXAF, Flag);
+  BuildMI(MBB, MI, DL, TII.get(Z80::POP16AF)).setMIFlag(Flag);
+  buildExchange(MBB, MI, DL, TII, Z80::EXAF, Flag);
+}
+
+bool Z80FrameLowering::assignCalleeSavedSpillSlots(
+  MachineFunction &MF, const TargetRegisterInfo *TRI,
+  std::vector<CalleeSavedInfo> &CSI) const {
+  // Only the registers that are pushed take space in the frame.
+  bool UseShadow = shouldUseShadow(MF);
+  unsigned Pushed = hasFP(MF);
+  for (const CalleeSavedInfo &Info : CSI)
+    if (!UseShadow || Z80::IR16RegClass.contains(Info.getReg()))
+      ++Pushed;
+  if (shouldSaveShadow(MF))
+    Pushed += 4;
+  MF.getInfo<Z80MachineFunctionInfo>()
+  ->setCalleeSavedFrameSize(Pushed * SlotSize);
+  return true;
+}
+
+bool Z80FrameLowering::spillCalleeSavedRegisters(
+  MachineBasicBlock &MBB, MachineBasicBlock::iterator MI,
+  const std::vector<CalleeSavedInfo> &CSI,
+  const TargetRegisterInfo *TRI) const {
+  const MachineFunction &MF = *MBB.getParent();
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  bool UseShadow = shouldUseShadow(MF);
+  DebugLoc DL = MBB.findDebugLoc(MI);
+  if (UseShadow) {
+    shadowCalleeSavedRegisters(MBB, MI, DL, MachineInstr::FrameSetup, CSI);
+  }
+  for (unsigned i = CSI.size(); i != 0; --i) {
+    unsigned Reg = CSI[i - 1].getReg();
+
+    // Non-index registers can be spilled to shadow registers.
+    if (UseShadow && !Z80::IR16RegClass.contains(Reg)) {
+      continue;
+    }
+
+    bool isLiveIn = MRI.isLiveIn(Reg);
+    if (!isLiveIn) {
+      MBB.addLiveIn(Reg);
+    }
+
+    // Decide whether we can add a kill flag to the use.
+    bool CanKill = !isLiveIn;
+    // Check if any subregister is live-in
+    if (CanKill) {
+      for (MCRegAliasIterator AReg(Reg, TRI, false); AReg.isValid(); ++AReg) {
+        if (MRI.isLiveIn(*AReg)) {
+          CanKill = false;
+          break;
+        }
+      }
+    }
+
+    // Do not set a kill flag on values that are also marked as live-in. This
+    // happens with the @llvm-returnaddress intrinsic and with arguments
+    // passed in callee saved registers.
+    // Omitting the kill flags is conservatively correct even if the live-in
+    // is not used after all.
+    MachineInstrBuilder MIB;
+    if (Reg == Z80::AF) {
+      MIB = BuildMI(MBB, MI, DL, TII.get(Z80::PUSH16AF));
+    } else
+      MIB = BuildMI(MBB, MI, DL, TII.get(Z80::PUSH16r))
+            .addReg(Reg, getKillRegState(CanKill));
+    MIB.setMIFlag(MachineInstr::FrameSetup);
+  }
+  if (shouldSaveShadow(MF))
+    saveShadowRegisters(MBB, MI, DL, MachineInstr::FrameSetup);
+  return true;
+}
+bool Z80FrameLowering::restoreCalleeSavedRegisters(
+  MachineBasicBlock &MBB, MachineBasicBlock::iterator MI,
+  std::vector<CalleeSavedInfo> &CSI,
+  const TargetRegisterInfo *TRI) const {
+  const MachineFunction &MF = *MBB.getParent();
+  bool UseShadow = shouldUseShadow(MF);
+  DebugLoc DL = MBB.findDebugLoc(MI);
+  if (shouldSaveShadow(MF))
+    saveShadowRegisters(MBB, MI, DL, MachineInstr::FrameDestroy);
+  for (unsigned i = 0, e = CSI.size(); i != e; ++i) {
+    unsigned Reg = CSI[i].getReg();
+
+    // Non-index registers can be spilled to shadow registers.
+    if (UseShadow && !Z80::IR16RegClass.contains(Reg)) {
+      continue;
+    }
+
+    MachineInstrBuilder MIB;
+    if (Reg == Z80::AF) {
+      MIB = BuildMI(MBB, MI, DL, TII.get(Z80::POP16AF));
+    } else
+      MIB = BuildMI(MBB, MI, DL, TII.get(Z80::POP16r),
+                    Reg);
+    MIB.setMIFlag(MachineInstr::FrameDestroy);
+  }
+  if (UseShadow) {
+    shadowCalleeSavedRegisters(MBB, MI, DL, MachineInstr::FrameDestroy, CSI);
+  }
+  return true;
+}
+
+void Z80FrameLowering::processFunctionBeforeFrameFinalized(
+  MachineFunction &MF, RegScavenger *RS) const {
+  MachineFrameInfo &MFI = MF.getFrameInfo();
+  MFI.setMaxCallFrameSize(0); // call frames are not implemented atm
+  if (!MF.getInfo<Z80MachineFunctionInfo>()->getStaticFrame() &&
+      MFI.estimateStackSize(MF) > 0x80) {
+    RS->addScavengingFrameIndex(MFI.CreateStackObject(SlotSize, 1, false));
+  }
+}
+
+MachineBasicBlock::iterator Z80FrameLowering::
+eliminateCallFramePseudoInstr(MachineFunction &MF, MachineBasicBlock &MBB,
+                              MachineBasicBlock::iterator I) const {
+  //if (!hasReservedCallFrame(MF)) {
+  unsigned Amount = TII.getFrameSize(*I);
+
+  unsigned ScratchReg = I->getOperand(I->getNumOperands() - 1).getReg();
+  assert(Z80::AIR16RegClass.contains(ScratchReg) &&
+         "Expected last operand to be the scratch reg.");
+
+  if (I->getOpcode() == TII.getCallFrameDestroyOpcode()) {
+    Amount -= TII.getFramePoppedByCallee(*I);
+    //assert(TargetRegisterInfo::isPhysicalRegister(ScratchReg) &&
+    //       "Reg alloc should have already happened.");
+    BuildStackAdjustment(MF, MBB, I, I->getDebugLoc(), ScratchReg, Amount);
+  }
+  //}
+
+  return MBB.erase(I);
 }
-//
-//// Only non-nested non-nmi interrupts can use shadow registers.
-//static bool shouldUseShadow(const MachineFunction &MF) {
-//  const Function &F = MF.getFunction();
-//  return F.getFnAttribute("interrupt").getValueAsString() == "Generic";
-//}
-//
-//void Z80FrameLowering::shadowCalleeSavedRegisters(
-//  MachineBasicBlock &MBB, MachineBasicBlock::iterator MI, DebugLoc DL,
-//  MachineInstr::MIFlag Flag, const std::vector<CalleeSavedInfo> &CSI) const {
-//  assert(shouldUseShadow(*MBB.getParent()) &&
-//         "Can't use shadow registers in this function.");
-//  bool SaveAF = false, SaveG = false;
-//  for (unsigned i = 0, e = CSI.size(); i != e; ++i) {
-//    unsigned Reg = CSI[i].getReg();
-//    if (Reg == Z80::AF) {
-//      SaveAF = true;
-//    } else if (Z80::GR16RegClass.contains(Reg)) {
-//      SaveG = true;
-//    }
-//  }
-//  if (SaveAF)
-//    BuildMI(MBB, MI, DL, TII.get(Z80::EXAF))
-//    .setMIFlag(Flag);
-//  if (SaveG)
-//    BuildMI(MBB, MI, DL, TII.get(Z80::EXX))
-//    .setMIFlag(Flag);
-//}
-//
-//bool Z80FrameLowering::assignCalleeSavedSpillSlots(
-//  MachineFunction &MF, const TargetRegisterInfo *TRI,
-//  std::vector<CalleeSavedInfo> &CSI) const {
-//  MF.getInfo<Z80MachineFunctionInfo>()
-//  ->setCalleeSavedFrameSize((CSI.size() + hasFP(MF)) * SlotSize);
-//  return true;
-//}
-//
-//bool Z80FrameLowering::spillCalleeSavedRegisters(
-//  MachineBasicBlock &MBB, MachineBasicBlock::iterator MI,
-//  const std::vector<CalleeSavedInfo> &CSI,
-//  const TargetRegisterInfo *TRI) const {
-//  const MachineFunction &MF = *MBB.getParent();
-//  const MachineRegisterInfo &MRI = MF.getRegInfo();
-//  bool UseShadow = shouldUseShadow(MF);
-//  DebugLoc DL = MBB.findDebugLoc(MI);
-//  if (UseShadow) {
-//    shadowCalleeSavedRegisters(MBB, MI, DL, MachineInstr::FrameSetup, CSI);
-//  }
-//  for (unsigned i = CSI.size(); i != 0; --i) {
-//    unsigned Reg = CSI[i - 1].getReg();
-//
-//    // Non-index registers can be spilled to shadow registers.
-//    if (UseShadow && !Z80::IR16RegClass.contains(Reg)) {
-//      continue;
-//    }
-//
-//    bool isLiveIn = MRI.isLiveIn(Reg);
-//    if (!isLiveIn) {
-//      MBB.addLiveIn(Reg);
-//    }
-//
-//    // Decide whether we can add a kill flag to the use.
-//    bool CanKill = !isLiveIn;
-//    // Check if any subregister is live-in
-//    if (CanKill) {
-//      for (MCRegAliasIterator AReg(Reg, TRI, false); AReg.isValid(); ++AReg) {
-//        if (MRI.isLiveIn(*AReg)) {
-//          CanKill = false;
-//          break;
-//        }
-//      }
-//    }
-//
-//    // Do not set a kill flag on values that are also marked as live-in. This
-//    // happens with the @llvm-returnaddress intrinsic and with arguments
-//    // passed in callee saved registers.
-//    // Omitting the kill flags is conservatively correct even if the live-in
-//    // is not used after all.
-//    MachineInstrBuilder MIB;
-//    if (Reg == Z80::AF) {
-//      MIB = BuildMI(MBB, MI, DL, TII.get(Z80::PUSH16AF));
-//    } else
-//      MIB = BuildMI(MBB, MI, DL, TII.get(Z80::PUSH16r))
-//            .addReg(Reg, getKillRegState(CanKill));
-//    MIB.setMIFlag(MachineInstr::FrameSetup);
-//  }
-//  return true;
-//}
-//bool Z80FrameLowering::restoreCalleeSavedRegisters(
-//  MachineBasicBlock &MBB, MachineBasicBlock::iterator MI,
-//  std::vector<CalleeSavedInfo> &CSI,
-//  const TargetRegisterInfo *TRI) const {
-//  const MachineFunction &MF = *MBB.getParent();
-//  bool UseShadow = shouldUseShadow(MF);
-//  DebugLoc DL = MBB.findDebugLoc(MI);
-//  for (unsigned i = 0, e = CSI.size(); i != e; ++i) {
-//    unsigned Reg = CSI[i].getReg();
-//
-//    // Non-index registers can be spilled to shadow registers.
-//    if (UseShadow && !Z80::IR16RegClass.contains(Reg)) {
-//      continue;
-//    }
-//
-//    MachineInstrBuilder MIB;
-//    if (Reg == Z80::AF) {
-//      MIB = BuildMI(MBB, MI, DL, TII.get(Z80::POP16AF));
-//    } else
-//      MIB = BuildMI(MBB, MI, DL, TII.get(Z80::POP16r),
-//                    Reg);
-//    MIB.setMIFlag(MachineInstr::FrameDestroy);
-//  }
-//  if (UseShadow) {
-//    shadowCalleeSavedRegisters(MBB, MI, DL, MachineInstr::FrameDestroy, CSI);
-//  }
-//  return true;
-//}
-//
-//void Z80FrameLowering::processFunctionBeforeFrameFinalized(
-//  MachineFunction &MF, RegScavenger *RS) const {
-//  MachineFrameInfo &MFI = MF.getFrameInfo();
-//  MFI.setMaxCallFrameSize(0); // call frames are not implemented atm
-//  if (MFI.estimateStackSize(MF) > 0x80) {
-//    RS->addScavengingFrameIndex(MFI.CreateStackObject(SlotSize, 1, false));
-//  }
-//}
-//
-//MachineBasicBlock::iterator Z80FrameLowering::
-//eliminateCallFramePseudoInstr(MachineFunction &MF, MachineBasicBlock &MBB,
-//                              MachineBasicBlock::iterator I) const {
-//  //if (!hasReservedCallFrame(MF)) {
-//  unsigned Amount = TII.getFrameSize(*I);
-//
-//  unsigned ScratchReg = I->getOperand(I->getNumOperands() - 1).getReg();
-//  assert(Z80::AIR16RegClass.contains(ScratchReg) &&
-//         "Expected last operand to be the scratch reg.");
-//
-//  if (I->getOpcode() == TII.getCallFrameDestroyOpcode()) {
-//    Amount -= TII.getFramePoppedByCallee(*I);
-//    //assert(TargetRegisterInfo::isPhysicalRegister(ScratchReg) &&
-//    //       "Reg alloc should have already happened.");
-//    BuildStackAdjustment(MF, MBB, I, I->getDebugLoc(), ScratchReg, Amount);
-//  }
-//  //}
-//
-//  return MBB.erase(I);
-//}
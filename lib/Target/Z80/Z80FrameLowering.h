@@ -14,6 +14,8 @@
 #ifndef LLVM_LIB_TARGET_Z80_Z80FRAMELOWERING_H
 #define LLVM_LIB_TARGET_Z80_Z80FRAMELOWERING_H
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/CodeGen/TargetFrameLowering.h"
 
 namespace llvm {
@@ -36,38 +38,83 @@ public:
   /// the function.
   void emitPrologue(MachineFunction &MF, MachineBasicBlock &MBB) const override;
   void emitEpilogue(MachineFunction &MF, MachineBasicBlock &MBB) const override;
-//
-//  bool assignCalleeSavedSpillSlots(
-//    MachineFunction &MF, const TargetRegisterInfo *TRI,
-//    std::vector<CalleeSavedInfo> &CSI) const override;
-//  bool spillCalleeSavedRegisters(MachineBasicBlock &MBB,
-//                                 MachineBasicBlock::iterator MI,
-//                                 const std::vector<CalleeSavedInfo> &CSI,
-//                                 const TargetRegisterInfo *TRI) const override;
-//  bool restoreCalleeSavedRegisters(MachineBasicBlock &MBB,
-//                                   MachineBasicBlock::iterator MI,
-//                                   std::vector<CalleeSavedInfo> &CSI,
-//                                   const TargetRegisterInfo *TRI) const override;
-//
-//  void processFunctionBeforeFrameFinalized(
-//    MachineFunction &MF, RegScavenger *RS = nullptr) const override;
-//
-//  MachineBasicBlock::iterator eliminateCallFramePseudoInstr(
-//    MachineFunction &MF, MachineBasicBlock &MBB,
-//    MachineBasicBlock::iterator MI) const override;
-//
+
+  bool assignCalleeSavedSpillSlots(
+    MachineFunction &MF, const TargetRegisterInfo *TRI,
+    std::vector<CalleeSavedInfo> &CSI) const override;
+  bool spillCalleeSavedRegisters(MachineBasicBlock &MBB,
+                                 MachineBasicBlock::iterator MI,
+                                 const std::vector<CalleeSavedInfo> &CSI,
+                                 const TargetRegisterInfo *TRI) const override;
+  bool restoreCalleeSavedRegisters(MachineBasicBlock &MBB,
+                                   MachineBasicBlock::iterator MI,
+                                   std::vector<CalleeSavedInfo> &CSI,
+                                   const TargetRegisterInfo *TRI) const override;
+
+  void processFunctionBeforeFrameFinalized(
+    MachineFunction &MF, RegScavenger *RS = nullptr) const override;
+
+  MachineBasicBlock::iterator eliminateCallFramePseudoInstr(
+    MachineFunction &MF, MachineBasicBlock &MBB,
+    MachineBasicBlock::iterator MI) const override;
+
   bool hasFP(const MachineFunction &MF) const override;
-//
-//private:
-//  void BuildStackAdjustment(MachineFunction &MF, MachineBasicBlock &MBB,
-//                            MachineBasicBlock::iterator MBBI, DebugLoc DL,
-//                            unsigned ScratchReg, int Offset,
-//                            int FPOffset = -1,
-//                            bool UnknownOffset = false) const;
-//
-//  void shadowCalleeSavedRegisters(
-//    MachineBasicBlock &MBB, MachineBasicBlock::iterator MI, DebugLoc DL,
-//    MachineInstr::MIFlag Flag, const std::vector<CalleeSavedInfo> &CSI) const;
+
+  /// reservesFP - Return true if IX has to be kept from the register
+  /// allocator, because the frame may end up addressed relative to it.
+  bool reservesFP(const MachineFunction &MF) const;
+  bool hasReservedCallFrame(const MachineFunction &MF) const override {
+    return false;
+  }
+  bool canSimplifyCallFramePseudos(const MachineFunction &MF) const override;
+  bool needsFrameIndexResolution(const MachineFunction &MF) const override;
+
+  int getFrameIndexReference(const MachineFunction &MF, int FI,
+                             unsigned &FrameReg) const override;
+
+  /// shouldUseSPRelativeFrame - Return true if the frame of the function is
+  /// better addressed relative to SP than to IX.
+  bool shouldUseSPRelativeFrame(const MachineFunction &MF) const;
+
+  /// shouldUseStaticFrame - Return true if the stack objects of the function
+  /// can be kept in static storage, see Z80StaticLocals.cpp.
+  bool shouldUseStaticFrame(const MachineFunction &MF) const;
+
+private:
+  /// A word at the top of the frame that is stored by the function before
+  /// anything else touches the frame, and so can be pushed instead.
+  struct FrameInit {
+    SmallVector<MachineInstr *, 2> Stores;
+    unsigned Reg;
+    bool Kill;
+    bool LoadImm;
+    uint16_t Imm;
+  };
+
+  unsigned getStackFrameSize(const MachineFunction &MF) const;
+  bool isClobberable(const MachineFunction &MF, unsigned Reg) const;
+  unsigned findScratchReg(MachineBasicBlock &MBB,
+                          MachineBasicBlock::iterator MI,
+                          ArrayRef<MCPhysReg> Regs) const;
+  int getFrameTopOffset(const MachineInstr &MI) const;
+  MachineBasicBlock::iterator
+  findFrameInits(MachineBasicBlock &MBB, MachineBasicBlock::iterator MI,
+                 SmallVectorImpl<FrameInit> &Inits) const;
+  void buildFrameInits(MachineBasicBlock &MBB,
+                       ArrayRef<FrameInit> Inits) const;
+
+  void BuildStackAdjustment(MachineFunction &MF, MachineBasicBlock &MBB,
+                            MachineBasicBlock::iterator MBBI, DebugLoc DL,
+                            unsigned ScratchReg, int Offset,
+                            int FPOffset = -1,
+                            bool UnknownOffset = false) const;
+
+  void shadowCalleeSavedRegisters(
+    MachineBasicBlock &MBB, MachineBasicBlock::iterator MI, DebugLoc DL,
+    MachineInstr::MIFlag Flag, const std::vector<CalleeSavedInfo> &CSI) const;
+  void saveShadowRegisters(MachineBasicBlock &MBB,
+                           MachineBasicBlock::iterator MI, DebugLoc DL,
+                           MachineInstr::MIFlag Flag) const;
 };
 } // End llvm namespace
 
@@ -0,0 +1,583 @@
+//===------- Z80HardwareLoops.cpp - Close countdown loops with djnz -------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the passes that turn counted loops into djnz loops,
+// which take 13/8 cycles for the whole dec b / jp nz, loop sequence instead of
+// 4 + 10.
+//
+// Before instruction selection, an innermost loop whose trip count scalar
+// evolution can compute gets a new byte counter, set to the trip count in the
+// preheader and counted down to zero in the latch, which replaces the exit
+// test.  0 stands for 256, as for djnz.  When the trip count fits in 16 bits
+// but not in 8, a second latch counts the high byte down each time the low
+// one runs out, like
+//   ld b, lo / ld c, hi / loop: ... / djnz loop / dec c / jp nz, loop
+//
+// Before register allocation, the latches of each loop are put in the form
+//   %next = dec %count
+//   jp nz, header
+// with %count a phi in the header, and the counter of the one taken most
+// often is hinted to b.
+//
+// After block placement, a dec b whose flags only feed a jp nz back within
+// reach of a relative branch is merged with it into a djnz.
+//
+// Word counts of loops the counter can't be given to are tested with
+// ld a, h / or l instead of a 16-bit subtract, which is done during lowering.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Z80.h"
+#include "Z80InstrInfo.h"
+#include "Z80Subtarget.h"
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Transforms/Utils/Local.h"
+using namespace llvm;
+using namespace PatternMatch;
+
+#define DEBUG_TYPE "z80-hwloops"
+
+STATISTIC(NumCounters, "Number of loops given a byte counter");
+STATISTIC(NumSplitCounters, "Number of loops given a two byte counter");
+STATISTIC(NumHinted, "Number of loop counters hinted to b");
+STATISTIC(NumDJNZ, "Number of djnz instructions formed");
+
+namespace {
+class Z80LoopCounters : public FunctionPass {
+public:
+  Z80LoopCounters() : FunctionPass(ID) {}
+
+  bool runOnFunction(Function &F) override;
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<ScalarEvolutionWrapperPass>();
+  }
+
+  StringRef getPassName() const override {
+    return "Z80 Loop Counters";
+  }
+
+private:
+  bool AddCounter(Loop &L);
+
+  LoopInfo *LI;
+  ScalarEvolution *SE;
+  const DataLayout *DL;
+  bool OptSize;
+  static char ID;
+};
+
+class Z80HardwareLoops : public MachineFunctionPass {
+public:
+  Z80HardwareLoops() : MachineFunctionPass(ID) {}
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.addRequired<MachineLoopInfo>();
+    AU.addPreserved<MachineLoopInfo>();
+    AU.addRequired<MachineBlockFrequencyInfo>();
+    AU.addPreserved<MachineBlockFrequencyInfo>();
+    MachineFunctionPass::getAnalysisUsage(AU);
+  }
+
+  StringRef getPassName() const override {
+    return "Z80 Hardware Loops";
+  }
+
+private:
+  MachineInstr *FindCounter(MachineLoop &L, MachineBasicBlock &Latch);
+  bool PrepareLoop(MachineLoop &L);
+
+  const TargetInstrInfo *TII;
+  const TargetRegisterInfo *TRI;
+  MachineRegisterInfo *MRI;
+  MachineBlockFrequencyInfo *MBFI;
+  static char ID;
+};
+
+class Z80FormDJNZ : public MachineFunctionPass {
+public:
+  Z80FormDJNZ() : MachineFunctionPass(ID) {}
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+
+  MachineFunctionProperties getRequiredProperties() const override {
+    return MachineFunctionProperties().set(
+             MachineFunctionProperties::Property::NoVRegs);
+  }
+
+  StringRef getPassName() const override {
+    return "Z80 Form DJNZ";
+  }
+
+private:
+  const TargetInstrInfo *TII;
+  const TargetRegisterInfo *TRI;
+  static char ID;
+};
+
+char Z80LoopCounters::ID = 0;
+char Z80HardwareLoops::ID = 0;
+char Z80FormDJNZ::ID = 0;
+} // end anonymous namespace
+
+FunctionPass *llvm::createZ80LoopCountersPass() {
+  return new Z80LoopCounters();
+}
+
+FunctionPass *llvm::createZ80HardwareLoopsPass() {
+  return new Z80HardwareLoops();
+}
+
+FunctionPass *llvm::createZ80FormDJNZPass() {
+  return new Z80FormDJNZ();
+}
+
+/// Return true if the latch of L already branches on an i8 header phi
+/// decremented to zero.
+static bool isByteCountdown(const Loop &L, const BranchInst &BI) {
+  ICmpInst::Predicate Pred;
+  Value *Count;
+  return match(BI.getCondition(),
+               m_ICmp(Pred, m_Add(m_Value(Count), m_AllOnes()), m_Zero())) &&
+         ICmpInst::isEquality(Pred) && Count->getType()->isIntegerTy(8) &&
+         isa<PHINode>(Count) &&
+         cast<PHINode>(Count)->getParent() == L.getHeader();
+}
+
+/// Return true if L calls anything.  A call clobbers b, and the block
+/// instructions that calls may be lowered to count in bc.
+static bool hasCalls(const Loop &L) {
+  for (const BasicBlock *BB : L.blocks()) {
+    for (const Instruction &I : *BB) {
+      if (!isa<CallInst>(I) && !isa<InvokeInst>(I)) {
+        continue;
+      }
+      if (auto *II = dyn_cast<IntrinsicInst>(&I)) {
+        if (isa<DbgInfoIntrinsic>(II) ||
+            II->getIntrinsicID() == Intrinsic::lifetime_start ||
+            II->getIntrinsicID() == Intrinsic::lifetime_end) {
+          continue;
+        }
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+/// Delete PN if nothing but itself and instructions without side effects
+/// depend on it, like an induction variable the exit test no longer uses.
+static void deleteDeadCycle(PHINode &PN) {
+  SmallSetVector<Instruction *, 8> Cycle;
+  Cycle.insert(&PN);
+  for (unsigned I = 0; I != Cycle.size(); ++I) {
+    for (User *U : Cycle[I]->users()) {
+      auto *UI = cast<Instruction>(U);
+      if (Cycle.count(UI)) {
+        continue;
+      }
+      if (UI->mayHaveSideEffects() || UI->isTerminator() ||
+          Cycle.size() == 8) {
+        return;
+      }
+      Cycle.insert(UI);
+    }
+  }
+  for (Instruction *I : Cycle) {
+    I->dropAllReferences();
+  }
+  for (Instruction *I : Cycle) {
+    I->eraseFromParent();
+  }
+}
+
+/// Give L a counter of its trips in place of its exit test, if it has one
+/// exit, in its latch, and scalar evolution can compute how often it is taken.
+bool Z80LoopCounters::AddCounter(Loop &L) {
+  BasicBlock *Preheader = L.getLoopPreheader();
+  BasicBlock *Header = L.getHeader();
+  BasicBlock *Latch = L.getLoopLatch();
+  if (!Preheader || !Latch || L.getExitingBlock() != Latch) {
+    return false;
+  }
+  auto *BI = dyn_cast<BranchInst>(Latch->getTerminator());
+  if (!BI || !BI->isConditional() || isByteCountdown(L, *BI) || hasCalls(L)) {
+    return false;
+  }
+
+  // The number of times the latch branches back, one less than the trip
+  // count.  Counts that take two bytes cost a second latch and are only
+  // worth it when optimizing for speed.
+  const SCEV *BTC = SE->getExitCount(&L, Latch);
+  if (isa<SCEVCouldNotCompute>(BTC) || !BTC->getType()->isIntegerTy()) {
+    return false;
+  }
+  // The range of the count alone wraps around when it is one less than a
+  // value that may be 0, which the exit test of the loop may rule out.
+  uint64_t MaxBTC = SE->getUnsignedRangeMax(BTC).getLimitedValue();
+  if (auto *MaxBE = dyn_cast<SCEVConstant>(SE->getMaxBackedgeTakenCount(&L))) {
+    MaxBTC = std::min(MaxBTC, MaxBE->getAPInt().getLimitedValue());
+  }
+  bool Split = MaxBTC > UINT8_MAX;
+  if (MaxBTC > UINT16_MAX || (Split && OptSize)) {
+    return false;
+  }
+
+  // Each byte of the trip count is one more than that of the backedge taken
+  // count, where a low byte of 0 makes 256 trips, and a high byte of 0 makes
+  // 256 rounds of the low one.  Computing them as bytes lets a count like
+  // zext(n) - 1 fold back to n.
+  Type *ByteTy = Type::getInt8Ty(Header->getContext());
+  const SCEV *One = SE->getOne(ByteTy);
+  const SCEV *LoCount = SE->getAddExpr(SE->getTruncateOrNoop(BTC, ByteTy), One);
+  const SCEV *HiCount = nullptr;
+  if (Split) {
+    HiCount = SE->getAddExpr(
+      SE->getTruncateExpr(
+        SE->getUDivExpr(BTC, SE->getConstant(BTC->getType(), 256)), ByteTy),
+      One);
+  }
+  SCEVExpander Expander(*SE, *DL, "count");
+  Instruction *InsertPt = Preheader->getTerminator();
+  if (!isSafeToExpand(BTC, *SE) ||
+      Expander.isHighCostExpansion(LoCount, &L, InsertPt) ||
+      (HiCount && Expander.isHighCostExpansion(HiCount, &L, InsertPt))) {
+    return false;
+  }
+
+  LLVM_DEBUG(dbgs() << "Adding a " << (Split ? "two byte" : "byte")
+                    << " counter to loop " << Header->getName()
+                    << " with backedge taken count " << *BTC << "\n");
+  Value *Lo = Expander.expandCodeFor(LoCount, ByteTy, InsertPt);
+  Value *Hi = HiCount ? Expander.expandCodeFor(HiCount, ByteTy, InsertPt)
+                      : nullptr;
+  SE->forgetLoop(&L);
+  BasicBlock *Exit = BI->getSuccessor(BI->getSuccessor(0) == Header);
+  Value *OldCond = BI->getCondition();
+
+  IRBuilder<> Builder(BI);
+  Constant *MinusOne = Constant::getAllOnesValue(ByteTy);
+  Constant *Zero = Constant::getNullValue(ByteTy);
+  PHINode *LoPhi = PHINode::Create(ByteTy, 3, "counter", &Header->front());
+  Value *LoNext = Builder.CreateAdd(LoPhi, MinusOne, "counter.next");
+  Value *LoCond = Builder.CreateICmpNE(LoNext, Zero);
+  LoPhi->addIncoming(Lo, Preheader);
+  LoPhi->addIncoming(LoNext, Latch);
+
+  BasicBlock *Done = Exit;
+  if (Split) {
+    // The outer latch, placed after the latch, counts the rounds of the low
+    // byte, and goes back to the header with it at 0 for 256 more trips.
+    Function *F = Header->getParent();
+    BasicBlock *Outer = BasicBlock::Create(F->getContext(),
+                                           Latch->getName() + ".outer", F,
+                                           Latch->getNextNode());
+    PHINode *HiPhi = PHINode::Create(ByteTy, 3, "counter.hi",
+                                     &Header->front());
+    Builder.SetInsertPoint(Outer);
+    Value *HiNext = Builder.CreateAdd(HiPhi, MinusOne, "counter.hi.next");
+    Builder.CreateCondBr(Builder.CreateICmpNE(HiNext, Zero), Header, Exit);
+    for (PHINode &PN : Header->phis()) {
+      if (&PN != LoPhi && &PN != HiPhi) {
+        PN.addIncoming(PN.getIncomingValueForBlock(Latch), Outer);
+      }
+    }
+    LoPhi->addIncoming(LoNext, Outer);
+    HiPhi->addIncoming(Hi, Preheader);
+    HiPhi->addIncoming(HiPhi, Latch);
+    HiPhi->addIncoming(HiNext, Outer);
+    for (PHINode &PN : Exit->phis()) {
+      int Idx = PN.getBasicBlockIndex(Latch);
+      if (Idx >= 0) {
+        PN.setIncomingBlock(Idx, Outer);
+      }
+    }
+    L.addBasicBlockToLoop(Outer, *LI);
+    Done = Outer;
+    ++NumSplitCounters;
+  } else {
+    ++NumCounters;
+  }
+
+  if (BI->getSuccessor(0) != Header) {
+    BI->swapSuccessors();
+  }
+  BI->setCondition(LoCond);
+  BI->setSuccessor(1, Done);
+
+  // The old exit test, and the induction variables only it used.
+  RecursivelyDeleteTriviallyDeadInstructions(OldCond);
+  SmallVector<WeakTrackingVH, 4> Phis;
+  for (PHINode &PN : Header->phis()) {
+    Phis.push_back(&PN);
+  }
+  for (WeakTrackingVH &PN : Phis) {
+    if (PN) {
+      deleteDeadCycle(*cast<PHINode>(PN));
+    }
+  }
+  return true;
+}
+
+bool Z80LoopCounters::runOnFunction(Function &F) {
+  if (skipFunction(F)) {
+    return false;
+  }
+  LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  SE = &getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+  DL = &F.getParent()->getDataLayout();
+  OptSize = F.optForSize();
+
+  // Only innermost loops get a counter, since there is only one b.
+  SmallVector<Loop *, 8> Loops;
+  for (Loop *TopLoop : *LI) {
+    for (Loop *L : depth_first(TopLoop)) {
+      if (L->empty()) {
+        Loops.push_back(L);
+      }
+    }
+  }
+  bool Changed = false;
+  for (Loop *L : Loops) {
+    Changed |= AddCounter(*L);
+  }
+  return Changed;
+}
+
+/// Return the last instruction before I that defines the flags, or null if
+/// they come from outside the block.
+static MachineInstr *findFlagsDef(MachineBasicBlock &MBB,
+                                  MachineBasicBlock::iterator I,
+                                  const TargetRegisterInfo *TRI) {
+  while (I != MBB.begin()) {
+    --I;
+    if (I->modifiesRegister(Z80::F, TRI)) {
+      return &*I;
+    }
+  }
+  return nullptr;
+}
+
+/// Put the branch of Latch back to the header of L in the form djnz will take,
+/// and return the decrement of the counter it tests, or null if it doesn't
+/// test one.
+MachineInstr *Z80HardwareLoops::FindCounter(MachineLoop &L,
+                                            MachineBasicBlock &Latch) {
+  MachineBasicBlock *Header = L.getHeader();
+  MachineBasicBlock *TBB = nullptr, *FBB = nullptr;
+  SmallVector<MachineOperand, 1> Cond;
+  if (TII->analyzeBranch(Latch, TBB, FBB, Cond, false) || Cond.empty()) {
+    return nullptr;
+  }
+
+  // Branching back to the header must be on nonzero.
+  bool Reverse = TBB != Header;
+  if (Reverse && FBB != Header && (FBB || !Latch.isLayoutSuccessor(Header))) {
+    return nullptr;
+  }
+  if (Cond[0].getImm() != (Reverse ? Z80::COND_Z : Z80::COND_NZ)) {
+    return nullptr;
+  }
+
+  // The flags must come from decrementing a byte that goes around the loop.
+  MachineInstr *Dec = findFlagsDef(Latch, Latch.getFirstTerminator(), TRI);
+  if (!Dec || Dec->getOpcode() != Z80::DEC8r) {
+    return nullptr;
+  }
+  unsigned NextReg = Dec->getOperand(0).getReg();
+  unsigned CountReg = Dec->getOperand(1).getReg();
+  if (!TargetRegisterInfo::isVirtualRegister(NextReg) ||
+      !TargetRegisterInfo::isVirtualRegister(CountReg)) {
+    return nullptr;
+  }
+  MachineInstr *Phi = MRI->getVRegDef(CountReg);
+  if (!Phi || !Phi->isPHI() || Phi->getParent() != Header) {
+    return nullptr;
+  }
+  bool FromLatch = false;
+  for (unsigned I = 1, E = Phi->getNumOperands(); I != E; I += 2) {
+    if (Phi->getOperand(I + 1).getMBB() == &Latch) {
+      FromLatch = Phi->getOperand(I).getReg() == NextReg;
+    }
+  }
+  if (!FromLatch) {
+    return nullptr;
+  }
+
+  if (Reverse) {
+    MachineBasicBlock *Exit = TBB;
+    DebugLoc DL = Latch.findBranchDebugLoc();
+    TII->reverseBranchCondition(Cond);
+    TII->removeBranch(Latch);
+    TII->insertBranch(Latch, Header, Exit, Cond, DL);
+  }
+  return Dec;
+}
+
+bool Z80HardwareLoops::PrepareLoop(MachineLoop &L) {
+  MachineBasicBlock *Header = L.getHeader();
+
+  // A loop with a two byte counter has a latch for each byte.  Only one of
+  // them can count in b, so take the one that branches back most often.
+  MachineInstr *Dec = nullptr;
+  BlockFrequency DecFreq;
+  for (MachineBasicBlock *Pred : Header->predecessors()) {
+    if (!L.contains(Pred)) {
+      continue;
+    }
+    MachineInstr *LatchDec = FindCounter(L, *Pred);
+    if (LatchDec && (!Dec || MBFI->getBlockFreq(Pred) > DecFreq)) {
+      Dec = LatchDec;
+      DecFreq = MBFI->getBlockFreq(Pred);
+    }
+  }
+  if (!Dec) {
+    return false;
+  }
+
+  // Ask for the whole counter, including its initial values, to live in b so
+  // that the dec and the branch can later be merged.
+  unsigned NextReg = Dec->getOperand(0).getReg();
+  unsigned CountReg = Dec->getOperand(1).getReg();
+  MachineInstr *Phi = MRI->getVRegDef(CountReg);
+  SmallVector<unsigned, 4> Regs = { CountReg, NextReg };
+  for (unsigned I = 1, E = Phi->getNumOperands(); I != E; I += 2) {
+    unsigned Reg = Phi->getOperand(I).getReg();
+    if (TargetRegisterInfo::isVirtualRegister(Reg) && Reg != NextReg) {
+      Regs.push_back(Reg);
+    }
+  }
+  for (unsigned Reg : Regs) {
+    if (MRI->getRegClass(Reg)->contains(Z80::B) &&
+        !MRI->getRegAllocationHint(Reg).second) {
+      MRI->setSimpleHint(Reg, Z80::B);
+    }
+  }
+  LLVM_DEBUG(dbgs() << "Hinted counter of loop " << printMBBReference(*Header)
+                    << " to b\n");
+  ++NumHinted;
+  return true;
+}
+
+bool Z80HardwareLoops::runOnMachineFunction(MachineFunction &MF) {
+  if (skipFunction(MF.getFunction())) {
+    return false;
+  }
+  TII = MF.getSubtarget().getInstrInfo();
+  TRI = MF.getSubtarget().getRegisterInfo();
+  MRI = &MF.getRegInfo();
+  MBFI = &getAnalysis<MachineBlockFrequencyInfo>();
+  bool Changed = false;
+  for (MachineLoop *TopLoop : getAnalysis<MachineLoopInfo>()) {
+    for (MachineLoop *L : depth_first(TopLoop)) {
+      Changed |= PrepareLoop(*L);
+    }
+  }
+  return Changed;
+}
+
+bool Z80FormDJNZ::runOnMachineFunction(MachineFunction &MF) {
+  if (skipFunction(MF.getFunction())) {
+    return false;
+  }
+  TII = MF.getSubtarget().getInstrInfo();
+  TRI = MF.getSubtarget().getRegisterInfo();
+
+  // Block offsets, to keep djnz within its reach.
+  SmallVector<unsigned, 16> BlockOffsets(MF.getNumBlockIDs());
+  unsigned Offset = 0;
+  for (auto &MBB : MF) {
+    BlockOffsets[MBB.getNumber()] = Offset;
+    for (auto &MI : MBB) {
+      Offset += TII->getInstSizeInBytes(MI);
+    }
+  }
+
+  bool Changed = false;
+  for (auto &MBB : MF) {
+    unsigned BranchOffset = BlockOffsets[MBB.getNumber()];
+    MachineBasicBlock::iterator Branch = MBB.end();
+    for (auto I = MBB.begin(), E = MBB.end(); I != E; ++I) {
+      if (I->getOpcode() == Z80::JQCC &&
+          I->getOperand(1).getImm() == Z80::COND_NZ) {
+        Branch = I;
+        break;
+      }
+      BranchOffset += TII->getInstSizeInBytes(*I);
+    }
+    if (Branch == MBB.end()) {
+      continue;
+    }
+
+    // Nothing else may see the flags.
+    bool FlagsUsed = false;
+    for (auto I = std::next(Branch), E = MBB.end(); I != E; ++I) {
+      FlagsUsed |= I->readsRegister(Z80::F, TRI);
+    }
+    for (MachineBasicBlock *Succ : MBB.successors()) {
+      FlagsUsed |= Succ->isLiveIn(Z80::F);
+    }
+    if (FlagsUsed) {
+      continue;
+    }
+
+    // Find the dec b that set them, with b untouched since.
+    MachineInstr *Dec = findFlagsDef(MBB, Branch, TRI);
+    if (!Dec || Dec->getOpcode() != Z80::DEC8r ||
+        Dec->getOperand(0).getReg() != Z80::B) {
+      continue;
+    }
+    bool Clobbered = false;
+    for (auto I = std::next(MachineBasicBlock::iterator(Dec)); I != Branch;
+         ++I) {
+      Clobbered |= I->readsRegister(Z80::F, TRI) ||
+                   I->readsRegister(Z80::B, TRI) ||
+                   I->modifiesRegister(Z80::B, TRI);
+    }
+    if (Clobbered) {
+      continue;
+    }
+
+    // The displacement is from the end of the two byte djnz, which takes the
+    // place of the three byte jp.
+    MachineBasicBlock *Target = Branch->getOperand(0).getMBB();
+    int64_t Disp = int64_t(BlockOffsets[Target->getNumber()]) -
+                   int64_t(BranchOffset + 2);
+    if (!isInt<8>(Disp)) {
+      continue;
+    }
+
+    LLVM_DEBUG(dbgs() << "Forming djnz in " << printMBBReference(MBB)
+                      << "\n");
+    BuildMI(MBB, Branch, Branch->getDebugLoc(), TII->get(Z80::DJNZ))
+      .addMBB(Target);
+    Branch->eraseFromParent();
+    Dec->eraseFromParent();
+    ++NumDJNZ;
+    Changed = true;
+  }
+  return Changed;
+}
@@ -1,15 +1,15 @@
 //===- Z80ISelDAGToDAG.cpp - A DAG pattern matching inst selector for Z80 -===//
-//
+
 //                     The LLVM Compiler Infrastructure
-//
+
 // This file is distributed under the University of Illinois Open Source
 // License. See LICENSE.TXT for details.
-//
+
 //===----------------------------------------------------------------------===//
-//
+
 // This file defines a DAG pattern matching instruction selector for Z80,
 // converting from a legalized dag to a Z80 dag.
-//
+
 //===----------------------------------------------------------------------===//
 
 #include "Z80.h"
@@ -26,10 +26,10 @@ namespace {
 /// SelectionDAG operations.
 ///
 class Z80DAGToDAGISel final : public SelectionDAGISel {
-//  /// Keep a pointer to the Z80Subtarget around so that we can
-//  /// make the right decision when generating code for different targets.
-//  const Z80Subtarget *Subtarget;
-//
+  /// Keep a pointer to the Z80Subtarget around so that we can
+  /// make the right decision when generating code for different targets.
+  const Z80Subtarget *Subtarget;
+
   /// If true, selector should try to optimize for code size instead of
   /// performance.
   bool OptForSize;
@@ -37,132 +37,132 @@ class Z80DAGToDAGISel final : public SelectionDAGISel {
 public:
   explicit Z80DAGToDAGISel(Z80TargetMachine &TM, CodeGenOpt::Level OptLevel)
     : SelectionDAGISel(TM, OptLevel), OptForSize(false) {}
-//
-//  StringRef getPassName() const override {
-//    return "Z80 DAG->DAG Instruction Selection";
-//  }
-//
-//  bool runOnMachineFunction(MachineFunction &MF) override {
-//    // Reset the subtarget each time through.
-//    Subtarget = &MF.getSubtarget<Z80Subtarget>();
-//    return SelectionDAGISel::runOnMachineFunction(MF);
-//  }
-//
-//// Include the pieces autogenerated from the target description.
+
+  StringRef getPassName() const override {
+    return "Z80 DAG->DAG Instruction Selection";
+  }
+
+  bool runOnMachineFunction(MachineFunction &MF) override {
+    // Reset the subtarget each time through.
+    Subtarget = &MF.getSubtarget<Z80Subtarget>();
+    return SelectionDAGISel::runOnMachineFunction(MF);
+  }
+
+// Include the pieces autogenerated from the target description.
 #include "Z80GenDAGISel.inc"
 
 private:
   void Select(SDNode *N) override;
-//
-//  bool SelectMem(SDValue N, SDValue &Mem);
-//  bool SelectOff(SDValue N, SDValue &Reg, SDValue &Off);
-//  bool SelectFI(SDValue N, SDValue &Reg, SDValue &Off);
-//
-//  /// Implement addressing mode selection for inline asm expressions.
-//  bool SelectInlineAsmMemoryOperand(const SDValue &Op, unsigned ConstraintID,
-//                                    std::vector<SDValue> &OutOps) override;
+
+  bool SelectMem(SDValue N, SDValue &Mem);
+  bool SelectOff(SDValue N, SDValue &Reg, SDValue &Off);
+  bool SelectFI(SDValue N, SDValue &Reg, SDValue &Off);
+
+  /// Implement addressing mode selection for inline asm expressions.
+  bool SelectInlineAsmMemoryOperand(const SDValue &Op, unsigned ConstraintID,
+                                    std::vector<SDValue> &OutOps) override;
 };
 }
 
 void Z80DAGToDAGISel::Select(SDNode *Node) {
-//  SDLoc DL(Node);
-//
-//  // Dump information about the Node being selected
-//  LLVM_DEBUG(dbgs() << "Selecting: "; Node->dump(CurDAG); dbgs() << '\n');
-//
-//  // If we have a custom node, we already have selected!
-//  if (Node->isMachineOpcode()) {
-//    LLVM_DEBUG(dbgs() << "== "; Node->dump(CurDAG); dbgs() << '\n');
-//    Node->setNodeId(-1);
-//    return;
-//  }
-//
+  SDLoc DL(Node);
+
+  // Dump information about the Node being selected
+  LLVM_DEBUG(dbgs() << "Selecting: "; Node->dump(CurDAG); dbgs() << '\n');
+
+  // If we have a custom node, we already have selected!
+  if (Node->isMachineOpcode()) {
+    LLVM_DEBUG(dbgs() << "== "; Node->dump(CurDAG); dbgs() << '\n');
+    Node->setNodeId(-1);
+    return;
+  }
+
   // Select the default instruction
   SelectCode(Node);
 }
-//
-//bool Z80DAGToDAGISel::SelectMem(SDValue N, SDValue &Mem) {
-//  switch (N.getOpcode()) {
-//  default:
-//    LLVM_DEBUG(dbgs() << "SelectMem: " << N->getOperationName() << '\n');
-//    return false;
-//  case ISD::Constant: {
-//      uint64_t Val = cast<ConstantSDNode>(N)->getSExtValue();
-//      //Mem = CurDAG->getTargetConstant(Val, SDLoc(N), MVT::i24);
-//      Mem = CurDAG->getTargetConstant(Val, SDLoc(N), MVT::i16);
-//      return true;
-//    }
-//  case Z80ISD::Wrapper: {
-//      Mem = N->getOperand(0);
-//      return true;
-//    }
-//  }
-//}
-//bool Z80DAGToDAGISel::SelectOff(SDValue N, SDValue &Reg, SDValue &Off) {
-//  switch (N.getOpcode()) {
-//  default: return false;
-//  case ISD::ADD:
-//    for (int I = 0; I != 2; ++I) {
-//      if (ConstantSDNode *C = dyn_cast<ConstantSDNode>(N.getOperand(I))) {
-//        int64_t Val = C->getSExtValue();
-//        if (!isInt<8>(Val)) {
-//          continue;
-//        }
-//        Reg = N.getOperand(1 - I);
-//        FrameIndexSDNode *Idx = dyn_cast<FrameIndexSDNode>(Reg);
-//        if (Val >= -1 && Val <= 1 && !Idx && Reg.hasOneUse()) {
-//          continue;
-//        }
-//        if (Idx)
-//          Reg = CurDAG->getTargetFrameIndex(
-//                  Idx->getIndex(), TLI->getPointerTy(CurDAG->getDataLayout()));
-//        Off = CurDAG->getTargetConstant(Val, SDLoc(N), MVT::i8);
-//        LLVM_DEBUG(dbgs() << "Selected ADD:\n";
-//                   N.dumpr();
-//                   dbgs() << "becomes\n";
-//                   Reg.dumpr();
-//                   Off.dumpr());
-//        return true;
-//      }
-//    }
-//    return false;
-//  case ISD::FrameIndex:
-//    Reg = CurDAG->getTargetFrameIndex(
-//            cast<FrameIndexSDNode>(N)->getIndex(),
-//            TLI->getPointerTy(CurDAG->getDataLayout()));
-//    Off = CurDAG->getTargetConstant(0, SDLoc(N), MVT::i8);
-//    return true;
-//  }
-//}
-//bool Z80DAGToDAGISel::SelectFI(SDValue N, SDValue &Reg, SDValue &Off) {
-//  if (!SelectOff(N, Reg, Off)) {
-//    return false;
-//  }
-//  return isa<FrameIndexSDNode>(Reg);
-//}
-//
-//bool Z80DAGToDAGISel::
-//SelectInlineAsmMemoryOperand(const SDValue &Op, unsigned ConstraintID,
-//                             std::vector<SDValue> &OutOps) {
-//  SDValue Op0, Op1;
-//  switch (ConstraintID) {
-//  default:
-//    llvm_unreachable("Unexpected asm memory constraint");
-//  case InlineAsm::Constraint_m:
-//    if (!SelectMem(Op, Op0)) {
-//      return true;
-//    }
-//    OutOps.push_back(Op0);
-//    return false;
-//  case InlineAsm::Constraint_o:
-//    if (!SelectOff(Op, Op0, Op1)) {
-//      return true;
-//    }
-//    OutOps.push_back(Op0);
-//    OutOps.push_back(Op1);
-//    return false;
-//  }
-//}
+
+bool Z80DAGToDAGISel::SelectMem(SDValue N, SDValue &Mem) {
+  switch (N.getOpcode()) {
+  default:
+    LLVM_DEBUG(dbgs() << "SelectMem: " << N->getOperationName() << '\n');
+    return false;
+  case ISD::Constant: {
+      uint64_t Val = cast<ConstantSDNode>(N)->getSExtValue();
+      //Mem = CurDAG->getTargetConstant(Val, SDLoc(N), MVT::i24);
+      Mem = CurDAG->getTargetConstant(Val, SDLoc(N), MVT::i16);
+      return true;
+    }
+  case Z80ISD::Wrapper: {
+      Mem = N->getOperand(0);
+      return true;
+    }
+  }
+}
+bool Z80DAGToDAGISel::SelectOff(SDValue N, SDValue &Reg, SDValue &Off) {
+  switch (N.getOpcode()) {
+  default: return false;
+  case ISD::ADD:
+    for (int I = 0; I != 2; ++I) {
+      if (ConstantSDNode *C = dyn_cast<ConstantSDNode>(N.getOperand(I))) {
+        int64_t Val = C->getSExtValue();
+        if (!isInt<8>(Val)) {
+          continue;
+        }
+        Reg = N.getOperand(1 - I);
+        FrameIndexSDNode *Idx = dyn_cast<FrameIndexSDNode>(Reg);
+        if (Val >= -1 && Val <= 1 && !Idx && Reg.hasOneUse()) {
+          continue;
+        }
+        if (Idx)
+          Reg = CurDAG->getTargetFrameIndex(
+                  Idx->getIndex(), TLI->getPointerTy(CurDAG->getDataLayout()));
+        Off = CurDAG->getTargetConstant(Val, SDLoc(N), MVT::i8);
+        LLVM_DEBUG(dbgs() << "Selected ADD:\n";
+                   N.dumpr();
+                   dbgs() << "becomes\n";
+                   Reg.dumpr();
+                   Off.dumpr());
+        return true;
+      }
+    }
+    return false;
+  case ISD::FrameIndex:
+    Reg = CurDAG->getTargetFrameIndex(
+            cast<FrameIndexSDNode>(N)->getIndex(),
+            TLI->getPointerTy(CurDAG->getDataLayout()));
+    Off = CurDAG->getTargetConstant(0, SDLoc(N), MVT::i8);
+    return true;
+  }
+}
+bool Z80DAGToDAGISel::SelectFI(SDValue N, SDValue &Reg, SDValue &Off) {
+  if (!SelectOff(N, Reg, Off)) {
+    return false;
+  }
+  return isa<FrameIndexSDNode>(Reg);
+}
+
+bool Z80DAGToDAGISel::
+SelectInlineAsmMemoryOperand(const SDValue &Op, unsigned ConstraintID,
+                             std::vector<SDValue> &OutOps) {
+  SDValue Op0, Op1;
+  switch (ConstraintID) {
+  default:
+    llvm_unreachable("Unexpected asm memory constraint");
+  case InlineAsm::Constraint_m:
+    if (!SelectMem(Op, Op0)) {
+      return true;
+    }
+    OutOps.push_back(Op0);
+    return false;
+  case InlineAsm::Constraint_o:
+    if (!SelectOff(Op, Op0, Op1)) {
+      return true;
+    }
+    OutOps.push_back(Op0);
+    OutOps.push_back(Op1);
+    return false;
+  }
+}
 
 /// This pass converts a legalized DAG into Z80-specific DAG,
 /// ready for instruction scheduling.
@@ -0,0 +1,411 @@
+//===------- Z80KnownValues.cpp - Reuse values held in registers ---------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines a pass that follows the values of the 8-bit registers
+// through each block after register allocation, numbering them so that a
+// register copied from another is known to hold the same value, and uses this
+// to make constants and copies cheaper:
+//   ld de, 0             -> ld d, h / ld e, l    when h and l hold 0
+//   ld r, n              -> ld r, r'             when r' holds n
+//   ld (ix+d), n         -> ld (ix+d), r'        when r' holds n
+//   ld (hl), n           -> ld (hl), r'          when r' holds n
+//   ld r, n / ld r, r'   -> nothing              when r already holds it
+// A 16-bit load is split into byte moves only if that is cheaper, in bytes
+// first when optimizing for size and in T-states first otherwise.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Z80.h"
+#include "Z80InstrInfo.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/CodeGen/TargetInstrInfo.h"
+#include "llvm/CodeGen/TargetSubtargetInfo.h"
+#include <array>
+using namespace llvm;
+
+#define DEBUG_TYPE "z80-known-values"
+
+STATISTIC(NumRemoved, "Number of loads of values already in place removed");
+STATISTIC(NumReused, "Number of constants taken from another register");
+STATISTIC(NumSplit, "Number of 16-bit constants loaded as bytes");
+
+namespace {
+/// The registers whose values are followed.  The first seven can be moved to
+/// each other with ld r, r'.
+const MCPhysReg TrackedRegs[] = {
+  Z80::A, Z80::B, Z80::C, Z80::D, Z80::E, Z80::H, Z80::L,
+  Z80::IXH, Z80::IXL, Z80::IYH, Z80::IYL
+};
+const unsigned NumTracked = array_lengthof(TrackedRegs);
+const unsigned NumSources = 7;
+
+using Z80::Cost;
+
+/// Value numbers below 256 are the constants with that value, the others are
+/// unknown values, distinct unless copied.
+typedef std::array<unsigned, NumTracked> ValueArray;
+
+class Z80KnownValues : public MachineFunctionPass {
+public:
+  Z80KnownValues() : MachineFunctionPass(ID) {}
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+
+  MachineFunctionProperties getRequiredProperties() const override {
+    return MachineFunctionProperties()
+           .set(MachineFunctionProperties::Property::NoVRegs)
+           .set(MachineFunctionProperties::Property::TracksLiveness);
+  }
+
+  StringRef getPassName() const override {
+    return "Z80 Known Register Values";
+  }
+
+private:
+  bool optimizeBlock(MachineBasicBlock &MBB);
+  bool optimizeLoad16(MachineInstr &MI);
+  /// Follow the values through MI.
+  void update(MachineInstr &MI);
+  /// A tracked register holding Val that may be moved to Dst, or -1.
+  int findSource(const ValueArray &Vals, unsigned Val, unsigned Dst) const;
+  /// Register I is read again after all, extend its liveness to here.
+  void reuse(unsigned I);
+  unsigned newValue() { return NextValue++; }
+
+  const TargetInstrInfo *TII;
+  const TargetRegisterInfo *TRI;
+  bool OptSize;
+
+  ValueArray Vals;
+  /// The use that ended the liveness of each register, and the dead def that
+  /// gave it its value, which must be undone when the value is reused.
+  std::array<MachineOperand *, NumTracked> Kills, DeadDefs;
+  unsigned NextValue;
+  static char ID;
+};
+
+char Z80KnownValues::ID = 0;
+} // end anonymous namespace
+
+FunctionPass *llvm::createZ80KnownValuesPass() {
+  return new Z80KnownValues();
+}
+
+static int getTrackedIndex(unsigned Reg) {
+  for (unsigned I = 0; I != NumTracked; ++I) {
+    if (TrackedRegs[I] == Reg) {
+      return I;
+    }
+  }
+  return -1;
+}
+
+bool Z80KnownValues::runOnMachineFunction(MachineFunction &MF) {
+  if (skipFunction(MF.getFunction())) {
+    return false;
+  }
+  TII = MF.getSubtarget().getInstrInfo();
+  TRI = MF.getSubtarget().getRegisterInfo();
+  OptSize = MF.getFunction().optForSize();
+  bool Changed = false;
+  for (auto &MBB : MF) {
+    Changed |= optimizeBlock(MBB);
+  }
+  return Changed;
+}
+
+int Z80KnownValues::findSource(const ValueArray &Vals, unsigned Val,
+                               unsigned Dst) const {
+  for (unsigned I = 0; I != NumSources; ++I) {
+    if (Vals[I] == Val && TrackedRegs[I] != Dst) {
+      return I;
+    }
+  }
+  return -1;
+}
+
+void Z80KnownValues::reuse(unsigned I) {
+  for (auto *Ops : {&Kills, &DeadDefs}) {
+    MachineOperand *MO = (*Ops)[I];
+    if (!MO) {
+      continue;
+    }
+    if (MO->isDef()) {
+      MO->setIsDead(false);
+    } else {
+      MO->setIsKill(false);
+    }
+    // The operand may cover other registers as well.
+    for (MachineOperand *&Other : *Ops) {
+      if (Other == MO) {
+        Other = nullptr;
+      }
+    }
+  }
+}
+
+void Z80KnownValues::update(MachineInstr &MI) {
+  // Values the instruction puts in registers that can be followed.
+  SmallVector<std::pair<unsigned, unsigned>, 4> Known;
+  auto getImm = [&](unsigned Idx) { return MI.getOperand(Idx).getImm(); };
+  auto track = [&](unsigned Reg, unsigned Val) {
+    int I = getTrackedIndex(Reg);
+    if (I >= 0) {
+      Known.push_back({I, Val});
+    }
+  };
+  switch (MI.getOpcode()) {
+  case Z80::LD8ri:
+    if (MI.getOperand(1).isImm()) {
+      track(MI.getOperand(0).getReg(), getImm(1) & 0xFF);
+    }
+    break;
+  case Z80::LD16ri:
+    if (MI.getOperand(1).isImm()) {
+      unsigned Reg = MI.getOperand(0).getReg();
+      track(TRI->getSubReg(Reg, Z80::sub_low), getImm(1) & 0xFF);
+      track(TRI->getSubReg(Reg, Z80::sub_high), getImm(1) >> 8 & 0xFF);
+    }
+    break;
+  case Z80::LD8gg: {
+    int Src = getTrackedIndex(MI.getOperand(1).getReg());
+    if (Src >= 0) {
+      track(MI.getOperand(0).getReg(), Vals[Src]);
+    }
+    break;
+  }
+  case Z80::XOR8ar:
+  case Z80::SUB8ar:
+    if (MI.getOperand(0).getReg() == Z80::A) {
+      track(Z80::A, 0);
+    }
+    break;
+  case Z80::INC8r:
+  case Z80::DEC8r: {
+    int I = getTrackedIndex(MI.getOperand(0).getReg());
+    if (I >= 0 && Vals[I] < 256) {
+      track(TrackedRegs[I],
+            (Vals[I] + (MI.getOpcode() == Z80::INC8r ? 1 : 255)) & 0xFF);
+    }
+    break;
+  }
+  case Z80::EX16DE:
+    track(Z80::D, Vals[getTrackedIndex(Z80::H)]);
+    track(Z80::E, Vals[getTrackedIndex(Z80::L)]);
+    track(Z80::H, Vals[getTrackedIndex(Z80::D)]);
+    track(Z80::L, Vals[getTrackedIndex(Z80::E)]);
+    break;
+  }
+
+  if (MI.isInlineAsm()) {
+    for (unsigned I = 0; I != NumTracked; ++I) {
+      Vals[I] = newValue();
+      Kills[I] = DeadDefs[I] = nullptr;
+    }
+    return;
+  }
+  for (MachineOperand &MO : MI.operands()) {
+    if (MO.isReg() && MO.getReg() && MO.isUse() && MO.isKill()) {
+      for (unsigned I = 0; I != NumTracked; ++I) {
+        if (TRI->regsOverlap(MO.getReg(), TrackedRegs[I])) {
+          Kills[I] = &MO;
+        }
+      }
+    }
+  }
+  for (MachineOperand &MO : MI.operands()) {
+    for (unsigned I = 0; I != NumTracked; ++I) {
+      if (MO.isRegMask() ? MO.clobbersPhysReg(TrackedRegs[I])
+                         : MO.isReg() && MO.getReg() && MO.isDef() &&
+                               TRI->regsOverlap(MO.getReg(), TrackedRegs[I])) {
+        Vals[I] = newValue();
+        Kills[I] = nullptr;
+        DeadDefs[I] = MO.isReg() && MO.isDead() ? &MO : nullptr;
+      }
+    }
+  }
+  for (auto &KV : Known) {
+    Vals[KV.first] = KV.second;
+  }
+}
+
+bool Z80KnownValues::optimizeLoad16(MachineInstr &MI) {
+  unsigned Reg = MI.getOperand(0).getReg();
+  if (!MI.getOperand(1).isImm() ||
+      (!Z80::GR16RegClass.contains(Reg) && !Z80::IR16RegClass.contains(Reg))) {
+    return false;
+  }
+  uint16_t Imm = MI.getOperand(1).getImm();
+  unsigned Halves[] = {
+    (unsigned)getTrackedIndex(TRI->getSubReg(Reg, Z80::sub_low)),
+    (unsigned)getTrackedIndex(TRI->getSubReg(Reg, Z80::sub_high))
+  };
+  unsigned Want[] = { Imm & 0xFFu, unsigned(Imm >> 8) };
+
+  // Loading a half costs nothing if it already holds its byte, a ld r, r' if
+  // another register does, or a ld r, n.  Either half may go first, the
+  // second can then be copied from the first.
+  Cost Best(Z80::IR16RegClass.contains(Reg) ? 4 : 3,
+            Z80::IR16RegClass.contains(Reg) ? 14 : 10);
+  int BestOrder = -1;
+  int BestSrc[2] = { -1, -1 };
+  for (unsigned Order = 0; Order != 2; ++Order) {
+    ValueArray Sim = Vals;
+    Cost Total;
+    int Src[2];
+    bool Possible = true;
+    for (unsigned Step = 0; Step != 2; ++Step) {
+      unsigned Half = Order ? 1 - Step : Step;
+      unsigned I = Halves[Half];
+      Src[Half] = -1;
+      if (Sim[I] != Want[Half]) {
+        // Index register halves are only reached with undocumented opcodes.
+        if (I >= NumSources) {
+          Possible = false;
+          break;
+        }
+        Src[Half] = findSource(Sim, Want[Half], TrackedRegs[I]);
+        Total += Src[Half] >= 0 ? Cost(1, 4) : Cost(2, 7);
+        Sim[I] = Want[Half];
+      }
+    }
+    if (Possible && Total.isBetter(Best, OptSize)) {
+      Best = Total;
+      BestOrder = Order;
+      BestSrc[0] = Src[0];
+      BestSrc[1] = Src[1];
+    }
+  }
+  if (BestOrder < 0) {
+    return false;
+  }
+
+  MachineBasicBlock &MBB = *MI.getParent();
+  LLVM_DEBUG(dbgs() << "Splitting "; MI.dump());
+  for (unsigned Step = 0; Step != 2; ++Step) {
+    unsigned Half = BestOrder ? 1 - Step : Step;
+    unsigned I = Halves[Half];
+    if (Vals[I] == Want[Half]) {
+      reuse(I);
+      continue;
+    }
+    MachineInstrBuilder MIB;
+    if (BestSrc[Half] >= 0) {
+      reuse(BestSrc[Half]);
+      MIB = BuildMI(MBB, MI, MI.getDebugLoc(), TII->get(Z80::LD8gg),
+                    TrackedRegs[I]).addReg(TrackedRegs[BestSrc[Half]]);
+    } else {
+      MIB = BuildMI(MBB, MI, MI.getDebugLoc(), TII->get(Z80::LD8ri),
+                    TrackedRegs[I]).addImm(Want[Half]);
+    }
+    LLVM_DEBUG(dbgs() << "     into "; MIB->dump());
+    update(*MIB);
+  }
+  MI.eraseFromParent();
+  if (Best.Bytes) {
+    ++NumSplit;
+  } else {
+    ++NumRemoved;
+  }
+  return true;
+}
+
+bool Z80KnownValues::optimizeBlock(MachineBasicBlock &MBB) {
+  // Nothing is known on entry.
+  NextValue = 256;
+  for (unsigned I = 0; I != NumTracked; ++I) {
+    Vals[I] = newValue();
+    Kills[I] = DeadDefs[I] = nullptr;
+  }
+
+  bool Changed = false;
+  for (auto I = MBB.begin(), E = MBB.end(); I != E;) {
+    MachineInstr &MI = *I++;
+    if (MI.isDebugInstr()) {
+      continue;
+    }
+    switch (MI.getOpcode()) {
+    case Z80::LD8gg: { // ld r, r' of the value r holds
+      int Dst = getTrackedIndex(MI.getOperand(0).getReg());
+      int Src = getTrackedIndex(MI.getOperand(1).getReg());
+      if (Dst >= 0 && Src >= 0 && Vals[Dst] == Vals[Src]) {
+        LLVM_DEBUG(dbgs() << "Removing "; MI.dump());
+        reuse(Dst);
+        MI.eraseFromParent();
+        ++NumRemoved;
+        Changed = true;
+        continue;
+      }
+      break;
+    }
+    case Z80::LD8ri: { // ld r, n -> ld r, r'
+      int Dst = getTrackedIndex(MI.getOperand(0).getReg());
+      if (Dst < 0 || !MI.getOperand(1).isImm()) {
+        break;
+      }
+      unsigned Val = MI.getOperand(1).getImm() & 0xFF;
+      if (Vals[Dst] == Val) {
+        LLVM_DEBUG(dbgs() << "Removing "; MI.dump());
+        reuse(Dst);
+        MI.eraseFromParent();
+        ++NumRemoved;
+        Changed = true;
+        continue;
+      }
+      int Src = findSource(Vals, Val, TrackedRegs[Dst]);
+      if (Src < 0 || unsigned(Dst) >= NumSources) {
+        break;
+      }
+      reuse(Src);
+      MachineInstr *CopyMI = BuildMI(MBB, MI, MI.getDebugLoc(),
+                                     TII->get(Z80::LD8gg), TrackedRegs[Dst])
+                             .addReg(TrackedRegs[Src]);
+      LLVM_DEBUG(dbgs() << "Replacing "; MI.dump(); dbgs() << "     with ";
+                 CopyMI->dump());
+      MI.eraseFromParent();
+      update(*CopyMI);
+      ++NumReused;
+      Changed = true;
+      continue;
+    }
+    case Z80::LD16ri:
+      if (optimizeLoad16(MI)) {
+        Changed = true;
+        continue;
+      }
+      break;
+    case Z80::LD8pi:   // ld (hl), n -> ld (hl), r'
+    case Z80::LD8oi: { // ld (ix+d), n -> ld (ix+d), r'
+      MachineOperand &SrcOp = MI.getOperand(MI.getNumExplicitOperands() - 1);
+      if (!SrcOp.isImm()) {
+        break;
+      }
+      int Src = findSource(Vals, SrcOp.getImm() & 0xFF, 0);
+      if (Src < 0) {
+        break;
+      }
+      LLVM_DEBUG(dbgs() << "Replacing "; MI.dump());
+      reuse(Src);
+      MI.setDesc(TII->get(MI.getOpcode() == Z80::LD8pi ? Z80::LD8pg
+                                                       : Z80::LD8og));
+      SrcOp.ChangeToRegister(TrackedRegs[Src], /*isDef*/false);
+      LLVM_DEBUG(dbgs() << "     with "; MI.dump());
+      ++NumReused;
+      Changed = true;
+      break;
+    }
+    }
+    update(MI);
+  }
+  return Changed;
+}
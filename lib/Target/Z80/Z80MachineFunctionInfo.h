@@ -45,6 +45,16 @@ class Z80MachineFunctionInfo : public MachineFunctionInfo {
   /// holds the virtual register into which the sret argument is passed.
   unsigned SRetReturnReg = 0;
 
+  /// SPRelativeFrame - The frame is addressed relative to SP instead of IX,
+  /// which is then free for allocation.  Decided at the end of instruction
+  /// selection, before the reserved registers are frozen.
+  bool SPRelativeFrame = false;
+
+  /// StaticFrame - The symbol of the static storage that holds the stack
+  /// objects of a non-reentrant function in place of its stack frame, or null
+  /// if they are on the stack.  See Z80StaticLocals.cpp.
+  const char *StaticFrame = nullptr;
+
 public:
   Z80MachineFunctionInfo() = default;
 
@@ -67,6 +77,12 @@ public:
 
   unsigned getBytesToPopOnReturn() const { return BytesToPopOnReturn; }
   void setBytesToPopOnReturn(unsigned bytes) { BytesToPopOnReturn = bytes;}
+
+  bool usesSPRelativeFrame() const { return SPRelativeFrame; }
+  void setUsesSPRelativeFrame(bool Value) { SPRelativeFrame = Value; }
+
+  const char *getStaticFrame() const { return StaticFrame; }
+  void setStaticFrame(const char *Symbol) { StaticFrame = Symbol; }
 };
 
 } // End llvm namespace
@@ -10,10 +10,23 @@
 // This file defines a pass that optimizes machine instructions after register
 // selection.
 //
+// Each block is walked forwards, keeping track of which flags are known to be
+// set or reset, and with the liveness of the flags computed beforehand.  This
+// allows:
+//   ld a, 0            -> xor a              when the flags are dead
+//   ld hl, 0 / -1      -> sbc hl, hl         when the carry is known to be
+//                                            reset / set, optimizing for size
+//   push rr / pop hl   -> ld l, r' / ld h, r or ex de, hl
+//   or a / scf / ccf   -> nothing            when the flags are dead, or
+//                                            already have the value they set
+//
 //===----------------------------------------------------------------------===//
 
 #include "Z80.h"
 #include "Z80RegisterInfo.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
 #include "llvm/CodeGen/MachineFunctionPass.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
 #include "llvm/CodeGen/MachineRegisterInfo.h"
@@ -23,179 +36,312 @@ using namespace llvm;
 
 #define DEBUG_TYPE "z80-ml-opt"
 
+STATISTIC(NumXorA, "Number of ld a, 0 turned into xor a");
+STATISTIC(NumSbcHL, "Number of ld hl, 0/-1 turned into sbc hl, hl");
+STATISTIC(NumPushPop, "Number of push/pop pairs turned into moves");
+STATISTIC(NumFlagOps, "Number of redundant flag operations removed");
+
 namespace {
+/// Bits of f.
+enum Flag : uint8_t {
+  Carry = 1 << 0,
+  Subtract = 1 << 1,
+  ParityOverflow = 1 << 2,
+  HalfCarry = 1 << 4,
+  Zero = 1 << 6,
+  Sign = 1 << 7
+};
+
+/// The flags known to be reset and set at some point of a block.
+struct KnownFlags {
+  uint8_t KnownZero = 0, KnownOne = 0;
+
+  void clear() { KnownZero = KnownOne = 0; }
+  void forget(uint8_t Mask) {
+    KnownZero &= ~Mask;
+    KnownOne &= ~Mask;
+  }
+  void set(uint8_t Mask, bool Val) {
+    forget(Mask);
+    (Val ? KnownOne : KnownZero) |= Mask;
+  }
+  bool isKnown(uint8_t Mask) const {
+    return ((KnownZero | KnownOne) & Mask) == Mask;
+  }
+  bool isZero(uint8_t Mask) const { return (KnownZero & Mask) == Mask; }
+  bool isOne(uint8_t Mask) const { return (KnownOne & Mask) == Mask; }
+};
+
 class Z80MachineLateOptimization : public MachineFunctionPass {
 public:
   Z80MachineLateOptimization() : MachineFunctionPass(ID) {}
-protected:
+
   bool runOnMachineFunction(MachineFunction &MF) override;
 
   MachineFunctionProperties getRequiredProperties() const override {
     return MachineFunctionProperties()
+           .set(MachineFunctionProperties::Property::NoVRegs)
            .set(MachineFunctionProperties::Property::TracksLiveness);
   }
 
+  StringRef getPassName() const override {
+    return "Z80 Machine Late Optimization";
+  }
+
 private:
-//  void computeKnownFlags(MachineInstr &MI, APInt &KnownZero,
-//                         APInt &KnownOne) const;
-//
-//  StringRef getPassName() const override {
-//    return "Z80 Machine Late Optimization";
-//  }
-//
-//  static const uint8_t Carry, Subtract, ParityOverflow, HalfCarry, Zero, Sign;
+  bool optimizeBlock(MachineBasicBlock &MBB);
+  void computeKnownFlags(const MachineInstr &MI, KnownFlags &Known) const;
+  /// The flags set by the last definition are read after all, by something
+  /// that relied on their known value.
+  void useFlags(MachineInstr *FlagsDef) const;
+
+  const TargetInstrInfo *TII;
+  const TargetRegisterInfo *TRI;
+  bool OptSize;
   static char ID;
 };
 
-//const uint8_t Z80MachineLateOptimization::Carry = 1 << 0;
-//const uint8_t Z80MachineLateOptimization::Subtract = 1 << 0;
-//const uint8_t Z80MachineLateOptimization::ParityOverflow = 1 << 0;
-//const uint8_t Z80MachineLateOptimization::HalfCarry = 1 << 0;
-//const uint8_t Z80MachineLateOptimization::Zero = 1 << 0;
-//const uint8_t Z80MachineLateOptimization::Sign = 1 << 0;
-//
-//char Z80MachineLateOptimization::ID = 0;
+char Z80MachineLateOptimization::ID = 0;
 } // end anonymous namespace
-//
+
 FunctionPass *llvm::createZ80MachineLateOptimization() {
   return new Z80MachineLateOptimization();
 }
-//
+
 bool Z80MachineLateOptimization::runOnMachineFunction(MachineFunction &MF) {
-//  const TargetSubtargetInfo &STI = MF.getSubtarget();
-//  assert(MF.getRegInfo().tracksLiveness() && "Liveness not being tracked!");
-//  const TargetInstrInfo *TII = STI.getInstrInfo();
+  if (skipFunction(MF.getFunction())) {
+    return false;
+  }
+  assert(MF.getRegInfo().tracksLiveness() && "Liveness not being tracked!");
+  TII = MF.getSubtarget().getInstrInfo();
+  TRI = MF.getSubtarget().getRegisterInfo();
+  OptSize = MF.getFunction().optForSize();
   bool Changed = false;
-//  if (!MF.getRegInfo().isPhysRegModified(Z80::F)) {
-//    return Changed;
-//  }
-//  //bool OptSize = MF.getFunction().getAttributes()
-//  //  .hasAttribute(AttributeList::FunctionIndex, Attribute::OptimizeForSize);
-//  APInt FlagsZero(8, 0), FlagsOne(8, 0);
-//  for (auto &MBB : MF) {
-//    bool UnusedFlags = true;
-//    for (MachineBasicBlock *Successor : MBB.successors())
-//      if (Successor->isLiveIn(Z80::F)) {
-//        UnusedFlags = false;
-//      }
-//    for (auto I = MBB.rbegin(), E = MBB.rend(); I != E; ++I) {
-//      if (UnusedFlags)
-//        switch (I->getOpcode()) {
-//        case Z80::LD8ri: // ld a, 0 -> xor a, a
-//          if (I->getOperand(0).getReg() == Z80::A &&
-//              I->getOperand(1).getImm() == 0) {
-//            I->setDesc(TII->get(Z80::XOR8ar));
-//            I->RemoveOperand(1);
-//            I->getOperand(0).setIsUse();
-//            I->addImplicitDefUseOperands(MF);
-//            for (auto &Op : I->uses()) {
-//              Op.setIsUndef();
-//            }
-//            FlagsZero = HalfCarry | Subtract | Carry;
-//            FlagsOne = 0;
-//            LLVM_DEBUG(dbgs() << '!');
-//            Changed = true;
-//          }
-//          break;
-//#if 0
-//        case Z80::LD24ri: // ld hl, -1/0 -> set-cf \ sbc hl, hl
-//          if (I->getOperand(0).getReg() == Z80::UHL &&
-//              I->getOperand(1).isImm()) {
-//            int Imm = I->getOperand(1).getImm();
-//            if (Imm == 0 || Imm == -1) {
-//              while (I->getNumOperands()) {
-//                I->RemoveOperand(0);
-//              }
-//              I->setDesc(TII->get(Z80::SBC24aa));
-//              I->addImplicitDefUseOperands(MF);
-//              for (auto &Op : I->uses()) {
-//                Op.setIsUndef();
-//              }
-//              MachineInstrBuilder MIB =
-//                BuildMI(MBB, I.getReverse(), I->getDebugLoc(),
-//                        TII->get(Imm ? Z80::SCF : Z80::OR8ar));
-//              if (!Imm) {
-//                MIB.addReg(Z80::A);
-//              }
-//              I = *MIB;
-//              for (auto &Op : I->uses()) {
-//                Op.setIsUndef();
-//              }
-//              FlagsZero = (Imm & (Sign | HalfCarry | Carry)) | (~Imm & Zero) |
-//                          ParityOverflow;
-//              FlagsOne = (~Imm & (Sign | HalfCarry | Carry)) | (Imm & Zero) |
-//                         Subtract;
-//              LLVM_DEBUG(dbgs() << '!');
-//              Changed = true;
-//            }
-//          }
-//          break;
-//        case Z80::POP24r: // push reg \ pop hl -> rcf \ sbc hl,hl \ add hl,reg
-//          if (!OptSize && I->getOperand(0).getReg() == Z80::UHL) {
-//            auto P = std::next(I);
-//            if (P != E && P->getOpcode() == Z80::PUSH24r &&
-//                Z80::O24RegClass.contains(P->getOperand(0).getReg())) {
-//              while (I->getNumOperands() != I->getNumExplicitOperands()) {
-//                I->RemoveOperand(I->getNumExplicitOperands());
-//              }
-//              I->setDesc(TII->get(Z80::ADD24ao));
-//              I->addOperand(MachineOperand::CreateReg(Z80::UHL,
-//                                                      /*isDef*/false));
-//              I->addOperand(P->getOperand(0));
-//              I->addImplicitDefUseOperands(MF);
-//              I->findRegisterDefOperand(Z80::F)->setIsDead();
-//              while (P->getNumOperands()) {
-//                P->RemoveOperand(0);
-//              }
-//              P->setDesc(TII->get(Z80::SBC24aa));
-//              P->addImplicitDefUseOperands(MF);
-//              for (auto &Op : P->uses()) {
-//                Op.setIsUndef();
-//              }
-//              I = *BuildMI(MBB, P.getReverse(), P->getDebugLoc(),
-//                           TII->get(Z80::OR8ar)).addReg(Z80::A);
-//              for (auto &Op : I->uses()) {
-//                Op.setIsUndef();
-//              }
-//              FlagsZero = Sign | ParityOverflow | Subtract | Carry;
-//              FlagsOne = Zero;
-//              LLVM_DEBUG(dbgs() << '!');
-//              Changed = true;
-//            }
-//          }
-//          break;
-//#endif // 0
-//        default:
-//          computeKnownFlags(*I, FlagsZero, FlagsOne);
-//          break;
-//        }
-//      UnusedFlags |= I->definesRegister(Z80::F);
-//      if (MachineOperand *FlagsUse = I->findRegisterUseOperand(Z80::F)) {
-//        UnusedFlags &= FlagsUse->isUndef();
-//      }
-//      LLVM_DEBUG(dbgs() << (UnusedFlags ? "unused" : "used") << '\t'; I->dump());
-//    }
-//    LLVM_DEBUG(dbgs() << '\n');
-//  }
+  for (auto &MBB : MF) {
+    Changed |= optimizeBlock(MBB);
+  }
   return Changed;
 }
-//
-//void Z80MachineLateOptimization::
-//computeKnownFlags(MachineInstr &MI, APInt &KnownZero, APInt &KnownOne) const {
-//  switch (MI.getOpcode()) {
-//  default:
-//    if (MI.definesRegister(Z80::F)) {
-//      KnownZero = KnownOne = 0;
-//      LLVM_DEBUG(dbgs() << '?');
-//    }
-//    break;
-//  case Z80::RCF:
-//    KnownZero = HalfCarry | Subtract | Carry;
-//    KnownOne = 0;
-//    break;
-//  case Z80::SCF:
-//    KnownZero = HalfCarry | Subtract;
-//    KnownOne = Carry;
-//    break;
-//  }
-//}
+
+void Z80MachineLateOptimization::useFlags(MachineInstr *FlagsDef) const {
+  assert(FlagsDef && "Known flags without a definition");
+  for (MachineOperand &MO : FlagsDef->operands()) {
+    if (MO.isReg() && MO.isDef() && MO.isDead() &&
+        TRI->regsOverlap(MO.getReg(), Z80::F)) {
+      MO.setIsDead(false);
+    }
+  }
+}
+
+bool Z80MachineLateOptimization::optimizeBlock(MachineBasicBlock &MBB) {
+  // The instructions after which nothing reads the flags.
+  SmallPtrSet<MachineInstr *, 32> FlagsDead;
+  LivePhysRegs LiveRegs(*TRI);
+  LiveRegs.addLiveOuts(MBB);
+  for (MachineInstr &MI : make_range(MBB.rbegin(), MBB.rend())) {
+    if (!LiveRegs.contains(Z80::F)) {
+      FlagsDead.insert(&MI);
+    }
+    LiveRegs.stepBackward(MI);
+  }
+
+  bool Changed = false;
+  KnownFlags Known;
+  MachineInstr *FlagsDef = nullptr;
+  for (auto I = MBB.begin(), E = MBB.end(); I != E;) {
+    MachineInstr *MI = &*I++;
+    if (MI->isDebugInstr()) {
+      continue;
+    }
+    bool Dead = FlagsDead.count(MI);
+    DebugLoc DL = MI->getDebugLoc();
+
+    switch (MI->getOpcode()) {
+    case Z80::LD8ri: // ld a, 0 -> xor a
+      if (Dead && MI->getOperand(0).getReg() == Z80::A &&
+          MI->getOperand(1).isImm() &&
+          (MI->getOperand(1).getImm() & 0xFF) == 0) {
+        MachineInstr *XorMI = BuildMI(MBB, MI, DL, TII->get(Z80::XOR8ar))
+                              .addReg(Z80::A, RegState::Undef);
+        for (MachineOperand &MO : XorMI->operands()) {
+          if (MO.isReg() && MO.isUse()) {
+            MO.setIsUndef();
+          }
+        }
+        XorMI->findRegisterDefOperand(Z80::F)->setIsDead();
+        LLVM_DEBUG(dbgs() << "Replacing "; MI->dump(); dbgs() << "     with ";
+                   XorMI->dump());
+        MI->eraseFromParent();
+        MI = XorMI;
+        ++NumXorA;
+        Changed = true;
+      }
+      break;
+    case Z80::LD16ri: { // ld hl, 0/-1 -> sbc hl, hl
+      if (!OptSize || !Dead || MI->getOperand(0).getReg() != Z80::HL ||
+          !MI->getOperand(1).isImm() || !Known.isKnown(Carry)) {
+        break;
+      }
+      uint16_t Imm = MI->getOperand(1).getImm();
+      bool CarrySet = Known.isOne(Carry);
+      if (Imm != (CarrySet ? 0xFFFF : 0)) {
+        break;
+      }
+      MachineInstr *SbcMI = BuildMI(MBB, MI, DL, TII->get(Z80::SBC16aa));
+      SbcMI->findRegisterUseOperand(Z80::HL)->setIsUndef();
+      SbcMI->findRegisterDefOperand(Z80::F)->setIsDead();
+      useFlags(FlagsDef);
+      LLVM_DEBUG(dbgs() << "Replacing "; MI->dump(); dbgs() << "     with ";
+                 SbcMI->dump());
+      MI->eraseFromParent();
+      MI = SbcMI;
+      ++NumSbcHL;
+      Changed = true;
+      break;
+    }
+    case Z80::PUSH16r: { // push rr / pop rr' -> ld / ld or ex de, hl
+      auto Pop = skipDebugInstructionsForward(I, E);
+      if (Pop == E || Pop->getOpcode() != Z80::POP16r) {
+        break;
+      }
+      const MachineOperand &Src = MI->getOperand(0);
+      unsigned DstReg = Pop->getOperand(0).getReg();
+      if (!Z80::GR16RegClass.contains(Src.getReg()) ||
+          !Z80::GR16RegClass.contains(DstReg)) {
+        break;
+      }
+      LLVM_DEBUG(dbgs() << "Replacing "; MI->dump(); dbgs() << "     and  ";
+                 Pop->dump());
+      TII->copyPhysReg(MBB, Pop, DL, DstReg, Src.getReg(), Src.isKill());
+      I = std::next(Pop);
+      Pop->eraseFromParent();
+      MI->eraseFromParent();
+      ++NumPushPop;
+      Changed = true;
+      continue;
+    }
+    case Z80::OR8ar:
+    case Z80::AND8ar:
+    case Z80::SCF:
+    case Z80::CCF: {
+      bool Redundant = Dead;
+      if (MI->getOpcode() == Z80::SCF) {
+        // scf also resets h and n.
+        Redundant |= Known.isOne(Carry) && Known.isZero(HalfCarry | Subtract);
+      } else if (MI->getOpcode() == Z80::OR8ar &&
+                 MI->getOperand(0).isUndef()) {
+        // An or a of an undefined a, the expansion of rcf, is only there to
+        // reset the carry; s, z and p/v come out undefined.
+        Redundant |= Known.isZero(Carry | HalfCarry | Subtract);
+      } else if (MI->getOpcode() != Z80::CCF &&
+                 MI->getOperand(0).getReg() != Z80::A) {
+        // Only or a, a and and a, a leave a untouched.
+        Redundant = false;
+      }
+      if (!Redundant) {
+        break;
+      }
+      if (!Dead) {
+        useFlags(FlagsDef);
+      }
+      LLVM_DEBUG(dbgs() << "Removing "; MI->dump());
+      MI->eraseFromParent();
+      ++NumFlagOps;
+      Changed = true;
+      continue;
+    }
+    }
+
+    bool KillsFlags = MI->killsRegister(Z80::F, TRI);
+    computeKnownFlags(*MI, Known);
+    if (MI->isInlineAsm() || MI->modifiesRegister(Z80::F, TRI)) {
+      FlagsDef = MI;
+    } else if (KillsFlags) {
+      // The flags still hold their value, but may no longer be read.
+      Known.clear();
+    }
+  }
+  return Changed;
+}
+
+void Z80MachineLateOptimization::
+computeKnownFlags(const MachineInstr &MI, KnownFlags &Known) const {
+  switch (MI.getOpcode()) {
+  default:
+    if (MI.isInlineAsm() || MI.modifiesRegister(Z80::F, TRI)) {
+      Known.clear();
+    }
+    break;
+  case Z80::SCF:
+    Known.set(Carry, true);
+    Known.set(HalfCarry | Subtract, false);
+    break;
+  case Z80::CCF:
+    if (Known.isKnown(Carry)) {
+      bool CarrySet = Known.isOne(Carry);
+      Known.set(Carry, !CarrySet);
+      Known.set(HalfCarry, CarrySet);
+    } else {
+      Known.forget(Carry | HalfCarry);
+    }
+    Known.set(Subtract, false);
+    break;
+  case Z80::AND8ar:
+  case Z80::AND8ai:
+  case Z80::AND8ap:
+  case Z80::AND8ao:
+    Known.forget(Sign | Zero | ParityOverflow);
+    Known.set(Carry | Subtract, false);
+    Known.set(HalfCarry, true);
+    break;
+  case Z80::XOR8ar:
+    if (MI.getOperand(0).getReg() == Z80::A) {
+      // xor a clears a, whatever it held.
+      Known.set(Carry | Subtract | HalfCarry | Sign, false);
+      Known.set(Zero | ParityOverflow, true);
+      break;
+    }
+    LLVM_FALLTHROUGH;
+  case Z80::XOR8ai:
+  case Z80::XOR8ap:
+  case Z80::XOR8ao:
+  case Z80::OR8ar:
+  case Z80::OR8ai:
+  case Z80::OR8ap:
+  case Z80::OR8ao:
+    Known.forget(Sign | Zero | ParityOverflow);
+    Known.set(Carry | Subtract | HalfCarry, false);
+    break;
+  case Z80::SBC16aa:
+    // hl - hl - c is 0 or -1.
+    if (Known.isKnown(Carry)) {
+      bool CarrySet = Known.isOne(Carry);
+      Known.set(Sign | HalfCarry | Carry, CarrySet);
+      Known.set(Zero, !CarrySet);
+      Known.set(ParityOverflow, false);
+    } else {
+      Known.clear();
+    }
+    Known.set(Subtract, true);
+    break;
+  case Z80::ADD16aa:
+  case Z80::ADD16ao:
+  case Z80::ADD16SP:
+    // A 16-bit add leaves s, z and p/v alone.
+    Known.forget(Carry | HalfCarry);
+    Known.set(Subtract, false);
+    break;
+  case Z80::INC8r:
+  case Z80::INC8p:
+  case Z80::INC8o:
+  case Z80::DEC8r:
+  case Z80::DEC8p:
+  case Z80::DEC8o:
+    // An 8-bit increment or decrement leaves the carry alone.
+    Known.forget(Sign | Zero | ParityOverflow | HalfCarry);
+    Known.set(Subtract, MI.getOpcode() == Z80::DEC8r ||
+                        MI.getOpcode() == Z80::DEC8p ||
+                        MI.getOpcode() == Z80::DEC8o);
+    break;
+  }
+}
@@ -13,6 +13,7 @@
 
 #include "Z80RegisterInfo.h"
 #include "Z80FrameLowering.h"
+#include "Z80MachineFunctionInfo.h"
 #include "Z80Subtarget.h"
 #include "MCTargetDesc/Z80MCTargetDesc.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
@@ -33,49 +34,48 @@ Z80RegisterInfo::Z80RegisterInfo(const Triple &TT)
   // Cache some information
 }
 
-//const TargetRegisterClass *
-//Z80RegisterInfo::getPointerRegClass(const MachineFunction &MF,
-//                                    unsigned Kind) const {
-//  //const Z80Subtarget& Subtarget = MF.getSubtarget<Z80Subtarget>();
-//  switch (Kind) {
-//  default: llvm_unreachable("Unexpected Kind in getPointerRegClass!");
-//  case 0: return &Z80::GR16RegClass;
-//  case 1: return &Z80::AIR16RegClass;
-//  case 2: return &Z80::IR16RegClass;
-//  }
-//}
-//
-//const TargetRegisterClass *
-//Z80RegisterInfo::getLargestLegalSuperClass(const TargetRegisterClass *RC,
-//                                           const MachineFunction &) const {
-//  const TargetRegisterClass *Super = RC;
-//  TargetRegisterClass::sc_iterator I = RC->getSuperClasses();
-//  do {
-//    switch (Super->getID()) {
-//    case Z80::RR8RegClassID:
-//    case Z80::R16RegClassID:
-//      //case Z80::R24RegClassID:
-//      return Super;
-//    }
-//    Super = *I++;
-//  } while (Super);
-//  return RC;
-//}
-//
-//unsigned Z80RegisterInfo::getRegPressureLimit(const TargetRegisterClass *RC,
-//                                              MachineFunction &MF) const {
-//  return 3;
-//  const Z80FrameLowering *TFI = getFrameLowering(MF);
-//
-//  switch (RC->getID()) {
-//  default:
-//    return 0;
-//  case Z80::R16RegClassID:
-//    //case Z80::R24RegClassID:
-//    return 2;
-//  }
-//}
-//
+const TargetRegisterClass *
+Z80RegisterInfo::getPointerRegClass(const MachineFunction &MF,
+                                    unsigned Kind) const {
+  //const Z80Subtarget& Subtarget = MF.getSubtarget<Z80Subtarget>();
+  switch (Kind) {
+  default: llvm_unreachable("Unexpected Kind in getPointerRegClass!");
+  case 0: return &Z80::GR16RegClass;
+  case 1: return &Z80::AIR16RegClass;
+  case 2: return &Z80::IR16RegClass;
+  }
+}
+
+const TargetRegisterClass *
+Z80RegisterInfo::getLargestLegalSuperClass(const TargetRegisterClass *RC,
+                                           const MachineFunction &) const {
+  const TargetRegisterClass *Super = RC;
+  TargetRegisterClass::sc_iterator I = RC->getSuperClasses();
+  do {
+    switch (Super->getID()) {
+    case Z80::RR8RegClassID:
+    case Z80::R16RegClassID:
+      //case Z80::R24RegClassID:
+      return Super;
+    }
+    Super = *I++;
+  } while (Super);
+  return RC;
+}
+
+unsigned Z80RegisterInfo::getRegPressureLimit(const TargetRegisterClass *RC,
+                                              MachineFunction &MF) const {
+  return 3;
+
+  switch (RC->getID()) {
+  default:
+    return 0;
+  case Z80::R16RegClassID:
+    //case Z80::R24RegClassID:
+    return 2;
+  }
+}
+
 const MCPhysReg *
 Z80RegisterInfo::getCalleeSavedRegs(const MachineFunction *MF) const {
   switch (MF->getFunction().getCallingConv()) {
@@ -84,36 +84,36 @@ Z80RegisterInfo::getCalleeSavedRegs(const MachineFunction *MF) const {
   case CallingConv::Fast:
     return /*Is24Bit ? CSR_EZ80_C_SaveList :*/ CSR_Z80_C_SaveList;
   case CallingConv::PreserveAll:
-//  case CallingConv::Z80_LibCall:
-//  case CallingConv::Z80_LibCall_AC:
-//  case CallingConv::Z80_LibCall_BC:
-//  case CallingConv::Z80_LibCall_C:
-//  case CallingConv::Z80_LibCall_L:
+  case CallingConv::Z80_LibCall:
+  case CallingConv::Z80_LibCall_AC:
+  case CallingConv::Z80_LibCall_BC:
+  case CallingConv::Z80_LibCall_C:
+  case CallingConv::Z80_LibCall_L:
     return /*Is24Bit ? CSR_EZ80_AllRegs_SaveList :*/ CSR_Z80_AllRegs_SaveList;
   }
 }
-//
-//const uint32_t *
-//Z80RegisterInfo::getCallPreservedMask(const MachineFunction &MF,
-//                                      CallingConv::ID CC) const {
-//  switch (CC) {
-//  default: llvm_unreachable("Unsupported calling convention");
-//  case CallingConv::C:
-//  case CallingConv::Fast:
-//    return /*Is24Bit ? CSR_EZ80_C_RegMask :*/ CSR_Z80_C_RegMask;
-//  case CallingConv::PreserveAll:
-//  case CallingConv::Z80_LibCall:
-//  case CallingConv::Z80_LibCall_AC:
-//  case CallingConv::Z80_LibCall_BC:
-//  case CallingConv::Z80_LibCall_C:
-//  case CallingConv::Z80_LibCall_L:
-//    return /*Is24Bit ? CSR_EZ80_AllRegs_RegMask :*/ CSR_Z80_AllRegs_RegMask;
-//  }
-//}
-//const uint32_t *Z80RegisterInfo::getNoPreservedMask() const {
-//  return CSR_NoRegs_RegMask;
-//}
-//
+
+const uint32_t *
+Z80RegisterInfo::getCallPreservedMask(const MachineFunction &MF,
+                                      CallingConv::ID CC) const {
+  switch (CC) {
+  default: llvm_unreachable("Unsupported calling convention");
+  case CallingConv::C:
+  case CallingConv::Fast:
+    return /*Is24Bit ? CSR_EZ80_C_RegMask :*/ CSR_Z80_C_RegMask;
+  case CallingConv::PreserveAll:
+  case CallingConv::Z80_LibCall:
+  case CallingConv::Z80_LibCall_AC:
+  case CallingConv::Z80_LibCall_BC:
+  case CallingConv::Z80_LibCall_C:
+  case CallingConv::Z80_LibCall_L:
+    return /*Is24Bit ? CSR_EZ80_AllRegs_RegMask :*/ CSR_Z80_AllRegs_RegMask;
+  }
+}
+const uint32_t *Z80RegisterInfo::getNoPreservedMask() const {
+  return CSR_NoRegs_RegMask;
+}
+
 BitVector Z80RegisterInfo::getReservedRegs(const MachineFunction &MF) const {
   BitVector Reserved(getNumRegs());
   const Z80FrameLowering *TFI = getFrameLowering(MF);
@@ -125,7 +125,7 @@ BitVector Z80RegisterInfo::getReservedRegs(const MachineFunction &MF) const {
   Reserved.set(Z80::PC);
 
   // Set the frame-pointer register and its aliases as reserved if needed.
-  if (TFI->hasFP(MF)) {
+  if (TFI->reservesFP(MF)) {
     for (MCSubRegIterator I(Z80::IX, this, /*IncludesSelf=*/true); I.isValid();
          ++I) {
       Reserved.set(*I);
@@ -134,218 +134,403 @@ BitVector Z80RegisterInfo::getReservedRegs(const MachineFunction &MF) const {
 
   return Reserved;
 }
-//
-//bool Z80RegisterInfo::saveScavengerRegister(MachineBasicBlock &MBB,
-//                                            MachineBasicBlock::iterator MI,
-//                                            MachineBasicBlock::iterator &UseMI,
-//                                            const TargetRegisterClass *RC,
-//                                            unsigned Reg) const {
-//  return false;
-//  const Z80Subtarget &STI = MBB.getParent()->getSubtarget<Z80Subtarget>();
-//  const TargetInstrInfo &TII = *STI.getInstrInfo();
-//  const TargetRegisterInfo *TRI = STI.getRegisterInfo();
-//  DebugLoc DL;
-//  if (Reg == Z80::AF) {
-//    BuildMI(MBB, MI, DL, TII.get(Z80::PUSH16AF));
-//  } else
-//    BuildMI(MBB, MI, DL, TII.get(Z80::PUSH16r))
-//    .addReg(Reg);
-//  for (MachineBasicBlock::iterator II = MI; II != UseMI ; ++II) {
-//    if (II->isDebugValue()) {
-//      continue;
-//    }
-//    if (II->modifiesRegister(Reg, TRI)) {
-//      UseMI = II;
-//    }
-//  }
-//  if (Reg == Z80::AF) {
-//    BuildMI(MBB, UseMI, DL, TII.get(Z80::POP16AF));
-//  } else {
-//    BuildMI(MBB, UseMI, DL, TII.get(Z80::POP16r), Reg);
-//  }
-//  return true;
-//}
-//
+
+bool Z80RegisterInfo::saveScavengerRegister(MachineBasicBlock &MBB,
+                                            MachineBasicBlock::iterator MI,
+                                            MachineBasicBlock::iterator &UseMI,
+                                            const TargetRegisterClass *RC,
+                                            unsigned Reg) const {
+  return false;
+  const Z80Subtarget &STI = MBB.getParent()->getSubtarget<Z80Subtarget>();
+  const TargetInstrInfo &TII = *STI.getInstrInfo();
+  const TargetRegisterInfo *TRI = STI.getRegisterInfo();
+  DebugLoc DL;
+  if (Reg == Z80::AF) {
+    BuildMI(MBB, MI, DL, TII.get(Z80::PUSH16AF));
+  } else
+    BuildMI(MBB, MI, DL, TII.get(Z80::PUSH16r))
+    .addReg(Reg);
+  for (MachineBasicBlock::iterator II = MI; II != UseMI ; ++II) {
+    if (II->isDebugValue()) {
+      continue;
+    }
+    if (II->modifiesRegister(Reg, TRI)) {
+      UseMI = II;
+    }
+  }
+  if (Reg == Z80::AF) {
+    BuildMI(MBB, UseMI, DL, TII.get(Z80::POP16AF));
+  } else {
+    BuildMI(MBB, UseMI, DL, TII.get(Z80::POP16r), Reg);
+  }
+  return true;
+}
+
 void Z80RegisterInfo::eliminateFrameIndex(MachineBasicBlock::iterator II,
                                           int SPAdj, unsigned FIOperandNum,
                                           RegScavenger *RS) const {
-//  MachineInstr &MI = *II;
-//  unsigned Opc = MI.getOpcode();
-//  MachineBasicBlock &MBB = *MI.getParent();
-//  MachineFunction &MF = *MBB.getParent();
-//  MachineRegisterInfo &MRI = MF.getRegInfo();
-//  const Z80Subtarget &STI = MF.getSubtarget<Z80Subtarget>();
-//  const Z80InstrInfo &TII = *STI.getInstrInfo();
-//  const Z80FrameLowering *TFI = getFrameLowering(MF);
-//  DebugLoc DL = MI.getDebugLoc();
-//  int FrameIndex = MI.getOperand(FIOperandNum).getIndex();
-//
-//  unsigned BasePtr = getFrameRegister(MF);
-//  LLVM_DEBUG(MF.dump(); II->dump();
-//             dbgs() << MF.getFunction().arg_size() << '\n');
-//  assert(TFI->hasFP(MF) && "Stack slot use without fp unimplemented");
-//  int Offset = MF.getFrameInfo().getObjectOffset(FrameIndex);
-//  int SlotSize = /*Is24Bit ? 3 :*/ 2;
-//  // Skip any saved callee saved registers
-//  if (TFI->hasFP(MF)) {
-//    Offset += SlotSize;
-//  }
-//  // Skip return address for arguments
-//  if (FrameIndex < 0) {
-//    Offset += SlotSize;
-//  }
-//  Offset += MI.getOperand(FIOperandNum + 1).getImm();
-//  if (isInt<8>(Offset) && Opc != Z80::LD16rfi) {
-//    MI.getOperand(FIOperandNum).ChangeToRegister(BasePtr, false);
-//    MI.getOperand(FIOperandNum + 1).ChangeToImmediate(Offset);
-//    return;
-//  }
-//  unsigned OffsetReg = RS->scavengeRegister(
-//                         &Z80::OR16RegClass, II, SPAdj);
-//#if 0
-//  if ((Opc == Z80::LEA24ro &&
-//       Z80::A24RegClass.contains(MI.getOperand(0).getReg())) ||
-//      ((Opc == Z80::LEA16ro || Opc == Z80::LD16rfi) &&
-//       Z80::AIR16RegClass.contains(MI.getOperand(0).getReg()))) {
-//    BuildMI(MBB, II, DL, TII.get(Is24Bit ? Z80::LD24ri : Z80::LD16ri),
-//            OffsetReg).addImm(Offset);
-//    MI.getOperand(FIOperandNum).ChangeToRegister(BasePtr, false);
-//    if (Opc == Z80::LD16rfi) {
-//      MI.setDesc(TII.get(TargetOpcode::COPY));
-//      MI.RemoveOperand(FIOperandNum + 1);
-//    } else {
-//      MI.getOperand(FIOperandNum + 1).ChangeToImmediate(0);
-//    }
-//    BuildMI(MBB, ++II, DL, TII.get(Is24Bit ? Z80::ADD24ao : Z80::ADD16ao),
-//            MI.getOperand(0).getReg()).addReg(MI.getOperand(0).getReg())
-//    .addReg(OffsetReg, RegState::Kill);
-//    return;
-//  }
-//#endif // 0
-//  if (unsigned ScratchReg = RS->FindUnusedReg(&Z80::AIR16RegClass)) {
-//    BuildMI(MBB, II, DL, TII.get(Z80::LD16ri),
-//            OffsetReg).addImm(Offset);
-//    BuildMI(MBB, II, DL, TII.get(TargetOpcode::COPY), ScratchReg)
-//    .addReg(BasePtr);
-//    BuildMI(MBB, II, DL, TII.get(Z80::ADD16ao),
-//            ScratchReg).addReg(ScratchReg).addReg(OffsetReg, RegState::Kill);
-//    MI.getOperand(FIOperandNum).ChangeToRegister(ScratchReg, false);
-//    if ((Z80::IR16RegClass).contains(ScratchReg)) {
-//      MI.getOperand(FIOperandNum + 1).ChangeToImmediate(0);
-//    } else {
-//      switch (Opc) {
-//      default: llvm_unreachable("Unexpected opcode!");
-//      //case Z80::LD24ro: Opc = Z80::LD24rp; break;
-//      //case Z80::LD16ro: Opc = Z80::LD16rp; break;
-//      case Z80::LD8ro: Opc = Z80::LD8rp; break;
-//      case Z80::LD8go: Opc = Z80::LD8gp; break;
-//      //case Z80::LD24or: Opc = Z80::LD24pr; break;
-//      //case Z80::LD16or: Opc = Z80::LD16pr; break;
-//      case Z80::LD8or: Opc = Z80::LD8pr; break;
-//      case Z80::LD8og: Opc = Z80::LD8pg; break;
-//      //case Z80::LEA24ro: case Z80::LEA16ro:
-//      case Z80::LD16rfi: Opc = TargetOpcode::COPY; break;
-//        //case Z80::PEA24o: Opc = Z80::PUSH24r; break;
-//        //case Z80::PEA16o: Opc = Z80::PUSH16r; break;
-//      }
-//      MI.setDesc(TII.get(Opc));
-//      MI.RemoveOperand(FIOperandNum + 1);
-//    }
-//    return;
-//  }
-//  BuildMI(MBB, II, DL, TII.get(Z80::PUSH16r))
-//  .addReg(BasePtr);
-//  BuildMI(MBB, II, DL, TII.get(Z80::LD16ri), OffsetReg)
-//  .addImm(Offset);
-//  BuildMI(MBB, II, DL, TII.get(Z80::ADD16ao), BasePtr)
-//  .addReg(BasePtr).addReg(OffsetReg, RegState::Kill);
-//#if 0
-//  if (Opc == Z80::PEA24o || Opc == Z80::PEA16o) {
-//    MI.setDesc(TII.get(Opc == Z80::PEA24o ? Z80::EX24SP : Z80::EX16SP));
-//    MI.getOperand(0).ChangeToRegister(BasePtr, true);
-//    MI.getOperand(1).ChangeToRegister(BasePtr, false);
-//    MI.tieOperands(0, 1);
-//  } else
-//#endif // 0
-//  {
-//    MI.getOperand(FIOperandNum).ChangeToRegister(BasePtr, false);
-//    if (Opc == Z80::LD16rfi) {
-//      MI.setDesc(TII.get(TargetOpcode::COPY));
-//      MI.RemoveOperand(FIOperandNum + 1);
-//    } else {
-//      MI.getOperand(FIOperandNum + 1).ChangeToImmediate(0);
-//    }
-//    BuildMI(MBB, ++II, DL, TII.get(Z80::POP16r), BasePtr);
-//  }
+  MachineInstr &MI = *II;
+  unsigned Opc = MI.getOpcode();
+  MachineBasicBlock &MBB = *MI.getParent();
+  MachineFunction &MF = *MBB.getParent();
+  const Z80Subtarget &STI = MF.getSubtarget<Z80Subtarget>();
+  const Z80InstrInfo &TII = *STI.getInstrInfo();
+  const Z80FrameLowering *TFI = getFrameLowering(MF);
+  DebugLoc DL = MI.getDebugLoc();
+  int FrameIndex = MI.getOperand(FIOperandNum).getIndex();
+
+  LLVM_DEBUG(MF.dump(); II->dump();
+             dbgs() << MF.getFunction().arg_size() << '\n');
+  unsigned BasePtr;
+  int Offset = TFI->getFrameIndexReference(MF, FrameIndex, BasePtr) +
+    MI.getOperand(FIOperandNum + 1).getImm();
+  if (!TFI->hasFP(MF)) {
+    // Only the arguments of a function with a static frame are on the stack.
+    const char *StaticFrame = nullptr;
+    if (FrameIndex >= 0)
+      StaticFrame = MF.getInfo<Z80MachineFunctionInfo>()->getStaticFrame();
+    eliminateFrameIndexWithoutFP(II, StaticFrame ? Offset : Offset + SPAdj,
+                                 FIOperandNum, StaticFrame, RS);
+    return;
+  }
+  if (isInt<8>(Offset) && Opc != Z80::LD16rfi) {
+    MI.getOperand(FIOperandNum).ChangeToRegister(BasePtr, false);
+    MI.getOperand(FIOperandNum + 1).ChangeToImmediate(Offset);
+    return;
+  }
+  unsigned OffsetReg = RS->scavengeRegister(
+                         &Z80::OR16RegClass, II, SPAdj);
+#if 0
+  if ((Opc == Z80::LEA24ro &&
+       Z80::A24RegClass.contains(MI.getOperand(0).getReg())) ||
+      ((Opc == Z80::LEA16ro || Opc == Z80::LD16rfi) &&
+       Z80::AIR16RegClass.contains(MI.getOperand(0).getReg()))) {
+    BuildMI(MBB, II, DL, TII.get(Is24Bit ? Z80::LD24ri : Z80::LD16ri),
+            OffsetReg).addImm(Offset);
+    MI.getOperand(FIOperandNum).ChangeToRegister(BasePtr, false);
+    if (Opc == Z80::LD16rfi) {
+      MI.setDesc(TII.get(TargetOpcode::COPY));
+      MI.RemoveOperand(FIOperandNum + 1);
+    } else {
+      MI.getOperand(FIOperandNum + 1).ChangeToImmediate(0);
+    }
+    BuildMI(MBB, ++II, DL, TII.get(Is24Bit ? Z80::ADD24ao : Z80::ADD16ao),
+            MI.getOperand(0).getReg()).addReg(MI.getOperand(0).getReg())
+    .addReg(OffsetReg, RegState::Kill);
+    return;
+  }
+#endif // 0
+  if (unsigned ScratchReg = RS->FindUnusedReg(&Z80::AIR16RegClass)) {
+    BuildMI(MBB, II, DL, TII.get(Z80::LD16ri),
+            OffsetReg).addImm(Offset);
+    BuildMI(MBB, II, DL, TII.get(TargetOpcode::COPY), ScratchReg)
+    .addReg(BasePtr);
+    BuildMI(MBB, II, DL, TII.get(Z80::ADD16ao),
+            ScratchReg).addReg(ScratchReg).addReg(OffsetReg, RegState::Kill);
+    MI.getOperand(FIOperandNum).ChangeToRegister(ScratchReg, false);
+    if ((Z80::IR16RegClass).contains(ScratchReg)) {
+      MI.getOperand(FIOperandNum + 1).ChangeToImmediate(0);
+    } else {
+      switch (Opc) {
+      default: llvm_unreachable("Unexpected opcode!");
+      //case Z80::LD24ro: Opc = Z80::LD24rp; break;
+      //case Z80::LD16ro: Opc = Z80::LD16rp; break;
+      case Z80::LD8ro: Opc = Z80::LD8rp; break;
+      case Z80::LD8go: Opc = Z80::LD8gp; break;
+      //case Z80::LD24or: Opc = Z80::LD24pr; break;
+      //case Z80::LD16or: Opc = Z80::LD16pr; break;
+      case Z80::LD8or: Opc = Z80::LD8pr; break;
+      case Z80::LD8og: Opc = Z80::LD8pg; break;
+      //case Z80::LEA24ro: case Z80::LEA16ro:
+      case Z80::LD16rfi: Opc = TargetOpcode::COPY; break;
+        //case Z80::PEA24o: Opc = Z80::PUSH24r; break;
+        //case Z80::PEA16o: Opc = Z80::PUSH16r; break;
+      }
+      MI.setDesc(TII.get(Opc));
+      MI.RemoveOperand(FIOperandNum + 1);
+    }
+    return;
+  }
+  BuildMI(MBB, II, DL, TII.get(Z80::PUSH16r))
+  .addReg(BasePtr);
+  BuildMI(MBB, II, DL, TII.get(Z80::LD16ri), OffsetReg)
+  .addImm(Offset);
+  BuildMI(MBB, II, DL, TII.get(Z80::ADD16ao), BasePtr)
+  .addReg(BasePtr).addReg(OffsetReg, RegState::Kill);
+#if 0
+  if (Opc == Z80::PEA24o || Opc == Z80::PEA16o) {
+    MI.setDesc(TII.get(Opc == Z80::PEA24o ? Z80::EX24SP : Z80::EX16SP));
+    MI.getOperand(0).ChangeToRegister(BasePtr, true);
+    MI.getOperand(1).ChangeToRegister(BasePtr, false);
+    MI.tieOperands(0, 1);
+  } else
+#endif // 0
+  {
+    MI.getOperand(FIOperandNum).ChangeToRegister(BasePtr, false);
+    if (Opc == Z80::LD16rfi) {
+      MI.setDesc(TII.get(TargetOpcode::COPY));
+      MI.RemoveOperand(FIOperandNum + 1);
+    } else {
+      MI.getOperand(FIOperandNum + 1).ChangeToImmediate(0);
+    }
+    BuildMI(MBB, ++II, DL, TII.get(Z80::POP16r), BasePtr);
+  }
 }
-//
+
+/// Returns the form of Opc that addresses memory through HL instead of an
+/// index register, or 0 if there is none.
+static unsigned getPointerOpcode(unsigned Opc) {
+  switch (Opc) {
+  default: return 0;
+  case Z80::LD8ro:  return Z80::LD8rp;
+  case Z80::LD8go:  return Z80::LD8gp;
+  case Z80::LD88ro: return Z80::LD88rp;
+  case Z80::LD8or:  return Z80::LD8pr;
+  case Z80::LD8og:  return Z80::LD8pg;
+  case Z80::LD88or: return Z80::LD88pr;
+  case Z80::LD8oi:  return Z80::LD8pi;
+  case Z80::ADD8ao: return Z80::ADD8ap;
+  case Z80::ADC8ao: return Z80::ADC8ap;
+  case Z80::SUB8ao: return Z80::SUB8ap;
+  case Z80::SBC8ao: return Z80::SBC8ap;
+  case Z80::AND8ao: return Z80::AND8ap;
+  case Z80::XOR8ao: return Z80::XOR8ap;
+  case Z80::OR8ao:  return Z80::OR8ap;
+  case Z80::CP8ao:  return Z80::CP8ap;
+  case Z80::INC8o:  return Z80::INC8p;
+  case Z80::DEC8o:  return Z80::DEC8p;
+  case Z80::RLC8o:  return Z80::RLC8p;
+  case Z80::RRC8o:  return Z80::RRC8p;
+  case Z80::RL8o:   return Z80::RL8p;
+  case Z80::RR8o:   return Z80::RR8p;
+  case Z80::SLA8o:  return Z80::SLA8p;
+  case Z80::SRA8o:  return Z80::SRA8p;
+  case Z80::SLL8o:  return Z80::SLL8p;
+  case Z80::SRL8o:  return Z80::SRL8p;
+  case Z80::BIT8bo: return Z80::BIT8bp;
+  case Z80::RES8bo: return Z80::RES8bp;
+  case Z80::SET8bo: return Z80::SET8bp;
+  }
+}
+
+/// Returns the form of Opc that addresses memory directly, or 0 if there is
+/// none.  Only A is loaded and stored directly among the 8-bit registers.
+static unsigned getDirectOpcode(const MachineInstr &MI) {
+  switch (MI.getOpcode()) {
+  default: return 0;
+  case Z80::LD88ro: return Z80::LD16rm;
+  case Z80::LD88or: return Z80::LD16mr;
+  case Z80::LD8ro:
+  case Z80::LD8go:
+    return MI.getOperand(0).getReg() == Z80::A ? Z80::LD8am : 0;
+  case Z80::LD8or:
+  case Z80::LD8og:
+    return MI.getOperand(2).getReg() == Z80::A ? Z80::LD8ma : 0;
+  }
+}
+
+/// eliminateFrameIndexWithoutFP - Rewrite the access of MI to the stack
+/// object at Offset from SP, or from StaticFrame if the object is in static
+/// storage.
+///
+/// On the stack, the word on top is loaded with pop rr / push rr, and stored
+/// from a dead HL with ex (sp),hl.  In static storage, words and bytes in A
+/// are loaded and stored with ld rr,(nn) and ld a,(nn).  Otherwise a pointer
+/// register is set to the address of the object with
+///   ld ptr, Offset              ld ptr, StaticFrame + Offset
+///   add ptr, sp
+/// where HL gives the shorter (hl) forms, and IY or IX the (ix+d) ones.  The
+/// pointer, and the flags for add, are saved around this if they are live.
+void Z80RegisterInfo::eliminateFrameIndexWithoutFP(
+  MachineBasicBlock::iterator II, int Offset, unsigned FIOperandNum,
+  const char *StaticFrame, RegScavenger *RS) const {
+  MachineInstr &MI = *II;
+  unsigned Opc = MI.getOpcode();
+  MachineBasicBlock &MBB = *MI.getParent();
+  MachineFunction &MF = *MBB.getParent();
+  const MachineRegisterInfo &MRI = MF.getRegInfo();
+  const TargetInstrInfo &TII = *MF.getSubtarget().getInstrInfo();
+  DebugLoc DL = MI.getDebugLoc();
+  assert(Offset >= 0 && "Stack object below SP");
+
+  if (StaticFrame) {
+    if (unsigned DirectOpc = getDirectOpcode(MI)) {
+      MachineInstrBuilder MIB = BuildMI(MBB, II, DL, TII.get(DirectOpc));
+      if (DirectOpc == Z80::LD16rm)
+        MIB.add(MI.getOperand(0));
+      MIB.addExternalSymbol(StaticFrame);
+      MIB->getOperand(MIB->getNumExplicitOperands() - 1).setOffset(Offset);
+      if (DirectOpc == Z80::LD16mr)
+        MIB.add(MI.getOperand(2));
+      MIB.setMemRefs(MI.memoperands_begin(), MI.memoperands_end());
+      MI.eraseFromParent();
+      return;
+    }
+  } else if (Offset == 0 && Opc == Z80::LD88ro) {
+    unsigned Reg = MI.getOperand(0).getReg();
+    BuildMI(MBB, II, DL, TII.get(Z80::POP16r), Reg);
+    BuildMI(MBB, II, DL, TII.get(Z80::PUSH16r)).addReg(Reg);
+    MI.eraseFromParent();
+    return;
+  } else if (Offset == 0 && Opc == Z80::LD88or &&
+             MI.getOperand(2).getReg() == Z80::HL &&
+             MI.getOperand(2).isKill()) {
+    BuildMI(MBB, II, DL, TII.get(Z80::EX16SP))
+    .addReg(Z80::HL, RegState::Define | RegState::Dead)
+    .addReg(Z80::HL, RegState::Kill);
+    MI.eraseFromParent();
+    return;
+  }
+
+  unsigned PtrOpc = getPointerOpcode(Opc);
+  bool IsAddr = Opc == Z80::LD16rfi;
+  unsigned DstReg = IsAddr ? MI.getOperand(0).getReg() : 0;
+  bool UsesIndex = false;
+  for (unsigned IndexReg : Z80::IR16RegClass)
+    UsesIndex |= MI.readsRegister(IndexReg, this) ||
+                 MI.modifiesRegister(IndexReg, this);
+
+  // An address can be computed right into an address register, or into any
+  // pair if it is static.
+  unsigned Ptr = 0;
+  if (StaticFrame ? Z80::R16RegClass.contains(DstReg)
+                  : Z80::AIR16RegClass.contains(DstReg))
+    Ptr = DstReg;
+  bool SavePtr = false;
+  if (!Ptr) {
+    // The pseudo loads and stores of index registers go through HL.
+    SmallVector<unsigned, 3> Candidates;
+    if ((IsAddr || PtrOpc) && !UsesIndex)
+      Candidates.push_back(Z80::HL);
+    if (!IsAddr)
+      Candidates.append({Z80::IY, Z80::IX});
+    for (unsigned Reg : Candidates) {
+      if (MRI.isReserved(Reg) || MI.readsRegister(Reg, this) ||
+          MI.modifiesRegister(Reg, this))
+        continue;
+      if (RS && !RS->isRegUsed(Reg)) {
+        Ptr = Reg;
+        SavePtr = false;
+        break;
+      }
+      if (!Ptr) {
+        Ptr = Reg;
+        SavePtr = true;
+      }
+    }
+    if (!Ptr)
+      report_fatal_error("No register to address the stack with");
+  }
+  bool SaveF = !StaticFrame && (!RS || RS->isRegUsed(Z80::F));
+
+  int Adjust = 0;
+  if (SavePtr) {
+    BuildMI(MBB, II, DL, TII.get(Z80::PUSH16r)).addReg(Ptr);
+    Adjust += 2;
+  }
+  if (StaticFrame) {
+    MachineInstrBuilder MIB = BuildMI(MBB, II, DL, TII.get(Z80::LD16ri), Ptr)
+                              .addExternalSymbol(StaticFrame);
+    MIB->getOperand(1).setOffset(Offset);
+  } else {
+    if (SaveF) {
+      BuildMI(MBB, II, DL, TII.get(Z80::PUSH16AF));
+      Adjust += 2;
+    }
+    BuildMI(MBB, II, DL, TII.get(Z80::LD16ri), Ptr).addImm(Offset + Adjust);
+    BuildMI(MBB, II, DL, TII.get(Z80::ADD16SP), Ptr).addReg(Ptr);
+    if (SaveF)
+      BuildMI(MBB, II, DL, TII.get(Z80::POP16AF));
+  }
+  if (SavePtr)
+    BuildMI(MBB, std::next(II), DL, TII.get(Z80::POP16r), Ptr);
+
+  if (IsAddr) {
+    if (Ptr != DstReg)
+      BuildMI(MBB, II, DL, TII.get(TargetOpcode::COPY), DstReg)
+      .addReg(Ptr, RegState::Kill);
+    MI.eraseFromParent();
+    return;
+  }
+  MI.getOperand(FIOperandNum).ChangeToRegister(Ptr, false, false, true);
+  if (Ptr == Z80::HL) {
+    MI.setDesc(TII.get(PtrOpc));
+    MI.RemoveOperand(FIOperandNum + 1);
+  } else {
+    MI.getOperand(FIOperandNum + 1).ChangeToImmediate(0);
+  }
+}
+
 unsigned Z80RegisterInfo::getFrameRegister(const MachineFunction &MF) const {
   return getFrameLowering(MF)->hasFP(MF) ? Z80::IX : Z80::SPS;
 }
-//
-//bool Z80RegisterInfo::
-//shouldCoalesce(MachineInstr *MI,
-//               const TargetRegisterClass *SrcRC, unsigned SrcSubReg,
-//               const TargetRegisterClass *DstRC, unsigned DstSubReg,
-//               const TargetRegisterClass *NewRC, LiveIntervals &LIS) const {
-//  const TargetRegisterInfo &TRI = *MI->getParent()->getParent()->getRegInfo()
-//                                  .getTargetRegisterInfo();
-//  (void)TRI;
-//  LLVM_DEBUG(dbgs() << TRI.getRegClassName(SrcRC) << '[' << SrcRC->getNumRegs()
-//             << "]:" << (SrcSubReg ? TRI.getSubRegIndexName(SrcSubReg) : "")
-//             << " -> " << TRI.getRegClassName(DstRC) << '[' << DstRC->getNumRegs()
-//             << "]:" << (DstSubReg ? TRI.getSubRegIndexName(DstSubReg) : "") << ' '
-//             << TRI.getRegClassName(NewRC) << '[' << NewRC->getNumRegs() << "]\n");
-//  // Don't coalesce if SrcRC and DstRC have a small intersection.
-//  return std::min(SrcRC->getNumRegs(),
-//                  DstRC->getNumRegs()) <= NewRC->getNumRegs();
-//}
-//
-//bool Z80RegisterInfo::
-//requiresVirtualBaseRegisters(const MachineFunction &MF) const {
-//  return true;
-//}
-//bool Z80RegisterInfo::needsFrameBaseReg(MachineInstr *MI,
-//                                        int64_t Offset) const {
-//  const MachineFunction &MF = *MI->getParent()->getParent();
-//  return !isFrameOffsetLegal(MI, getFrameRegister(MF), Offset);
-//}
-//void Z80RegisterInfo::
-//materializeFrameBaseRegister(MachineBasicBlock *MBB, unsigned BaseReg,
-//                             int FrameIdx, int64_t Offset) const {
-//  MachineFunction &MF = *MBB->getParent();
-//  MachineRegisterInfo &MRI = MF.getRegInfo();
-//  const TargetInstrInfo &TII = *MF.getSubtarget().getInstrInfo();
-//  MachineBasicBlock::iterator II = MBB->begin();
-//  DebugLoc DL = MBB->findDebugLoc(II);
-//  MRI.setRegClass(BaseReg, &Z80::IR16RegClass);
-//  //BuildMI(*MBB, II, DL, TII.get(Z80::LEA16ro), BaseReg)
-//  BuildMI(*MBB, II, DL, TII.get(Z80::LD88ro),
-//          BaseReg) // $TODO: Check if this is correct. LEA: IX/Y += Offset
-//  .addFrameIndex(FrameIdx).addImm(Offset);
-//  return;
-//  unsigned CopyReg = MRI.createVirtualRegister(&Z80::IR16RegClass);
-//  unsigned OffsetReg = MRI.createVirtualRegister(&Z80::OR16RegClass);
-//  BuildMI(*MBB, II, DL, TII.get(TargetOpcode::COPY), CopyReg)
-//  .addReg(getFrameRegister(MF));
-//  BuildMI(*MBB, II, DL, TII.get(Z80::LD16ri),
-//          OffsetReg).addImm(Offset);
-//  BuildMI(*MBB, II, DL, TII.get(Z80::ADD16ao), BaseReg)
-//  .addReg(CopyReg).addReg(OffsetReg);
-//}
-//void Z80RegisterInfo::resolveFrameIndex(MachineInstr &MI, unsigned BaseReg,
-//                                        int64_t Offset) const {
-//  unsigned FIOperandNum = 0;
-//  while (!MI.getOperand(FIOperandNum).isFI()) {
-//    FIOperandNum++;
-//    assert(FIOperandNum < MI.getNumOperands() && "Expected a frame index");
-//  }
-//  MI.getOperand(FIOperandNum).ChangeToRegister(BaseReg, false);
-//  MI.getOperand(FIOperandNum + 1).ChangeToImmediate(
-//    MI.getOperand(FIOperandNum + 1).getImm() + Offset);
-//}
-//bool Z80RegisterInfo::isFrameOffsetLegal(const MachineInstr *MI,
-//                                         unsigned BaseReg,
-//                                         int64_t Offset) const {
-//  return isInt<8>(Offset);
-//}
+
+bool Z80RegisterInfo::
+shouldCoalesce(MachineInstr *MI,
+               const TargetRegisterClass *SrcRC, unsigned SrcSubReg,
+               const TargetRegisterClass *DstRC, unsigned DstSubReg,
+               const TargetRegisterClass *NewRC, LiveIntervals &LIS) const {
+  const TargetRegisterInfo &TRI = *MI->getParent()->getParent()->getRegInfo()
+                                  .getTargetRegisterInfo();
+  (void)TRI;
+  LLVM_DEBUG(dbgs() << TRI.getRegClassName(SrcRC) << '[' << SrcRC->getNumRegs()
+             << "]:" << (SrcSubReg ? TRI.getSubRegIndexName(SrcSubReg) : "")
+             << " -> " << TRI.getRegClassName(DstRC) << '[' << DstRC->getNumRegs()
+             << "]:" << (DstSubReg ? TRI.getSubRegIndexName(DstSubReg) : "") << ' '
+             << TRI.getRegClassName(NewRC) << '[' << NewRC->getNumRegs() << "]\n");
+  // Don't coalesce if SrcRC and DstRC have a small intersection.
+  return std::min(SrcRC->getNumRegs(),
+                  DstRC->getNumRegs()) <= NewRC->getNumRegs();
+}
+
+bool Z80RegisterInfo::
+requiresVirtualBaseRegisters(const MachineFunction &MF) const {
+  return true;
+}
+bool Z80RegisterInfo::needsFrameBaseReg(MachineInstr *MI,
+                                        int64_t Offset) const {
+  const MachineFunction &MF = *MI->getParent()->getParent();
+  // Any offset from SP takes the same code.
+  if (!getFrameLowering(MF)->hasFP(MF))
+    return false;
+  return !isFrameOffsetLegal(MI, getFrameRegister(MF), Offset);
+}
+void Z80RegisterInfo::
+materializeFrameBaseRegister(MachineBasicBlock *MBB, unsigned BaseReg,
+                             int FrameIdx, int64_t Offset) const {
+  MachineFunction &MF = *MBB->getParent();
+  MachineRegisterInfo &MRI = MF.getRegInfo();
+  const TargetInstrInfo &TII = *MF.getSubtarget().getInstrInfo();
+  MachineBasicBlock::iterator II = MBB->begin();
+  DebugLoc DL = MBB->findDebugLoc(II);
+  MRI.setRegClass(BaseReg, &Z80::IR16RegClass);
+  //BuildMI(*MBB, II, DL, TII.get(Z80::LEA16ro), BaseReg)
+  BuildMI(*MBB, II, DL, TII.get(Z80::LD88ro),
+          BaseReg) // $TODO: Check if this is correct. LEA: IX/Y += Offset
+  .addFrameIndex(FrameIdx).addImm(Offset);
+  return;
+  unsigned CopyReg = MRI.createVirtualRegister(&Z80::IR16RegClass);
+  unsigned OffsetReg = MRI.createVirtualRegister(&Z80::OR16RegClass);
+  BuildMI(*MBB, II, DL, TII.get(TargetOpcode::COPY), CopyReg)
+  .addReg(getFrameRegister(MF));
+  BuildMI(*MBB, II, DL, TII.get(Z80::LD16ri),
+          OffsetReg).addImm(Offset);
+  BuildMI(*MBB, II, DL, TII.get(Z80::ADD16ao), BaseReg)
+  .addReg(CopyReg).addReg(OffsetReg);
+}
+void Z80RegisterInfo::resolveFrameIndex(MachineInstr &MI, unsigned BaseReg,
+                                        int64_t Offset) const {
+  unsigned FIOperandNum = 0;
+  while (!MI.getOperand(FIOperandNum).isFI()) {
+    FIOperandNum++;
+    assert(FIOperandNum < MI.getNumOperands() && "Expected a frame index");
+  }
+  MI.getOperand(FIOperandNum).ChangeToRegister(BaseReg, false);
+  MI.getOperand(FIOperandNum + 1).ChangeToImmediate(
+    MI.getOperand(FIOperandNum + 1).getImm() + Offset);
+}
+bool Z80RegisterInfo::isFrameOffsetLegal(const MachineInstr *MI,
+                                         unsigned BaseReg,
+                                         int64_t Offset) const {
+  return isInt<8>(Offset);
+}
@@ -0,0 +1,195 @@
+//===-- Z80SelectionDAGInfo.cpp - Z80 SelectionDAG Info -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the Z80SelectionDAGInfo class.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Z80SelectionDAGInfo.h"
+#include "Z80ISelLowering.h"
+#include "MCTargetDesc/Z80MCTargetDesc.h"
+#include "llvm/CodeGen/SelectionDAG.h"
+#include "llvm/Support/CommandLine.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "z80-selectiondag-info"
+
+static cl::opt<bool> Z80StackFill(
+    "z80-stack-fill", cl::Hidden, cl::init(true),
+    cl::desc("Allow memset to push its pattern through a hijacked stack "
+             "pointer with interrupts disabled"));
+
+static bool optimizeForSize(SelectionDAG &DAG) {
+  return DAG.getMachineFunction().getFunction().getAttributes()
+         .hasAttribute(AttributeList::FunctionIndex, Attribute::OptimizeForSize);
+}
+
+/// Copy Size bytes from (HL) to (DE), with a single ldir when optimizing for
+/// size and with unrolled ldi, at 16 instead of 21 cycles a byte, otherwise.
+/// Up to 16 ldi are fully unrolled and don't need the count in BC.
+static SDValue EmitBlockCopy(SelectionDAG &DAG, const SDLoc &dl, SDValue Chain,
+                             SDValue Dst, SDValue Src, uint64_t Size) {
+  bool OptSize = optimizeForSize(DAG);
+  SDValue InFlag;
+  if (OptSize || Size > 16) {
+    Chain = DAG.getCopyToReg(Chain, dl, Z80::BC,
+                             DAG.getConstant(Size, dl, MVT::i16), InFlag);
+    InFlag = Chain.getValue(1);
+  }
+  Chain = DAG.getCopyToReg(Chain, dl, Z80::DE, Dst, InFlag);
+  InFlag = Chain.getValue(1);
+  Chain = DAG.getCopyToReg(Chain, dl, Z80::HL, Src, InFlag);
+  InFlag = Chain.getValue(1);
+  SDVTList VTs = DAG.getVTList(MVT::Other, MVT::Glue);
+  if (OptSize) {
+    return DAG.getNode(Z80ISD::LDIR, dl, VTs, Chain, InFlag);
+  }
+  return DAG.getNode(Size > 16 ? Z80ISD::LDI_LOOP : Z80ISD::LDI, dl, VTs,
+                     Chain, DAG.getTargetConstant(Size, dl, MVT::i16), InFlag);
+}
+
+SDValue Z80SelectionDAGInfo::EmitTargetCodeForMemcpy(
+    SelectionDAG &DAG, const SDLoc &dl, SDValue Chain, SDValue Dst, SDValue Src,
+    SDValue Size, unsigned Align, bool isVolatile, bool AlwaysInline,
+    MachinePointerInfo DstPtrInfo, MachinePointerInfo SrcPtrInfo) const {
+  // An ldir with bc = 0 copies 64K, so unknown sizes are left to memcpy.
+  ConstantSDNode *ConstantSize = dyn_cast<ConstantSDNode>(Size);
+  if (!ConstantSize || ConstantSize->getZExtValue() > UINT16_MAX) {
+    return SDValue();
+  }
+  uint64_t SizeVal = ConstantSize->getZExtValue();
+  if (!SizeVal) {
+    return Chain;
+  }
+  return EmitBlockCopy(DAG, dl, Chain, Dst, Src, SizeVal);
+}
+
+SDValue Z80SelectionDAGInfo::EmitTargetCodeForMemmove(
+    SelectionDAG &DAG, const SDLoc &dl, SDValue Chain, SDValue Dst, SDValue Src,
+    SDValue Size, unsigned Align, bool isVolatile,
+    MachinePointerInfo DstPtrInfo, MachinePointerInfo SrcPtrInfo) const {
+  ConstantSDNode *ConstantSize = dyn_cast<ConstantSDNode>(Size);
+  if (!ConstantSize || ConstantSize->getZExtValue() > UINT16_MAX) {
+    return SDValue();
+  }
+  uint64_t SizeVal = ConstantSize->getZExtValue();
+  if (!SizeVal) {
+    return Chain;
+  }
+  return DAG.getNode(Z80ISD::MEMMOVE, dl, MVT::Other, Chain, Dst, Src,
+                     DAG.getTargetConstant(SizeVal, dl, MVT::i16));
+}
+
+SDValue Z80SelectionDAGInfo::EmitTargetCodeForMemset(
+    SelectionDAG &DAG, const SDLoc &dl, SDValue Chain, SDValue Dst, SDValue Src,
+    SDValue Size, unsigned Align, bool isVolatile,
+    MachinePointerInfo DstPtrInfo) const {
+  ConstantSDNode *ConstantSize = dyn_cast<ConstantSDNode>(Size);
+  if (!ConstantSize || ConstantSize->getZExtValue() > UINT16_MAX) {
+    return SDValue();
+  }
+  uint64_t SizeVal = ConstantSize->getZExtValue();
+  if (!SizeVal) {
+    return Chain;
+  }
+  EVT PtrVT = Dst.getValueType();
+  SDValue Byte = DAG.getZExtOrTrunc(Src, dl, MVT::i8);
+  MachineMemOperand::Flags MMOFlags = isVolatile ? MachineMemOperand::MOVolatile
+                                                 : MachineMemOperand::MONone;
+  // Big enough blocks are pushed at 5.5 cycles a byte.  That stores downwards
+  // from the end, with interrupts disabled for the duration, up to some 48000
+  // cycles for 8K, so it is only done when optimizing for speed, and not for
+  // volatile stores.  It also takes iy to save sp.  An odd byte at the start
+  // is stored on its own.
+  uint64_t Words = SizeVal / 2;
+  if (Z80StackFill && !isVolatile && !optimizeForSize(DAG) && Words >= 8 &&
+      Words <= 16 * 256) {
+    if (SizeVal % 2) {
+      Chain = DAG.getStore(Chain, dl, Byte, Dst, DstPtrInfo, Align, MMOFlags);
+    }
+    SDValue Pattern;
+    if (auto ConstByte = dyn_cast<ConstantSDNode>(Byte)) {
+      Pattern = DAG.getConstant(ConstByte->getZExtValue() * 0x0101, dl,
+                                MVT::i16);
+    } else {
+      Pattern = DAG.getNode(ISD::ZERO_EXTEND, dl, MVT::i16, Byte);
+      Pattern = DAG.getNode(ISD::OR, dl, MVT::i16, Pattern,
+                            DAG.getNode(ISD::SHL, dl, MVT::i16, Pattern,
+                                        DAG.getConstant(8, dl, MVT::i8)));
+    }
+    SDValue End = DAG.getNode(ISD::ADD, dl, PtrVT, Dst,
+                              DAG.getConstant(SizeVal, dl, PtrVT));
+    SDValue InFlag;
+    Chain = DAG.getCopyToReg(Chain, dl, Z80::DE, Pattern, InFlag);
+    InFlag = Chain.getValue(1);
+    Chain = DAG.getCopyToReg(Chain, dl, Z80::HL, End, InFlag);
+    InFlag = Chain.getValue(1);
+    return DAG.getNode(Z80ISD::FILLSP, dl,
+                       DAG.getVTList(MVT::Other, MVT::Glue), Chain,
+                       DAG.getTargetConstant(Words, dl, MVT::i16), InFlag);
+  }
+  // Otherwise store the first byte and copy each byte into the next one.
+  Chain = DAG.getStore(Chain, dl, Byte, Dst, DstPtrInfo, Align, MMOFlags);
+  if (SizeVal == 1) {
+    return Chain;
+  }
+  SDValue Next = DAG.getNode(ISD::ADD, dl, PtrVT, Dst,
+                             DAG.getConstant(1, dl, PtrVT));
+  return EmitBlockCopy(DAG, dl, Chain, Next, Dst, SizeVal - 1);
+}
+
+std::pair<SDValue, SDValue> Z80SelectionDAGInfo::EmitTargetCodeForMemchr(
+    SelectionDAG &DAG, const SDLoc &dl, SDValue Chain, SDValue Src,
+    SDValue Char, SDValue Length, MachinePointerInfo SrcPtrInfo) const {
+  EVT PtrVT = Src.getValueType();
+  ConstantSDNode *ConstantLength = dyn_cast<ConstantSDNode>(Length);
+  if (ConstantLength && !ConstantLength->getZExtValue()) {
+    return std::make_pair(DAG.getConstant(0, dl, PtrVT), Chain);
+  }
+  // An unknown length needs a test for zero around the cpir, which is no
+  // smaller than the call.
+  if (!ConstantLength && optimizeForSize(DAG)) {
+    return std::make_pair(SDValue(), SDValue());
+  }
+  SDValue Byte = DAG.getZExtOrTrunc(Char, dl, MVT::i8);
+  Length = DAG.getZExtOrTrunc(Length, dl, MVT::i16);
+  SDValue Result = DAG.getNode(Z80ISD::MEMCHR, dl,
+                               DAG.getVTList(PtrVT, MVT::Other), Chain, Src,
+                               Byte, Length);
+  return std::make_pair(Result, Result.getValue(1));
+}
+
+std::pair<SDValue, SDValue> Z80SelectionDAGInfo::EmitTargetCodeForStrlen(
+    SelectionDAG &DAG, const SDLoc &DL, SDValue Chain, SDValue Src,
+    MachinePointerInfo SrcPtrInfo) const {
+  // Setting up the scan and turning the count into the length takes more
+  // bytes than the call.
+  if (optimizeForSize(DAG)) {
+    return std::make_pair(SDValue(), SDValue());
+  }
+  // Scan for the terminator with bc = 0, which counts down from 64K.  A string
+  // of n bytes leaves bc = -(n + 1), so the length is ~bc.
+  SDValue InFlag;
+  Chain = DAG.getCopyToReg(Chain, DL, Z80::A,
+                           DAG.getConstant(0, DL, MVT::i8), InFlag);
+  InFlag = Chain.getValue(1);
+  Chain = DAG.getCopyToReg(Chain, DL, Z80::BC,
+                           DAG.getConstant(0, DL, MVT::i16), InFlag);
+  InFlag = Chain.getValue(1);
+  Chain = DAG.getCopyToReg(Chain, DL, Z80::HL, Src, InFlag);
+  InFlag = Chain.getValue(1);
+  Chain = DAG.getNode(Z80ISD::CPIR, DL, DAG.getVTList(MVT::Other, MVT::Glue),
+                      Chain, InFlag);
+  InFlag = Chain.getValue(1);
+  SDValue Count = DAG.getCopyFromReg(Chain, DL, Z80::BC, MVT::i16, InFlag);
+  Chain = Count.getValue(1);
+  SDValue Length = DAG.getNode(ISD::XOR, DL, MVT::i16, Count,
+                               DAG.getConstant(-1, DL, MVT::i16));
+  return std::make_pair(Length, Chain);
+}
@@ -0,0 +1,258 @@
+//===-- Z80ShadowSpills.cpp - Spill to the shadow registers ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains a pass that keeps spilled values in the shadow registers
+// instead of the stack, when compiled code may use them (+shadow-regs).
+//
+// A value spilled and reloaded once within a block, in a register swapped by
+// ex af, af' or exx, is parked with that instruction at the spill and brought
+// back with it at the reload.  That takes 1 byte and 4 T-states each, instead
+// of up to 6 bytes and 38 T-states for a word at (ix+d).  The swap moves the
+// other registers of the set too, so each of them must either keep its value
+// untouched from the spill to the reload, when it rides along in the shadow
+// register, or hold no value at either point.  Calls and inline asm may use
+// the shadow registers themselves, so none may come in between.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Z80.h"
+#include "Z80InstrInfo.h"
+#include "Z80Subtarget.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/LivePhysRegs.h"
+#include "llvm/CodeGen/MachineFrameInfo.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "z80-shadow-spills"
+
+STATISTIC(NumShadowSpills, "Number of spills kept in shadow registers");
+
+// The 8-bit registers swapped by ex af, af' and exx, as bits of a mask.
+static const MCPhysReg Units[] = {Z80::A, Z80::F, Z80::B, Z80::C,
+                                  Z80::D, Z80::E, Z80::H, Z80::L};
+static const unsigned AFUnits = 0x03;
+static const unsigned EXXUnits = 0xFC;
+
+namespace {
+class Z80ShadowSpills : public MachineFunctionPass {
+public:
+  Z80ShadowSpills() : MachineFunctionPass(ID) {}
+
+  bool runOnMachineFunction(MachineFunction &MF) override;
+
+  MachineFunctionProperties getRequiredProperties() const override {
+    return MachineFunctionProperties().set(
+             MachineFunctionProperties::Property::NoVRegs);
+  }
+
+  StringRef getPassName() const override {
+    return "Z80 Shadow Spills";
+  }
+
+private:
+  /// A spill slot that is stored once and then reloaded once.
+  struct Spill {
+    MachineInstr *Store = nullptr;
+    MachineInstr *Reload = nullptr;
+    bool Valid = true;
+  };
+
+  unsigned getUnits(unsigned Reg) const;
+  bool canSwap(const Spill &S, unsigned Group, unsigned SwapOpc,
+               const DenseMap<const MachineInstr *, unsigned> &LiveAfter) const;
+  void setUndefUses(MachineInstr &MI, unsigned Live, bool ShadowLive) const;
+
+  const TargetInstrInfo *TII;
+  const TargetRegisterInfo *TRI;
+  static char ID;
+};
+
+char Z80ShadowSpills::ID = 0;
+} // end anonymous namespace
+
+FunctionPass *llvm::createZ80ShadowSpillsPass() {
+  return new Z80ShadowSpills();
+}
+
+/// Return the mask of the 8-bit registers that overlap Reg.
+unsigned Z80ShadowSpills::getUnits(unsigned Reg) const {
+  unsigned Mask = 0;
+  for (unsigned I = 0; I != array_lengthof(Units); ++I)
+    if (TRI->regsOverlap(Reg, Units[I]))
+      Mask |= 1 << I;
+  return Mask;
+}
+
+/// Return true if the spill S of a register of Group can be kept in the shadow
+/// registers by swapping them in with SwapOpc at the store and at the reload.
+bool Z80ShadowSpills::canSwap(
+  const Spill &S, unsigned Group, unsigned SwapOpc,
+  const DenseMap<const MachineInstr *, unsigned> &LiveAfter) const {
+  unsigned Spilled = getUnits(S.Store->getOperand(2).getReg());
+  unsigned LiveAtStore = LiveAfter.lookup(S.Store);
+  if (LiveAtStore & Spilled)
+    return false;
+
+  unsigned Accessed = 0, Modified = 0;
+  for (auto I = std::next(S.Store->getIterator()),
+       E = S.Reload->getIterator(); I != E; ++I) {
+    if (I->isDebugInstr())
+      continue;
+    if (I->isCall() || I->isInlineAsm() || I->getOpcode() == SwapOpc)
+      return false;
+    for (unsigned U = 0; U != array_lengthof(Units); ++U) {
+      if (!(Group & 1 << U))
+        continue;
+      if (I->modifiesRegister(Units[U], TRI))
+        Modified |= 1 << U;
+      if (I->readsRegister(Units[U], TRI))
+        Accessed |= 1 << U;
+    }
+  }
+  Accessed |= Modified;
+
+  // The values live across the spill ride along in the shadow registers, and
+  // come back at the reload.  The values set in between end up there.
+  unsigned Others = Group & ~Spilled;
+  return !(LiveAtStore & Others & Accessed) &&
+         !(LiveAfter.lookup(S.Reload) & Others & Modified);
+}
+
+/// Mark the implicit uses of MI of registers that hold no value as undef.
+void Z80ShadowSpills::setUndefUses(MachineInstr &MI, unsigned Live,
+                                   bool ShadowLive) const {
+  for (MachineOperand &MO : MI.implicit_operands()) {
+    if (!MO.isUse())
+      continue;
+    if (Z80::SHR16RegClass.contains(MO.getReg()) ? !ShadowLive
+                                                 : !(getUnits(MO.getReg()) &
+                                                     Live))
+      MO.setIsUndef();
+  }
+}
+
+bool Z80ShadowSpills::runOnMachineFunction(MachineFunction &MF) {
+  const Z80Subtarget &STI = MF.getSubtarget<Z80Subtarget>();
+  // Interrupt handlers may have interrupted code using the shadow registers.
+  if (skipFunction(MF.getFunction()) || !STI.usesShadowRegs() ||
+      MF.getFunction().hasFnAttribute("interrupt"))
+    return false;
+  TII = STI.getInstrInfo();
+  TRI = STI.getRegisterInfo();
+  MachineFrameInfo &MFI = MF.getFrameInfo();
+
+  // Find the spill slots that are stored and then reloaded into the same
+  // register, within one block, and not accessed otherwise.
+  DenseMap<int, Spill> Spills;
+  for (MachineBasicBlock &MBB : MF)
+    for (MachineInstr &MI : MBB)
+      for (const MachineOperand &MO : MI.operands()) {
+        if (!MO.isFI() || !MFI.isSpillSlotObjectIndex(MO.getIndex()))
+          continue;
+        int FI = MO.getIndex(), SlotFI;
+        Spill &S = Spills[FI];
+        if (!S.Store && TII->isStoreToStackSlot(MI, SlotFI) && SlotFI == FI)
+          S.Store = &MI;
+        else if (S.Store && !S.Reload && S.Store->getParent() == &MBB &&
+                 TII->isLoadFromStackSlot(MI, SlotFI) ==
+                 S.Store->getOperand(2).getReg() && SlotFI == FI)
+          S.Reload = &MI;
+        else
+          S.Valid = false;
+      }
+
+  // Take the candidates of each block in order, so that the spills kept in
+  // the same shadow registers don't overlap.
+  DenseMap<MachineBasicBlock *, SmallVector<int, 4>> Candidates;
+  for (MachineBasicBlock &MBB : MF)
+    for (MachineInstr &MI : MBB) {
+      int FI;
+      if (TII->isStoreToStackSlot(MI, FI) && Spills.count(FI)) {
+        const Spill &S = Spills[FI];
+        if (S.Valid && S.Store == &MI && S.Reload)
+          Candidates[&MBB].push_back(FI);
+      }
+    }
+
+  bool Changed = false;
+  for (MachineBasicBlock &MBB : MF) {
+    auto Entry = Candidates.find(&MBB);
+    if (Entry == Candidates.end())
+      continue;
+
+    // The 8-bit registers that hold a value after each instruction.
+    DenseMap<const MachineInstr *, unsigned> LiveAfter;
+    LivePhysRegs LiveRegs(*TRI);
+    LiveRegs.addLiveOuts(MBB);
+    for (MachineInstr &MI : reverse(MBB)) {
+      if (MI.isDebugInstr())
+        continue;
+      unsigned Live = 0;
+      for (unsigned U = 0; U != array_lengthof(Units); ++U)
+        if (LiveRegs.contains(Units[U]))
+          Live |= 1 << U;
+      LiveAfter[&MI] = Live;
+      LiveRegs.stepBackward(MI);
+    }
+
+    MachineInstr *AFBusyUntil = nullptr, *EXXBusyUntil = nullptr;
+    for (int FI : Entry->second) {
+      const Spill &S = Spills[FI];
+      unsigned Reg = S.Store->getOperand(2).getReg();
+      unsigned Spilled = getUnits(Reg);
+      unsigned Group, SwapOpc;
+      MachineInstr **BusyUntil;
+      if (Spilled && !(Spilled & ~AFUnits)) {
+        Group = AFUnits;
+        SwapOpc = Z80::EXAF;
+        BusyUntil = &AFBusyUntil;
+      } else if (Spilled && !(Spilled & ~EXXUnits)) {
+        Group = EXXUnits;
+        SwapOpc = Z80::EXX;
+        BusyUntil = &EXXBusyUntil;
+      } else
+        continue;
+
+      // Skip spills that start before the last one of the group ends.
+      if (*BusyUntil) {
+        bool Overlaps = false;
+        for (MachineBasicBlock::iterator I = S.Store->getIterator(),
+             E = MBB.end(); I != E; ++I)
+          if (&*I == *BusyUntil) {
+            Overlaps = true;
+            break;
+          }
+        if (Overlaps)
+          continue;
+      }
+      if (!canSwap(S, Group, SwapOpc, LiveAfter))
+        continue;
+
+      LLVM_DEBUG(dbgs() << "Keeping spill in shadow registers:\n";
+                 S.Store->dump(); S.Reload->dump());
+      unsigned LiveAtStore = LiveAfter.lookup(S.Store) | Spilled;
+      unsigned LiveAtReload = LiveAfter.lookup(S.Reload) & ~Spilled;
+      MachineInstr *Park = BuildMI(MBB, S.Store, S.Store->getDebugLoc(),
+                                   TII->get(SwapOpc));
+      setUndefUses(*Park, LiveAtStore, false);
+      MachineInstr *Back = BuildMI(MBB, S.Reload, S.Reload->getDebugLoc(),
+                                   TII->get(SwapOpc));
+      setUndefUses(*Back, LiveAtReload, true);
+      S.Store->eraseFromParent();
+      S.Reload->eraseFromParent();
+      MFI.RemoveStackObject(FI);
+      *BusyUntil = Back;
+      ++NumShadowSpills;
+      Changed = true;
+    }
+  }
+  return Changed;
+}
@@ -0,0 +1,150 @@
+//===-- Z80StaticLocals.cpp - Give non-reentrant frames static storage ----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains a module pass that picks the functions whose locals and
+// spill slots are kept in static storage instead of on the stack, like the
+// default non-reentrant mode of SDCC.  It is enabled for a function by the
+// "z80-static-locals" attribute, or for all of them by -z80-static-locals.
+//
+// A stack object in static storage is loaded and stored with ld a,(nn),
+// ld hl,(nn) and friends, or through ld hl,nn, without setting up IX or
+// adding SP.  A function can't have a static frame if it can be active
+// twice: if it is recursive, or an interrupt handler, or may be called from
+// one.  The functions chosen are marked with "z80-static-frame", which
+// Z80TargetLowering::finalizeLowering turns into a static frame unless the
+// function needs a frame pointer anyway.
+//
+// Once every function is compiled, Z80AsmPrinter lays out the static frames
+// of the module in one block, where the frames of functions that are never
+// active at the same time overlap.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Z80StaticLocals.h"
+#include "Z80.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+using namespace llvm;
+
+#define DEBUG_TYPE "z80-static-locals"
+
+static cl::opt<bool>
+EnableStaticLocals("z80-static-locals",
+                   cl::desc("Keep the stack objects of all non-reentrant "
+                            "functions in static storage"),
+                   cl::init(false), cl::Hidden);
+
+STATISTIC(NumStaticFrames, "Number of functions given a static frame");
+
+Z80CallGraph::Z80CallGraph(const Module &M) {
+  // The functions that code we can't see may call: those whose address is
+  // taken, and those visible outside of the module, like a putchar called
+  // back from a library printf.
+  SmallVector<const Function *, 8> Escaping;
+  for (const Function &F : M)
+    if (!F.isDeclaration() && (F.hasAddressTaken() || !F.hasLocalLinkage()))
+      Escaping.push_back(&F);
+
+  DenseMap<const Function *, SmallVector<const Function *, 8>> Callees;
+  for (const Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    SmallVectorImpl<const Function *> &Succs = Callees[&F];
+    bool CallsUnknown = false;
+    for (const Instruction &I : instructions(F)) {
+      ImmutableCallSite CS(&I);
+      if (!CS || CS.isInlineAsm())
+        continue;
+      const Function *Callee =
+        dyn_cast<Function>(CS.getCalledValue()->stripPointerCasts());
+      if (Callee && Callee->isIntrinsic())
+        continue;
+      if (Callee && !Callee->isDeclaration())
+        Succs.push_back(Callee);
+      else
+        CallsUnknown = true;
+    }
+    if (CallsUnknown)
+      Succs.append(Escaping.begin(), Escaping.end());
+  }
+
+  for (const auto &Entry : Callees) {
+    SmallPtrSetImpl<const Function *> &Reached = Reachable[Entry.first];
+    SmallVector<const Function *, 16> Worklist(Entry.second.begin(),
+                                               Entry.second.end());
+    while (!Worklist.empty()) {
+      const Function *F = Worklist.pop_back_val();
+      if (!Reached.insert(F).second)
+        continue;
+      const auto &Succs = Callees.find(F)->second;
+      Worklist.append(Succs.begin(), Succs.end());
+    }
+  }
+}
+
+bool Z80CallGraph::reaches(const Function *From, const Function *To) const {
+  auto I = Reachable.find(From);
+  return I != Reachable.end() && I->second.count(To);
+}
+
+namespace {
+class Z80StaticLocals : public ModulePass {
+public:
+  Z80StaticLocals() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override;
+
+  StringRef getPassName() const override {
+    return "Z80 Static Locals";
+  }
+
+  static char ID;
+};
+
+char Z80StaticLocals::ID = 0;
+} // end anonymous namespace
+
+ModulePass *llvm::createZ80StaticLocalsPass() {
+  return new Z80StaticLocals();
+}
+
+static bool wantsStaticLocals(const Function &F) {
+  return !F.isDeclaration() &&
+         (EnableStaticLocals || F.hasFnAttribute("z80-static-locals"));
+}
+
+bool Z80StaticLocals::runOnModule(Module &M) {
+  if (skipModule(M) || none_of(M, wantsStaticLocals))
+    return false;
+
+  Z80CallGraph CG(M);
+  SmallVector<const Function *, 4> Interrupts;
+  for (const Function &F : M)
+    if (!F.isDeclaration() && F.hasFnAttribute("interrupt"))
+      Interrupts.push_back(&F);
+
+  bool Changed = false;
+  for (Function &F : M) {
+    if (!wantsStaticLocals(F) || F.hasFnAttribute("interrupt") ||
+        CG.reaches(&F, &F) ||
+        any_of(Interrupts, [&](const Function *Handler) {
+          return CG.reaches(Handler, &F);
+        }))
+      continue;
+    F.addFnAttr("z80-static-frame");
+    ++NumStaticFrames;
+    Changed = true;
+  }
+  return Changed;
+}
@@ -0,0 +1,47 @@
+//===-- Z80StaticLocals.h - Static storage for Z80 frames -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the call graph that decides which functions may keep
+// their stack objects in static storage, and which of them may share it.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_LIB_TARGET_Z80_Z80STATICLOCALS_H
+#define LLVM_LIB_TARGET_Z80_Z80STATICLOCALS_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+
+namespace llvm {
+class Function;
+class Module;
+
+/// Z80CallGraph - Which functions of a module may call which others, directly
+/// or not.  A call through a pointer or to a function outside of the module
+/// may reach any function of the module whose address is taken or that is
+/// visible outside of it.
+class Z80CallGraph {
+  DenseMap<const Function *, SmallPtrSet<const Function *, 8>> Reachable;
+
+public:
+  explicit Z80CallGraph(const Module &M);
+
+  /// reaches - Return true if To may be called while From is active.
+  bool reaches(const Function *From, const Function *To) const;
+
+  /// canOverlap - Return true if F and G are never active at the same time,
+  /// so that their static frames may share storage.
+  bool canOverlap(const Function *F, const Function *G) const {
+    return !reaches(F, G) && !reaches(G, F);
+  }
+};
+
+} // end namespace llvm
+
+#endif
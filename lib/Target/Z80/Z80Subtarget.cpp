@@ -24,6 +24,10 @@ using namespace llvm;
 
 Z80Subtarget &Z80Subtarget::initializeSubtargetDependencies(StringRef CPU,
                                                             StringRef FS) {
+  // Without a processor there is no schedule model.
+  if (CPU.empty()) {
+    CPU = "generic";
+  }
   ParseSubtargetFeatures(CPU, FS);
   HasIdxHalfRegs = HasUndocOps;
   return *this;
@@ -36,6 +40,7 @@ Z80Subtarget::Z80Subtarget(const Triple &TT, StringRef CPU, StringRef FS,
   , In16BitMode(TT.getArch() == Triple::z80)
   , HasIdxHalfRegs(false)
   , HasUndocOps(false)
+  , UsesShadowRegs(false)
   , InstrInfo(initializeSubtargetDependencies(CPU, FS))
   , TLInfo(TM, *this)
   , FrameLowering(*this) {
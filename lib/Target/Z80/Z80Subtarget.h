@@ -42,6 +42,10 @@ class Z80Subtarget final : public Z80GenSubtargetInfo {
   /// True if target has index half registers (HasUndocOps || HasEZ80Ops).
   bool HasIdxHalfRegs;
 
+  /// True if compiled code may keep values in the shadow registers, false if
+  /// they are left to interrupt handlers.
+  bool UsesShadowRegs;
+
   Z80SelectionDAGInfo TSInfo;
   // Ordering here is important. Z80InstrInfo initializes Z80RegisterInfo which
   // Z80TargetLowering needs.
@@ -69,6 +73,9 @@ public:
     return &getInstrInfo()->getRegisterInfo();
   }
 
+  /// The schedule model is exact, so let the machine scheduler use it.
+  bool enableMachineScheduler() const override { return true; }
+
   /// ParseSubtargetFeatures - Parses features string setting specified
   /// subtarget options.  Definition of function is auto generated by tblgen.
   void ParseSubtargetFeatures(StringRef CPU, StringRef FS);
@@ -86,6 +93,7 @@ public:
 #endif // 0
   bool hasUndocOps()      const { return HasUndocOps; }
   bool hasIndexHalfRegs() const { return HasIdxHalfRegs; }
+  bool usesShadowRegs()   const { return UsesShadowRegs; }
 };
 } // End llvm namespace
 
@@ -157,11 +157,14 @@ public:
     return getTM<Z80TargetMachine>();
   }
 
+  void addIRPasses() override;
   void addCodeGenPrepare() override;
   bool addInstSelector() override;
-//void addPreRegAlloc() override;
+  void addPreRegAlloc() override;
+  void addPostRegAlloc() override;
 //bool addPreRewrite() override;
-//void addPreSched2() override;
+  void addPreSched2() override;
+  void addPreEmitPass() override;
 };
 } // namespace
 
@@ -169,6 +172,14 @@ TargetPassConfig *Z80TargetMachine::createPassConfig(PassManagerBase &PM) {
   return new Z80PassConfig(*this, PM);
 }
 
+void Z80PassConfig::addIRPasses() {
+  addPass(createZ80StaticLocalsPass());
+  TargetPassConfig::addIRPasses();
+  if (getOptLevel() != CodeGenOpt::None) {
+    addPass(createZ80LoopCountersPass());
+  }
+}
+
 void Z80PassConfig::addCodeGenPrepare() {
   addPass(createLowerSwitchPass());
   TargetPassConfig::addCodeGenPrepare();
@@ -180,21 +191,38 @@ bool Z80PassConfig::addInstSelector() {
   return false;
 }
 
-/*void Z80PassConfig::addPreRegAlloc() {
+void Z80PassConfig::addPreRegAlloc() {
   TargetPassConfig::addPreRegAlloc();
+  if (getOptLevel() != CodeGenOpt::None) {
+    //addPass(createZ80CallFrameOptimization());
+    addPass(createZ80HardwareLoopsPass());
+  }
+}
+
+void Z80PassConfig::addPostRegAlloc() {
+  // Spill slots have to be rewritten before frame indices are eliminated.
   if (getOptLevel() != CodeGenOpt::None)
-    ;//addPass(createZ80CallFrameOptimization());
+    addPass(createZ80ShadowSpillsPass());
 }
 
-bool Z80PassConfig::addPreRewrite() {
+/*bool Z80PassConfig::addPreRewrite() {
   //addPass(createZ80ExpandPseudoPass());
   return TargetPassConfig::addPreRewrite();
 }
+*/
 
 void Z80PassConfig::addPreSched2() {
+  addPass(createZ80ExpandPseudoPass());
   // Z80MachineLateOptimization pass must be run after ExpandPostRAPseudos
-  if (getOptLevel() != CodeGenOpt::None)
+  if (getOptLevel() != CodeGenOpt::None) {
+    addPass(createZ80KnownValuesPass());
     addPass(createZ80MachineLateOptimization());
+  }
   TargetPassConfig::addPreSched2();
 }
-*/
+
+void Z80PassConfig::addPreEmitPass() {
+  if (getOptLevel() != CodeGenOpt::None)
+    addPass(createZ80FormDJNZPass());
+  addPass(createZ80BranchSelectorPass());
+}
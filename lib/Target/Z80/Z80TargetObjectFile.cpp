@@ -11,13 +11,13 @@
 
 #include "Z80Subtarget.h"
 #include "Z80TargetMachine.h"
+#include "llvm/BinaryFormat/ELF.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/MC/MCContext.h"
 #include "llvm/MC/MCSectionELF.h"
 #include "llvm/Support/CommandLine.h"
-//#include "llvm/Support/ELF.h"
 #include "llvm/Target/TargetMachine.h"
 using namespace llvm;
 
@@ -37,6 +37,9 @@ void Z80TargetObjectFile::Initialize(MCContext &Ctx, const TargetMachine &TM) {
   SmallBSSSection = getContext().getELFSection(".sbss", ELF::SHT_NOBITS,
                                                ELF::SHF_WRITE | ELF::SHF_ALLOC);
 #endif // 0
+  StaticFrameSection = getContext().getELFSection(
+                         ".bss.frames", ELF::SHT_NOBITS,
+                         ELF::SHF_WRITE | ELF::SHF_ALLOC);
   this->TM = &static_cast<const Z80TargetMachine &>(TM);
 }
 
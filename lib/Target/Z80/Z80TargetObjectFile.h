@@ -20,11 +20,16 @@ class Z80TargetMachine;
 class Z80TargetObjectFile : public TargetLoweringObjectFileELF {
   MCSection *SmallDataSection;
   MCSection *SmallBSSSection;
+  MCSection *StaticFrameSection;
   const Z80TargetMachine *TM;
 public:
 
   void Initialize(MCContext &Ctx, const TargetMachine &TM) override;
 
+  /// getStaticFrameSection - The section of the storage shared by the static
+  /// frames of a module, see Z80StaticLocals.cpp.
+  MCSection *getStaticFrameSection() const { return StaticFrameSection; }
+
 };
 } // end namespace llvm
 
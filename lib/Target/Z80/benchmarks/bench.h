@@ -0,0 +1,41 @@
+/* Common definitions of the Z80 code generation benchmarks.
+ *
+ * Each benchmark is a main() that runs its kernel on fixed input, checks the
+ * result and returns 0 if it is right.  The kernels only use what the backend
+ * lowers without a runtime library: no multiplication, division or variable
+ * shifts, which are done in C where a kernel needs them.
+ *
+ * The types have the same width on the Z80 and on the host, where the
+ * expected results were computed.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+typedef __INT8_TYPE__ int8_t;
+typedef __UINT8_TYPE__ uint8_t;
+typedef __INT16_TYPE__ int16_t;
+typedef __UINT16_TYPE__ uint16_t;
+typedef __INT32_TYPE__ int32_t;
+typedef __UINT32_TYPE__ uint32_t;
+
+/* Pseudo-random input, from a 16-bit xorshift generator. */
+static uint16_t bench_seed = 1;
+
+static uint16_t bench_rand(void)
+{
+	uint16_t x = bench_seed;
+	x ^= (uint16_t)(x << 7);
+	x ^= (uint16_t)(x >> 9);
+	x ^= (uint16_t)(x << 8);
+	bench_seed = x;
+	return x;
+}
+
+static void bench_fill(uint8_t *buf, uint16_t len)
+{
+	uint16_t i;
+	for (i = 0; i < len; i++)
+		buf[i] = (uint8_t)bench_rand();
+}
+
+#endif
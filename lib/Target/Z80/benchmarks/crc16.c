@@ -0,0 +1,59 @@
+/* CRC-16/CCITT, bit by bit and through a table. */
+#include "bench.h"
+
+static uint8_t data[512];
+static uint16_t table[256];
+
+static const uint8_t check[] = "123456789";
+
+static uint16_t crc16_byte(uint16_t crc, uint8_t byte)
+{
+	uint8_t bit;
+	crc ^= (uint16_t)((uint16_t)byte << 8);
+	for (bit = 0; bit < 8; bit++)
+	{
+		if (crc & 0x8000)
+			crc = (uint16_t)(crc << 1) ^ 0x1021;
+		else
+			crc = (uint16_t)(crc << 1);
+	}
+	return crc;
+}
+
+static uint16_t crc16_bitwise(const uint8_t *p, uint16_t len)
+{
+	uint16_t crc = 0xFFFF;
+	while (len--)
+		crc = crc16_byte(crc, *p++);
+	return crc;
+}
+
+static void crc16_init_table(void)
+{
+	uint16_t i;
+	for (i = 0; i < 256; i++)
+		table[i] = crc16_byte(0, (uint8_t)i);
+}
+
+static uint16_t crc16_table(const uint8_t *p, uint16_t len)
+{
+	uint16_t crc = 0xFFFF;
+	while (len--)
+		crc = (uint16_t)(crc << 8) ^ table[(uint8_t)(crc >> 8) ^ *p++];
+	return crc;
+}
+
+int main(void)
+{
+	if (crc16_bitwise(check, 9) != 0x29B1)
+		return 1;
+	bench_fill(data, sizeof(data));
+	if (crc16_bitwise(data, sizeof(data)) != 0x2B87)
+		return 2;
+	crc16_init_table();
+	if (crc16_table(check, 9) != 0x29B1)
+		return 3;
+	if (crc16_table(data, sizeof(data)) != 0x2B87)
+		return 4;
+	return 0;
+}
@@ -0,0 +1,34 @@
+/* CRC-32 as used by zip and ethernet, reflected, bit by bit. */
+#include "bench.h"
+
+static uint8_t data[256];
+
+static const uint8_t check[] = "123456789";
+
+static uint32_t crc32(const uint8_t *p, uint16_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	uint8_t bit;
+	while (len--)
+	{
+		crc ^= *p++;
+		for (bit = 0; bit < 8; bit++)
+		{
+			if (crc & 1)
+				crc = (crc >> 1) ^ 0xEDB88320;
+			else
+				crc >>= 1;
+		}
+	}
+	return ~crc;
+}
+
+int main(void)
+{
+	if (crc32(check, 9) != 0xCBF43926)
+		return 1;
+	bench_fill(data, sizeof(data));
+	if (crc32(data, sizeof(data)) != 0xFB9ADFDC)
+		return 2;
+	return 0;
+}
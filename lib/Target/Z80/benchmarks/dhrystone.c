@@ -0,0 +1,265 @@
+/* A Dhrystone style mix of procedure calls, record and pointer handling,
+ * string copies and compares, and enumerations.  Dhrystone's multiplications
+ * and divisions are replaced by shifts, adds and subtractions.
+ */
+#include "bench.h"
+
+#define RUNS 50
+
+typedef enum { Ident_1, Ident_2, Ident_3, Ident_4, Ident_5 } Enumeration;
+
+typedef struct record
+{
+	struct record *Ptr_Comp;
+	Enumeration Discr;
+	Enumeration Enum_Comp;
+	int16_t Int_Comp;
+	char Str_Comp[31];
+} Rec_Type, *Rec_Pointer;
+
+static Rec_Type Rec_1, Rec_2;
+static Rec_Pointer Ptr_Glob, Next_Ptr_Glob;
+static int16_t Int_Glob;
+static uint8_t Bool_Glob;
+static char Ch_1_Glob, Ch_2_Glob;
+static int16_t Arr_1_Glob[32];
+static int16_t Arr_2_Glob[32][32];
+
+static void str_copy(char *d, const char *s)
+{
+	while ((*d++ = *s++) != 0)
+		;
+}
+
+static int16_t str_compare(const char *a, const char *b)
+{
+	while (*a && *a == *b)
+	{
+		a++;
+		b++;
+	}
+	return (int16_t)((uint8_t)*a - (uint8_t)*b);
+}
+
+static uint8_t Func_3(Enumeration Enum_Par_Val)
+{
+	return Enum_Par_Val == Ident_3;
+}
+
+static Enumeration Func_1(char Ch_1_Par_Val, char Ch_2_Par_Val)
+{
+	char Ch_1_Loc = Ch_1_Par_Val;
+	char Ch_2_Loc = Ch_1_Loc;
+	if (Ch_2_Loc != Ch_2_Par_Val)
+		return Ident_1;
+	Ch_1_Glob = Ch_1_Loc;
+	return Ident_2;
+}
+
+static uint8_t Func_2(const char *Str_1_Par_Ref, const char *Str_2_Par_Ref)
+{
+	int16_t Int_Loc = 2;
+	char Ch_Loc = 'A';
+	while (Int_Loc <= 2)
+	{
+		if (Func_1(Str_1_Par_Ref[Int_Loc], Str_2_Par_Ref[Int_Loc + 1]) ==
+			Ident_1)
+		{
+			Ch_Loc = 'A';
+			Int_Loc += 1;
+		}
+	}
+	if (Ch_Loc >= 'W' && Ch_Loc < 'Z')
+		Int_Loc = 7;
+	if (Ch_Loc == 'R')
+		return 1;
+	if (str_compare(Str_1_Par_Ref, Str_2_Par_Ref) > 0)
+	{
+		Int_Loc += 7;
+		Int_Glob = Int_Loc;
+		return 1;
+	}
+	return 0;
+}
+
+static void Proc_6(Enumeration Enum_Val_Par, Enumeration *Enum_Ref_Par)
+{
+	*Enum_Ref_Par = Enum_Val_Par;
+	if (!Func_3(Enum_Val_Par))
+		*Enum_Ref_Par = Ident_4;
+	switch (Enum_Val_Par)
+	{
+	case Ident_1:
+		*Enum_Ref_Par = Ident_1;
+		break;
+	case Ident_2:
+		*Enum_Ref_Par = Int_Glob > 100 ? Ident_1 : Ident_4;
+		break;
+	case Ident_3:
+		*Enum_Ref_Par = Ident_2;
+		break;
+	case Ident_4:
+		break;
+	case Ident_5:
+		*Enum_Ref_Par = Ident_3;
+		break;
+	}
+}
+
+static void Proc_7(int16_t Int_1_Par_Val, int16_t Int_2_Par_Val,
+	int16_t *Int_Par_Ref)
+{
+	int16_t Int_Loc = Int_1_Par_Val + 2;
+	*Int_Par_Ref = Int_2_Par_Val + Int_Loc;
+}
+
+static void Proc_8(int16_t *Arr_1_Par_Ref, int16_t (*Arr_2_Par_Ref)[32],
+	int16_t Int_1_Par_Val, int16_t Int_2_Par_Val)
+{
+	int16_t Int_Index;
+	int16_t Int_Loc = Int_1_Par_Val + 5;
+	Arr_1_Par_Ref[Int_Loc] = Int_2_Par_Val;
+	Arr_1_Par_Ref[Int_Loc + 1] = Arr_1_Par_Ref[Int_Loc];
+	Arr_1_Par_Ref[Int_Loc + 15] = Int_Loc;
+	for (Int_Index = Int_Loc; Int_Index <= Int_Loc + 1; ++Int_Index)
+		Arr_2_Par_Ref[Int_Loc][Int_Index] = Int_Loc;
+	Arr_2_Par_Ref[Int_Loc][Int_Loc - 1] += 1;
+	Arr_2_Par_Ref[Int_Loc + 15][Int_Loc] = Arr_1_Par_Ref[Int_Loc];
+	Int_Glob = 5;
+}
+
+static void Proc_3(Rec_Pointer *Ptr_Ref_Par)
+{
+	if (Ptr_Glob)
+		*Ptr_Ref_Par = Ptr_Glob->Ptr_Comp;
+	Proc_7(10, Int_Glob, &Ptr_Glob->Int_Comp);
+}
+
+static void Proc_1(Rec_Pointer Ptr_Val_Par)
+{
+	Rec_Pointer Next_Record = Ptr_Val_Par->Ptr_Comp;
+	*Ptr_Val_Par->Ptr_Comp = *Ptr_Glob;
+	Ptr_Val_Par->Int_Comp = 5;
+	Next_Record->Int_Comp = Ptr_Val_Par->Int_Comp;
+	Next_Record->Ptr_Comp = Ptr_Val_Par->Ptr_Comp;
+	Proc_3(&Next_Record->Ptr_Comp);
+	if (Next_Record->Discr == Ident_1)
+	{
+		Next_Record->Int_Comp = 6;
+		Proc_6(Ptr_Val_Par->Enum_Comp, &Next_Record->Enum_Comp);
+		Next_Record->Ptr_Comp = Ptr_Glob->Ptr_Comp;
+		Proc_7(Next_Record->Int_Comp, 10, &Next_Record->Int_Comp);
+	}
+	else
+		*Ptr_Val_Par = *Ptr_Val_Par->Ptr_Comp;
+}
+
+static void Proc_2(int16_t *Int_Par_Ref)
+{
+	int16_t Int_Loc = *Int_Par_Ref + 10;
+	Enumeration Enum_Loc = Ident_2;
+	do
+	{
+		if (Ch_1_Glob == 'A')
+		{
+			Int_Loc -= 1;
+			*Int_Par_Ref = Int_Loc - Int_Glob;
+			Enum_Loc = Ident_1;
+		}
+	} while (Enum_Loc != Ident_1);
+}
+
+static void Proc_4(void)
+{
+	uint8_t Bool_Loc = Ch_1_Glob == 'A';
+	Bool_Glob = Bool_Loc | Bool_Glob;
+	Ch_2_Glob = 'B';
+}
+
+static void Proc_5(void)
+{
+	Ch_1_Glob = 'A';
+	Bool_Glob = 0;
+}
+
+int main(void)
+{
+	int16_t Int_1_Loc = 0, Int_2_Loc = 0, Int_3_Loc = 0;
+	char Ch_Index;
+	Enumeration Enum_Loc = Ident_1;
+	char Str_1_Loc[31];
+	char Str_2_Loc[31];
+	uint16_t Run_Index;
+	uint16_t sum;
+
+	Next_Ptr_Glob = &Rec_2;
+	Ptr_Glob = &Rec_1;
+	Ptr_Glob->Ptr_Comp = Next_Ptr_Glob;
+	Ptr_Glob->Discr = Ident_1;
+	Ptr_Glob->Enum_Comp = Ident_3;
+	Ptr_Glob->Int_Comp = 40;
+	str_copy(Ptr_Glob->Str_Comp, "DHRYSTONE PROGRAM, SOME STRING");
+	str_copy(Str_1_Loc, "DHRYSTONE PROGRAM, 1'ST STRING");
+	Arr_2_Glob[8][7] = 10;
+
+	for (Run_Index = 1; Run_Index <= RUNS; ++Run_Index)
+	{
+		Proc_5();
+		Proc_4();
+		Int_1_Loc = 2;
+		Int_2_Loc = 3;
+		str_copy(Str_2_Loc, "DHRYSTONE PROGRAM, 2'ND STRING");
+		Enum_Loc = Ident_2;
+		Bool_Glob = !Func_2(Str_1_Loc, Str_2_Loc);
+		while (Int_1_Loc < Int_2_Loc)
+		{
+			/* Int_3_Loc = 5 * Int_1_Loc - Int_2_Loc */
+			Int_3_Loc = (int16_t)((Int_1_Loc << 2) + Int_1_Loc - Int_2_Loc);
+			Proc_7(Int_1_Loc, Int_2_Loc, &Int_3_Loc);
+			Int_1_Loc += 1;
+		}
+		Proc_8(Arr_1_Glob, Arr_2_Glob, Int_1_Loc, Int_3_Loc);
+		Proc_1(Ptr_Glob);
+		for (Ch_Index = 'A'; Ch_Index <= Ch_2_Glob; ++Ch_Index)
+		{
+			if (Enum_Loc == Func_1(Ch_Index, 'C'))
+			{
+				Proc_6(Ident_1, &Enum_Loc);
+				str_copy(Str_2_Loc, "DHRYSTONE PROGRAM, 3'RD STRING");
+				Int_2_Loc = (int16_t)Run_Index;
+				Int_Glob = (int16_t)Run_Index;
+			}
+		}
+		/* Int_2_Loc = Int_2_Loc * Int_1_Loc, with Int_1_Loc == 3 */
+		Int_2_Loc = (int16_t)((Int_2_Loc << 1) + Int_2_Loc);
+		/* Int_1_Loc = Int_2_Loc / Int_3_Loc, with Int_3_Loc == 7 */
+		Int_1_Loc = 0;
+		while (Int_2_Loc >= Int_3_Loc)
+		{
+			Int_2_Loc -= Int_3_Loc;
+			Int_1_Loc++;
+		}
+		Int_2_Loc = (int16_t)((Int_1_Loc << 3) - Int_1_Loc) - Int_2_Loc;
+		Proc_2(&Int_1_Loc);
+	}
+
+	sum = (uint16_t)Int_Glob;
+	sum = (uint16_t)(sum << 1) ^ Bool_Glob;
+	sum = (uint16_t)(sum << 1) ^ (uint8_t)Ch_1_Glob;
+	sum = (uint16_t)(sum << 1) ^ (uint8_t)Ch_2_Glob;
+	sum = (uint16_t)(sum << 1) ^ (uint16_t)Arr_1_Glob[8];
+	sum = (uint16_t)(sum << 1) ^ (uint16_t)Arr_2_Glob[8][7];
+	sum = (uint16_t)(sum << 1) ^ (uint16_t)Ptr_Glob->Int_Comp;
+	sum = (uint16_t)(sum << 1) ^ (uint16_t)Next_Ptr_Glob->Int_Comp;
+	sum = (uint16_t)(sum << 1) ^ (uint16_t)Next_Ptr_Glob->Enum_Comp;
+	sum = (uint16_t)(sum << 1) ^ (uint16_t)Int_1_Loc;
+	sum = (uint16_t)(sum << 1) ^ (uint16_t)Int_2_Loc;
+	sum = (uint16_t)(sum << 1) ^ (uint16_t)Int_3_Loc;
+	sum = (uint16_t)(sum << 1) ^ (uint16_t)Enum_Loc;
+	sum = (uint16_t)(sum << 1) ^ (uint8_t)Str_2_Loc[19];
+	if (str_compare(Str_2_Loc, "DHRYSTONE PROGRAM, 2'ND STRING") != 0)
+		return 1;
+	if (sum != 0x8E74)
+		return 2;
+	return 0;
+}
@@ -0,0 +1,58 @@
+/* A 16 tap low-pass FIR filter in Q15 fixed point, with the multiplication
+ * done by shift and add as Z80 code does it.
+ */
+#include "bench.h"
+
+#define TAPS 16
+#define SAMPLES 64
+
+static const int16_t coefs[TAPS] =
+{
+	-332, -512, -487, 0, 1024, 2396, 3705, 4474,
+	4474, 3705, 2396, 1024, 0, -487, -512, -332
+};
+
+static int16_t input[SAMPLES + TAPS - 1];
+static int16_t output[SAMPLES];
+
+static int32_t mul16(int16_t a, int16_t b)
+{
+	uint16_t x = a < 0 ? (uint16_t)(0 - (uint16_t)a) : (uint16_t)a;
+	uint16_t y = b < 0 ? (uint16_t)(0 - (uint16_t)b) : (uint16_t)b;
+	uint32_t wide = x;
+	uint32_t product = 0;
+	while (y)
+	{
+		if (y & 1)
+			product += wide;
+		wide <<= 1;
+		y >>= 1;
+	}
+	return (a < 0) != (b < 0) ? -(int32_t)product : (int32_t)product;
+}
+
+static void fir(const int16_t *in, int16_t *out, uint16_t n)
+{
+	uint16_t i;
+	uint8_t k;
+	for (i = 0; i < n; i++)
+	{
+		int32_t acc = 0;
+		for (k = 0; k < TAPS; k++)
+			acc += mul16(coefs[k], in[i + k]);
+		out[i] = (int16_t)(acc >> 15);
+	}
+}
+
+int main(void)
+{
+	uint16_t i, sum = 0;
+	for (i = 0; i < SAMPLES + TAPS - 1; i++)
+		input[i] = (int16_t)((int16_t)bench_rand() >> 2);
+	fir(input, output, SAMPLES);
+	for (i = 0; i < SAMPLES; i++)
+		sum = (uint16_t)((uint16_t)(sum << 1) | (sum >> 15)) ^ (uint16_t)output[i];
+	if (sum != 0x1DF9)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,129 @@
+/* printf style formatting of numbers and strings into a buffer.  Decimal
+ * digits come from subtracting powers of ten, as there is no division.
+ */
+#include "bench.h"
+
+struct arg
+{
+	uint16_t n;
+	const char *s;
+};
+
+static const uint16_t powers[] = { 10000, 1000, 100, 10, 1 };
+static const char hex_digits[] = "0123456789abcdef";
+
+static char buffer[256];
+
+static char *put_unsigned(char *p, uint16_t v)
+{
+	uint8_t i, started = 0;
+	for (i = 0; i < 5; i++)
+	{
+		char digit = '0';
+		while (v >= powers[i])
+		{
+			v -= powers[i];
+			digit++;
+		}
+		if (digit != '0' || started || i == 4)
+		{
+			*p++ = digit;
+			started = 1;
+		}
+	}
+	return p;
+}
+
+static char *put_hex(char *p, uint16_t v)
+{
+	uint8_t i;
+	for (i = 0; i < 4; i++)
+	{
+		*p++ = hex_digits[(uint8_t)(v >> 12)];
+		v = (uint16_t)(v << 4);
+	}
+	return p;
+}
+
+/* Format fmt into buf, taking the operands of %d, %u, %x, %c and %s from
+ * args.  Returns the length.
+ */
+static uint16_t format(char *buf, const char *fmt, const struct arg *args)
+{
+	char *p = buf;
+	const char *s;
+	for (; *fmt; fmt++)
+	{
+		if (*fmt != '%')
+		{
+			*p++ = *fmt;
+			continue;
+		}
+		switch (*++fmt)
+		{
+		case 'd':
+			if ((int16_t)args->n < 0)
+			{
+				*p++ = '-';
+				p = put_unsigned(p, (uint16_t)(0 - args->n));
+			}
+			else
+				p = put_unsigned(p, args->n);
+			args++;
+			break;
+		case 'u':
+			p = put_unsigned(p, args->n);
+			args++;
+			break;
+		case 'x':
+			p = put_hex(p, args->n);
+			args++;
+			break;
+		case 'c':
+			*p++ = (char)args->n;
+			args++;
+			break;
+		case 's':
+			for (s = args->s; *s; s++)
+				*p++ = *s;
+			args++;
+			break;
+		default:
+			*p++ = *fmt;
+			break;
+		}
+	}
+	*p = 0;
+	return (uint16_t)(p - buf);
+}
+
+static uint8_t equal(const char *a, const char *b)
+{
+	while (*a && *a == *b)
+	{
+		a++;
+		b++;
+	}
+	return *a == *b;
+}
+
+static const struct arg args[] =
+{
+	{ 42, 0 }, { (uint16_t)-1234, 0 }, { 65535, 0 }, { 0xBEEF, 0 },
+	{ 'z', 0 }, { 0, "eighty" }, { 0, 0 }, { 100, 0 }
+};
+
+int main(void)
+{
+	uint16_t i, len = 0;
+	for (i = 0; i < 20; i++)
+	{
+		len = format(buffer, "n=%d m=%d u=%u x=%x c=%c s=%s z=%u%%%u", args);
+		if (!equal(buffer,
+			"n=42 m=-1234 u=65535 x=beef c=z s=eighty z=0%100"))
+			return 1;
+	}
+	if (len != 48)
+		return 2;
+	return 0;
+}
@@ -0,0 +1,228 @@
+/* State machines: a tokenizer for a small C like language, and a receiver
+ * for framed, checksummed packets.
+ */
+#include "bench.h"
+
+static const char source[] =
+	"/* sample */ int count = 42;\n"
+	"while (count > 0) { count = count - 7; total += 0x1F; }\n"
+	"// done\n"
+	"if (total >= 1000) reset(total, 'x'); else step(3, count);\n";
+
+enum token_state
+{
+	S_START, S_IDENT, S_NUMBER, S_HEX, S_SLASH, S_LINE_COMMENT,
+	S_BLOCK_COMMENT, S_BLOCK_STAR, S_CHAR, S_CHAR_END, S_OPERATOR
+};
+
+struct token_counts
+{
+	uint16_t idents, numbers, operators, comments, chars, value_sum;
+};
+
+static uint8_t is_alpha(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static uint8_t is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static uint8_t hex_value(char c)
+{
+	if (c >= 'a')
+		return (uint8_t)(c - 'a' + 10);
+	if (c >= 'A')
+		return (uint8_t)(c - 'A' + 10);
+	return (uint8_t)(c - '0');
+}
+
+static void tokenize(const char *p, struct token_counts *counts)
+{
+	enum token_state state = S_START;
+	uint16_t value = 0;
+	char c;
+	do
+	{
+		c = *p++;
+		switch (state)
+		{
+		case S_IDENT:
+			if (is_alpha(c) || is_digit(c))
+				continue;
+			counts->idents++;
+			break;
+		case S_NUMBER:
+			if (is_digit(c))
+			{
+				/* value * 10 + digit */
+				value = (uint16_t)((uint16_t)(value << 3) + (uint16_t)(value << 1) +
+					(uint8_t)(c - '0'));
+				continue;
+			}
+			if ((c == 'x' || c == 'X') && value == 0)
+			{
+				state = S_HEX;
+				continue;
+			}
+			counts->numbers++;
+			counts->value_sum += value;
+			break;
+		case S_HEX:
+			if (is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))
+			{
+				value = (uint16_t)(value << 4) | hex_value(c);
+				continue;
+			}
+			counts->numbers++;
+			counts->value_sum += value;
+			break;
+		case S_SLASH:
+			if (c == '/')
+			{
+				state = S_LINE_COMMENT;
+				continue;
+			}
+			if (c == '*')
+			{
+				state = S_BLOCK_COMMENT;
+				continue;
+			}
+			counts->operators++;
+			break;
+		case S_LINE_COMMENT:
+			if (c != '\n' && c)
+				continue;
+			counts->comments++;
+			break;
+		case S_BLOCK_COMMENT:
+			if (c == '*')
+				state = S_BLOCK_STAR;
+			continue;
+		case S_BLOCK_STAR:
+			if (c == '/')
+			{
+				counts->comments++;
+				state = S_START;
+			}
+			else if (c != '*')
+				state = S_BLOCK_COMMENT;
+			continue;
+		case S_CHAR:
+			counts->value_sum += (uint8_t)c;
+			state = S_CHAR_END;
+			continue;
+		case S_CHAR_END:
+			counts->chars++;
+			state = S_START;
+			continue;
+		case S_OPERATOR:
+			if (c == '=')
+				continue;
+			counts->operators++;
+			break;
+		case S_START:
+			break;
+		}
+
+		/* Start a new token with c. */
+		if (is_alpha(c))
+			state = S_IDENT;
+		else if (is_digit(c))
+		{
+			state = S_NUMBER;
+			value = (uint8_t)(c - '0');
+		}
+		else if (c == '/')
+			state = S_SLASH;
+		else if (c == '\'')
+			state = S_CHAR;
+		else if (c == '<' || c == '>' || c == '=' || c == '!' || c == '+' ||
+			c == '-')
+			state = S_OPERATOR;
+		else
+		{
+			if (c == ';' || c == ',' || c == '(' || c == ')' || c == '{' ||
+				c == '}')
+				counts->operators++;
+			state = S_START;
+		}
+	} while (c);
+}
+
+/* Packets are 0x7E, a length, that many bytes and their sum. */
+enum packet_state { P_IDLE, P_LENGTH, P_PAYLOAD, P_CHECKSUM };
+
+struct receiver
+{
+	enum packet_state state;
+	uint8_t length, received, sum;
+	uint16_t good, bad, payload_sum;
+};
+
+static void receive(struct receiver *r, uint8_t byte)
+{
+	switch (r->state)
+	{
+	case P_IDLE:
+		if (byte == 0x7E)
+			r->state = P_LENGTH;
+		break;
+	case P_LENGTH:
+		r->length = byte;
+		r->received = 0;
+		r->sum = 0;
+		r->state = byte ? P_PAYLOAD : P_CHECKSUM;
+		break;
+	case P_PAYLOAD:
+		r->sum += byte;
+		r->payload_sum += byte;
+		if (++r->received == r->length)
+			r->state = P_CHECKSUM;
+		break;
+	case P_CHECKSUM:
+		if (byte == r->sum)
+			r->good++;
+		else
+			r->bad++;
+		r->state = P_IDLE;
+		break;
+	}
+}
+
+int main(void)
+{
+	struct token_counts counts = { 0, 0, 0, 0, 0, 0 };
+	struct receiver r = { P_IDLE, 0, 0, 0, 0, 0, 0 };
+	uint16_t i;
+	uint8_t j;
+
+	for (i = 0; i < 4; i++)
+		tokenize(source, &counts);
+	if (counts.idents != 56 || counts.numbers != 24 ||
+		counts.operators != 92 || counts.comments != 8 || counts.chars != 4 ||
+		counts.value_sum != 4812)
+		return 1;
+
+	for (i = 0; i < 64; i++)
+	{
+		uint8_t length = (uint8_t)(bench_rand() & 15);
+		uint8_t sum = 0;
+		receive(&r, (uint8_t)bench_rand());
+		receive(&r, 0x7E);
+		receive(&r, length);
+		for (j = 0; j < length; j++)
+		{
+			uint8_t byte = (uint8_t)bench_rand();
+			sum += byte;
+			receive(&r, byte);
+		}
+		/* Corrupt every eighth packet. */
+		receive(&r, (i & 7) ? sum : (uint8_t)(sum + 1));
+	}
+	if (r.good != 56 || r.bad != 8 || r.payload_sum != 0x0832)
+		return 2;
+	return 0;
+}
@@ -0,0 +1,58 @@
+/* Byte copy and fill loops of the kind memcpy and memset are made of. */
+#include "bench.h"
+
+static uint8_t src[300];
+static uint8_t dst[300];
+
+static void *copy(void *d, const void *s, uint16_t n)
+{
+	uint8_t *dp = d;
+	const uint8_t *sp = s;
+	while (n--)
+		*dp++ = *sp++;
+	return d;
+}
+
+static void *fill(void *d, uint8_t c, uint16_t n)
+{
+	uint8_t *dp = d;
+	while (n--)
+		*dp++ = c;
+	return d;
+}
+
+/* Copy backwards, for overlapping moves to a higher address. */
+static void *move_up(void *d, const void *s, uint16_t n)
+{
+	uint8_t *dp = (uint8_t *)d + n;
+	const uint8_t *sp = (const uint8_t *)s + n;
+	while (n--)
+		*--dp = *--sp;
+	return d;
+}
+
+static uint16_t checksum(const uint8_t *p, uint16_t n)
+{
+	uint16_t sum = 0;
+	while (n--)
+		sum = (uint16_t)((uint16_t)(sum << 1) | (sum >> 15)) ^ *p++;
+	return sum;
+}
+
+int main(void)
+{
+	uint16_t len;
+	bench_fill(src, sizeof(src));
+	for (len = 1; len < 256; len += 23)
+	{
+		fill(dst, (uint8_t)len, sizeof(dst));
+		copy(dst + (len & 7), src + (len & 3), len);
+	}
+	if (checksum(dst, sizeof(dst)) != 0xC69E)
+		return 1;
+	copy(dst, src, sizeof(dst));
+	move_up(dst + 17, dst, 250);
+	if (checksum(dst, sizeof(dst)) != 0x8584)
+		return 2;
+	return 0;
+}
@@ -0,0 +1,126 @@
+/* Quicksort through a comparison function, as qsort does it, on an array of
+ * integers and on an array of records.
+ */
+#include "bench.h"
+
+typedef int (*compare_fn)(const void *, const void *);
+
+struct record
+{
+	uint8_t key;
+	uint8_t tag;
+	uint16_t value;
+};
+
+static int16_t numbers[128];
+static struct record records[64];
+
+static void swap(uint8_t *a, uint8_t *b, uint16_t size)
+{
+	while (size--)
+	{
+		uint8_t t = *a;
+		*a++ = *b;
+		*b++ = t;
+	}
+}
+
+/* Sort the elements from lo to hi, both included. */
+static void sort(uint8_t *lo, uint8_t *hi, uint16_t size, compare_fn cmp)
+{
+	while (lo < hi)
+	{
+		uint8_t *store = lo;
+		uint8_t *p;
+		for (p = lo; p < hi; p += size)
+		{
+			if (cmp(p, hi) < 0)
+			{
+				swap(p, store, size);
+				store += size;
+			}
+		}
+		swap(store, hi, size);
+		/* Recurse into the smaller part and loop on the larger one, so the
+		 * stack stays shallow. */
+		if (store - lo < hi - store)
+		{
+			if (store > lo)
+				sort(lo, store - size, size, cmp);
+			lo = store + size;
+		}
+		else
+		{
+			if (store < hi)
+				sort(store + size, hi, size, cmp);
+			hi = store - size;
+		}
+	}
+}
+
+static void bench_qsort(void *base, uint16_t n, uint16_t size, compare_fn cmp)
+{
+	uint8_t *last = base;
+	if (n < 2)
+		return;
+	while (--n)
+		last += size;
+	sort(base, last, size, cmp);
+}
+
+static int compare_numbers(const void *a, const void *b)
+{
+	int16_t x = *(const int16_t *)a;
+	int16_t y = *(const int16_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static int compare_records(const void *a, const void *b)
+{
+	const struct record *x = a;
+	const struct record *y = b;
+	if (x->key != y->key)
+		return x->key < y->key ? -1 : 1;
+	return x->value < y->value ? -1 : x->value > y->value;
+}
+
+static uint16_t mix(uint16_t sum, uint16_t v)
+{
+	return (uint16_t)((uint16_t)(sum << 1) | (sum >> 15)) ^ v;
+}
+
+int main(void)
+{
+	uint16_t i, sum;
+
+	for (i = 0; i < 128; i++)
+		numbers[i] = (int16_t)bench_rand();
+	bench_qsort(numbers, 128, sizeof(numbers[0]), compare_numbers);
+	sum = 0;
+	for (i = 0; i < 128; i++)
+	{
+		if (i && numbers[i - 1] > numbers[i])
+			return 1;
+		sum = mix(sum, (uint16_t)numbers[i]);
+	}
+	if (sum != 0xD501)
+		return 2;
+
+	for (i = 0; i < 64; i++)
+	{
+		records[i].key = (uint8_t)(bench_rand() & 15);
+		records[i].tag = (uint8_t)i;
+		records[i].value = bench_rand();
+	}
+	bench_qsort(records, 64, sizeof(records[0]), compare_records);
+	sum = 0;
+	for (i = 0; i < 64; i++)
+	{
+		if (i && compare_records(&records[i - 1], &records[i]) > 0)
+			return 3;
+		sum = mix(sum, records[i].tag);
+	}
+	if (sum != 0x4CE9)
+		return 4;
+	return 0;
+}
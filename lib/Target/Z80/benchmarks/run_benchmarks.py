@@ -0,0 +1,212 @@
+#!/usr/bin/env python
+#
+# Runs the Z80 code generation benchmarks and compares them to the baselines.
+#
+# Each kernel in this directory is compiled with clang --target=z80 to LLVM IR
+# and with llc to an object file, at every optimization level, then linked
+# and run by llvm-z80sim together with runtime.c.  A kernel returns 0 when its
+# result is right.  For every run the code size of the kernel, the T-states
+# and the stack high-water mark are compared with baselines.json, and any
+# increase is reported as a regression.  A run without a baseline fails too,
+# so that a new kernel can't go unchecked.
+#
+# Usage:
+#   run_benchmarks.py --clang=<clang> --llc=<llc> --sim=<llvm-z80sim>
+#                     [--update] [--tolerance=<percent>] [kernel...]
+#
+# --update writes the results of the run to baselines.json, after a change
+# that makes the code better, or worse on purpose, or adds a kernel.
+#
+# The check-z80-perf build target runs this script with the tools of the
+# build.
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+
+# clang optimization level, and the llc one that goes with it.
+OPT_LEVELS = {'O0': 'O0', 'O1': 'O1', 'O2': 'O2', 'O3': 'O3', 'Os': 'O2',
+              'Oz': 'O2'}
+
+METRICS = ['size', 'tstates', 'stack']
+
+SHF_ALLOC = 0x2
+SHF_EXECINSTR = 0x4
+
+
+def code_size(path):
+    """Sum of the sizes of the code sections of an ELF32 object."""
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:4] != b'\x7fELF' or data[4:5] != b'\x01':
+        raise RuntimeError('%s is not an ELF32 file' % path)
+    shoff, = struct.unpack_from('<I', data, 0x20)
+    shentsize, shnum = struct.unpack_from('<HH', data, 0x2E)
+    size = 0
+    for i in range(shnum):
+        flags, = struct.unpack_from('<I', data, shoff + i * shentsize + 8)
+        sh_size, = struct.unpack_from('<I', data, shoff + i * shentsize + 20)
+        if flags & SHF_ALLOC and flags & SHF_EXECINSTR:
+            size += sh_size
+    return size
+
+
+def run(cmd):
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE,
+                            stderr=subprocess.STDOUT)
+    out = proc.communicate()[0].decode('utf-8', 'replace')
+    return proc.returncode, out
+
+
+def compile_c(args, source, obj, level, extra=[]):
+    ll = os.path.splitext(obj)[0] + '.ll'
+    rc, out = run([args.clang, '--target=z80', '-ffreestanding', '-' + level,
+                   '-I', BENCH_DIR, '-S', '-emit-llvm', '-o', ll, source] +
+                  extra)
+    if rc:
+        raise RuntimeError(out)
+    rc, out = run([args.llc, '-' + OPT_LEVELS[level], '-filetype=obj',
+                   '-o', obj, ll])
+    if rc:
+        raise RuntimeError(out)
+
+
+def parse_sim_output(out):
+    fields = {}
+    for line in out.splitlines():
+        m = re.match(r'^(Exit|Result|T-states|Stack usage):\s+(.*)$', line)
+        if m:
+            fields[m.group(1)] = m.group(2)
+    if 'T-states' not in fields:
+        raise RuntimeError(out)
+    return fields
+
+
+def run_kernel(args, kernel, level, runtime_obj):
+    source = os.path.join(BENCH_DIR, kernel + '.c')
+    obj = os.path.join(args.work_dir, '%s-%s.o' % (kernel, level))
+    compile_c(args, source, obj, level)
+    rc, out = run([args.sim, obj, runtime_obj])
+    fields = parse_sim_output(out)
+    result = {
+        'size': code_size(obj),
+        'tstates': int(fields['T-states']),
+        'stack': int(fields['Stack usage'].split()[0]),
+    }
+    m = re.search(r'HL=0x([0-9a-fA-F]+)', fields.get('Result', ''))
+    if fields.get('Exit') != 'returned':
+        result['error'] = fields.get('Exit', 'did not finish')
+    elif not m or int(m.group(1), 16) != 0:
+        result['error'] = 'wrong result, check %s failed' % (
+            int(m.group(1), 16) if m else '?')
+    return result
+
+
+def compare(result, baseline, tolerance):
+    """Regressions and improvements of result over baseline."""
+    worse, better = [], []
+    for metric in METRICS:
+        if metric not in baseline:
+            continue
+        old, new = baseline[metric], result[metric]
+        if new > old * (1 + tolerance / 100.0):
+            worse.append('%s %d -> %d' % (metric, old, new))
+        elif new < old:
+            better.append('%s %d -> %d' % (metric, old, new))
+    return worse, better
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Run the Z80 code generation benchmarks.')
+    parser.add_argument('--clang', default='clang')
+    parser.add_argument('--llc', default='llc')
+    parser.add_argument('--sim', default='llvm-z80sim')
+    parser.add_argument('--opt-levels', default='O0,Os,O2',
+                        help='comma separated clang optimization levels')
+    parser.add_argument('--baselines',
+                        default=os.path.join(BENCH_DIR, 'baselines.json'))
+    parser.add_argument('--update', action='store_true',
+                        help='write the results to the baselines')
+    parser.add_argument('--tolerance', type=float, default=0.0,
+                        help='percentage by which a metric may grow')
+    parser.add_argument('--work-dir', help='directory for the objects')
+    parser.add_argument('kernels', nargs='*', help='kernels to run, all by '
+                        'default')
+    args = parser.parse_args()
+
+    if not args.work_dir:
+        args.work_dir = tempfile.mkdtemp(prefix='z80-perf-')
+    elif not os.path.isdir(args.work_dir):
+        os.makedirs(args.work_dir)
+
+    kernels = args.kernels or sorted(
+        os.path.splitext(f)[0] for f in os.listdir(BENCH_DIR)
+        if f.endswith('.c') and f != 'runtime.c')
+    levels = args.opt_levels.split(',')
+    for level in levels:
+        if level not in OPT_LEVELS:
+            parser.error('unknown optimization level %s' % level)
+
+    baselines = {}
+    if os.path.exists(args.baselines):
+        with open(args.baselines) as f:
+            baselines = json.load(f)
+
+    failed = regressed = missing = False
+    print('%-12s %-4s %8s %10s %6s  %s' % ('Kernel', 'Opt', 'Size',
+                                           'T-states', 'Stack', 'Status'))
+    for level in levels:
+        runtime_obj = os.path.join(args.work_dir, 'runtime-%s.o' % level)
+        compile_c(args, os.path.join(BENCH_DIR, 'runtime.c'), runtime_obj,
+                  level, ['-fno-builtin'])
+        for kernel in kernels:
+            try:
+                result = run_kernel(args, kernel, level, runtime_obj)
+            except RuntimeError as e:
+                print('%-12s %-4s failed:\n%s' % (kernel, level, e))
+                failed = True
+                continue
+            if 'error' in result:
+                status = 'FAIL: ' + result['error']
+                failed = True
+            else:
+                baseline = baselines.get(kernel, {}).get(level)
+                if baseline is None:
+                    status = 'FAIL: no baseline'
+                    missing = True
+                else:
+                    worse, better = compare(result, baseline, args.tolerance)
+                    if worse:
+                        status = 'REGRESSED: ' + ', '.join(worse)
+                        regressed = True
+                    elif better:
+                        status = 'improved: ' + ', '.join(better)
+                    else:
+                        status = 'ok'
+                if args.update:
+                    baselines.setdefault(kernel, {})[level] = dict(
+                        (m, result[m]) for m in METRICS)
+            print('%-12s %-4s %8d %10d %6d  %s' % (
+                kernel, level, result['size'], result['tstates'],
+                result['stack'], status))
+
+    if args.update:
+        with open(args.baselines, 'w') as f:
+            json.dump(baselines, f, indent=2, sort_keys=True)
+            f.write('\n')
+        print('Updated %s' % args.baselines)
+    return 1 if failed or ((regressed or missing) and not args.update) else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
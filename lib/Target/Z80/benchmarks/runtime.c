@@ -0,0 +1,34 @@
+/* The library functions that code generation calls by itself, for block
+ * copies and fills.  Built with -fno-builtin, so the loops are not turned
+ * back into calls.
+ */
+
+void *memcpy(void *d, const void *s, unsigned int n)
+{
+	unsigned char *dp = d;
+	const unsigned char *sp = s;
+	while (n--)
+		*dp++ = *sp++;
+	return d;
+}
+
+void *memmove(void *d, const void *s, unsigned int n)
+{
+	unsigned char *dp = d;
+	const unsigned char *sp = s;
+	if (dp <= sp)
+		return memcpy(d, s, n);
+	dp += n;
+	sp += n;
+	while (n--)
+		*--dp = *--sp;
+	return d;
+}
+
+void *memset(void *d, int c, unsigned int n)
+{
+	unsigned char *dp = d;
+	while (n--)
+		*dp++ = (unsigned char)c;
+	return d;
+}
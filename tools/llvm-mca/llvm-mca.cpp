@@ -404,19 +404,24 @@ int main(int argc, char **argv) {
   if (!STI->isCPUStringValid(MCPU))
     return 1;
 
-  if (!PrintInstructionTables && !STI->getSchedModel().isOutOfOrder()) {
+  // An in-order model can still be simulated if it describes a reorder
+  // buffer for the retire control unit.
+  const MCSchedModel &SM = STI->getSchedModel();
+  bool HasReorderBuffer = SM.hasExtraProcessorInfo() &&
+                          SM.getExtraProcessorInfo().ReorderBufferSize;
+  if (!PrintInstructionTables && !SM.isOutOfOrder() && !HasReorderBuffer) {
     WithColor::error() << "please specify an out-of-order cpu. '" << MCPU
                        << "' is an in-order cpu.\n";
     return 1;
   }
 
-  if (!STI->getSchedModel().hasInstrSchedModel()) {
+  if (!SM.hasInstrSchedModel()) {
     WithColor::error()
         << "unable to find instruction-level scheduling information for"
         << " target triple '" << TheTriple.normalize() << "' and cpu '" << MCPU
         << "'.\n";
 
-    if (STI->getSchedModel().InstrItineraries)
+    if (SM.InstrItineraries)
       WithColor::note()
           << "cpu '" << MCPU << "' provides itineraries. However, "
           << "instruction itineraries are currently unsupported.\n";
@@ -458,8 +463,6 @@ int main(int argc, char **argv) {
 
   std::unique_ptr<llvm::ToolOutputFile> TOF = std::move(*OF);
 
-  const MCSchedModel &SM = STI->getSchedModel();
-
   unsigned Width = SM.IssueWidth;
   if (DispatchWidth)
     Width = DispatchWidth;
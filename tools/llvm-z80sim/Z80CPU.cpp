@@ -0,0 +1,822 @@
+//===-- Z80CPU.cpp - Z80 instruction set simulator core -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Opcodes are decoded by their x, y, z, p and q fields: x is bits 7-6, y bits
+// 5-3, z bits 2-0, p bits 5-4 and q bit 3.  T-states are those of a Z80
+// without wait states.  A dd or fd prefix costs 4 T-states of its own, and an
+// (ix+d) operand 8 more than (hl), 5 for ld (ix+d), n.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Z80CPU.h"
+#include "llvm/Support/ErrorHandling.h"
+
+using namespace llvm;
+using namespace z80sim;
+
+/// Sign, zero and the undocumented flags of V.
+static uint8_t getSZ53(uint8_t V) {
+  return (V & (Z80CPU::FlagS | Z80CPU::FlagY | Z80CPU::FlagX)) |
+         (V ? 0 : Z80CPU::FlagZ);
+}
+
+/// getSZ53, with even parity of V in P/V.
+static uint8_t getSZ53P(uint8_t V) {
+  uint8_t P = V ^ V >> 4;
+  P ^= P >> 2;
+  P ^= P >> 1;
+  return getSZ53(V) | (P & 1 ? 0 : Z80CPU::FlagPV);
+}
+
+uint16_t Z80CPU::fetch16() {
+  uint8_t Lo = fetch();
+  return uint16_t(fetch() << 8 | Lo);
+}
+
+uint16_t Z80CPU::read16(uint16_t Addr) {
+  uint8_t Lo = Bus.read(Addr);
+  return uint16_t(Bus.read(Addr + 1) << 8 | Lo);
+}
+
+void Z80CPU::write16(uint16_t Addr, uint16_t Val) {
+  Bus.write(Addr, uint8_t(Val));
+  Bus.write(Addr + 1, Val >> 8);
+}
+
+void Z80CPU::push(uint16_t Val) {
+  SP -= 2;
+  write16(SP, Val);
+}
+
+uint16_t Z80CPU::pop() {
+  uint16_t Val = read16(SP);
+  SP += 2;
+  return Val;
+}
+
+uint16_t Z80CPU::getIdx() const {
+  switch (Idx) {
+  case UseHL:
+    return getHL();
+  case UseIX:
+    return getIX();
+  case UseIY:
+    return getIY();
+  }
+  llvm_unreachable("Unknown index mode");
+}
+
+void Z80CPU::setIdx(uint16_t V) {
+  switch (Idx) {
+  case UseHL:
+    return setHL(V);
+  case UseIX:
+    return setIX(V);
+  case UseIY:
+    return setIY(V);
+  }
+}
+
+uint16_t Z80CPU::getPtrAddr() {
+  if (Idx == UseHL)
+    return getHL();
+  int8_t Disp = int8_t(fetch());
+  return uint16_t(getIdx() + Disp);
+}
+
+uint8_t &Z80CPU::reg8(unsigned Reg, bool IdxHalves) {
+  switch (Reg) {
+  case 0:
+    return B;
+  case 1:
+    return C;
+  case 2:
+    return D;
+  case 3:
+    return E;
+  case 4:
+    if (IdxHalves && Idx != UseHL)
+      return Idx == UseIX ? IXH : IYH;
+    return H;
+  case 5:
+    if (IdxHalves && Idx != UseHL)
+      return Idx == UseIX ? IXL : IYL;
+    return L;
+  case 7:
+    return A;
+  }
+  llvm_unreachable("(hl) is not a register");
+}
+
+uint16_t Z80CPU::getRP(unsigned P) const {
+  switch (P) {
+  case 0:
+    return getBC();
+  case 1:
+    return getDE();
+  case 2:
+    return getIdx();
+  default:
+    return SP;
+  }
+}
+
+void Z80CPU::setRP(unsigned P, uint16_t V) {
+  switch (P) {
+  case 0:
+    return setBC(V);
+  case 1:
+    return setDE(V);
+  case 2:
+    return setIdx(V);
+  default:
+    SP = V;
+  }
+}
+
+uint16_t Z80CPU::getRP2(unsigned P) const {
+  return P == 3 ? getAF() : getRP(P);
+}
+
+void Z80CPU::setRP2(unsigned P, uint16_t V) {
+  if (P == 3)
+    return setAF(V);
+  setRP(P, V);
+}
+
+bool Z80CPU::testCond(unsigned CC) const {
+  static const uint8_t CondFlags[] = {FlagZ, FlagC, FlagPV, FlagS};
+  bool Set = F & CondFlags[CC >> 1];
+  return CC & 1 ? Set : !Set;
+}
+
+void Z80CPU::alu(unsigned Op, uint8_t V) {
+  unsigned Carry = (Op == 1 || Op == 3) && (F & FlagC) ? 1 : 0;
+  switch (Op) {
+  case 0: // add
+  case 1: { // adc
+    unsigned Res = A + V + Carry;
+    F = getSZ53(uint8_t(Res)) | ((A ^ V ^ Res) & FlagH) |
+        (~(A ^ V) & (A ^ Res) & 0x80 ? FlagPV : 0) | (Res > 0xFF ? FlagC : 0);
+    A = uint8_t(Res);
+    return;
+  }
+  case 2: // sub
+  case 3: // sbc
+  case 7: { // cp
+    unsigned Res = A - V - Carry;
+    uint8_t Flags = FlagN | ((A ^ V ^ Res) & FlagH) |
+                    ((A ^ V) & (A ^ Res) & 0x80 ? FlagPV : 0) |
+                    (Res & 0x100 ? FlagC : 0);
+    if (Op == 7) {
+      // cp takes the undocumented flags from the operand.
+      F = Flags | (Res & FlagS) | (uint8_t(Res) ? 0 : FlagZ) |
+          (V & (FlagY | FlagX));
+      return;
+    }
+    A = uint8_t(Res);
+    F = Flags | getSZ53(A);
+    return;
+  }
+  case 4:
+    A &= V;
+    F = getSZ53P(A) | FlagH;
+    return;
+  case 5:
+    A ^= V;
+    F = getSZ53P(A);
+    return;
+  case 6:
+    A |= V;
+    F = getSZ53P(A);
+    return;
+  }
+}
+
+uint8_t Z80CPU::inc8(uint8_t V) {
+  uint8_t Res = V + 1;
+  F = (F & FlagC) | getSZ53(Res) | ((V & 0x0F) == 0x0F ? FlagH : 0) |
+      (V == 0x7F ? FlagPV : 0);
+  return Res;
+}
+
+uint8_t Z80CPU::dec8(uint8_t V) {
+  uint8_t Res = V - 1;
+  F = (F & FlagC) | FlagN | getSZ53(Res) | ((V & 0x0F) == 0 ? FlagH : 0) |
+      (V == 0x80 ? FlagPV : 0);
+  return Res;
+}
+
+uint8_t Z80CPU::rot(unsigned Op, uint8_t V) {
+  uint8_t OldCarry = F & FlagC;
+  uint8_t Carry, Res;
+  switch (Op) {
+  case 0: // rlc
+    Carry = V >> 7;
+    Res = uint8_t(V << 1 | Carry);
+    break;
+  case 1: // rrc
+    Carry = V & 1;
+    Res = uint8_t(V >> 1 | Carry << 7);
+    break;
+  case 2: // rl
+    Carry = V >> 7;
+    Res = uint8_t(V << 1 | OldCarry);
+    break;
+  case 3: // rr
+    Carry = V & 1;
+    Res = uint8_t(V >> 1 | OldCarry << 7);
+    break;
+  case 4: // sla
+    Carry = V >> 7;
+    Res = uint8_t(V << 1);
+    break;
+  case 5: // sra
+    Carry = V & 1;
+    Res = uint8_t(V >> 1 | (V & 0x80));
+    break;
+  case 6: // sll
+    Carry = V >> 7;
+    Res = uint8_t(V << 1 | 1);
+    break;
+  default: // srl
+    Carry = V & 1;
+    Res = V >> 1;
+    break;
+  }
+  F = getSZ53P(Res) | Carry;
+  return Res;
+}
+
+void Z80CPU::bit(unsigned Bit, uint8_t V, uint8_t XY) {
+  uint8_t Res = V & (1 << Bit);
+  F = (F & FlagC) | FlagH | (Res ? 0 : FlagZ | FlagPV) | (Res & FlagS) |
+      (XY & (FlagY | FlagX));
+}
+
+uint16_t Z80CPU::add16(uint16_t X, uint16_t Y) {
+  unsigned Res = X + Y;
+  F = (F & (FlagS | FlagZ | FlagPV)) | (((X ^ Y ^ Res) >> 8) & FlagH) |
+      ((Res >> 8) & (FlagY | FlagX)) | (Res > 0xFFFF ? FlagC : 0);
+  return uint16_t(Res);
+}
+
+void Z80CPU::adc16(uint16_t V) {
+  uint16_t HL = getHL();
+  unsigned Res = HL + V + (F & FlagC);
+  F = ((Res >> 8) & (FlagS | FlagY | FlagX)) | (Res & 0xFFFF ? 0 : FlagZ) |
+      (((HL ^ V ^ Res) >> 8) & FlagH) |
+      (~(HL ^ V) & (HL ^ Res) & 0x8000 ? FlagPV : 0) |
+      (Res > 0xFFFF ? FlagC : 0);
+  setHL(uint16_t(Res));
+}
+
+void Z80CPU::sbc16(uint16_t V) {
+  uint16_t HL = getHL();
+  unsigned Res = HL - V - (F & FlagC);
+  F = FlagN | ((Res >> 8) & (FlagS | FlagY | FlagX)) |
+      (Res & 0xFFFF ? 0 : FlagZ) | (((HL ^ V ^ Res) >> 8) & FlagH) |
+      ((HL ^ V) & (HL ^ Res) & 0x8000 ? FlagPV : 0) |
+      (Res & 0x10000 ? FlagC : 0);
+  setHL(uint16_t(Res));
+}
+
+void Z80CPU::daa() {
+  uint8_t Corr = 0;
+  bool Carry = F & FlagC;
+  if (F & FlagH || (A & 0x0F) > 9)
+    Corr |= 0x06;
+  if (Carry || A > 0x99) {
+    Corr |= 0x60;
+    Carry = true;
+  }
+  bool Half;
+  uint8_t Res;
+  if (F & FlagN) {
+    Half = F & FlagH && (A & 0x0F) < 6;
+    Res = A - Corr;
+  } else {
+    Half = (A & 0x0F) > 9;
+    Res = A + Corr;
+  }
+  F = (F & FlagN) | getSZ53P(Res) | (Half ? FlagH : 0) | (Carry ? FlagC : 0);
+  A = Res;
+}
+
+unsigned Z80CPU::step() {
+  LastControl = CtlNone;
+  if (Halted)
+    return 0;
+
+  Idx = UseHL;
+  uint8_t Op = fetch();
+  incR();
+  unsigned T;
+  if (Op == 0xDD || Op == 0xFD) {
+    uint8_t Next = Bus.read(PC);
+    if (Next == 0xDD || Next == 0xED || Next == 0xFD) {
+      // The prefix has nothing to apply to, so it acts as a nop.
+      LastKey = PageMain << 8 | Op;
+      T = 4;
+    } else {
+      Idx = Op == 0xDD ? UseIX : UseIY;
+      Op = fetch();
+      incR();
+      if (Op == 0xCB)
+        T = 4 + execIndexedCB();
+      else {
+        LastKey = (Idx == UseIX ? PageDD : PageFD) << 8 | Op;
+        T = 4 + execMain(Op);
+      }
+    }
+  } else if (Op == 0xCB)
+    T = execCB();
+  else if (Op == 0xED)
+    T = execED();
+  else {
+    LastKey = PageMain << 8 | Op;
+    T = execMain(Op);
+  }
+  TStates += T;
+  return T;
+}
+
+unsigned Z80CPU::execMain(uint8_t Op) {
+  unsigned X = Op >> 6, Y = Op >> 3 & 7, Z = Op & 7, P = Y >> 1, Q = Y & 1;
+  unsigned DispT = Idx == UseHL ? 0 : 8;
+  switch (X) {
+  case 0:
+    switch (Z) {
+    case 0:
+      switch (Y) {
+      case 0: // nop
+        return 4;
+      case 1: { // ex af, af'
+        uint16_t V = getAF();
+        setAF(AFAlt);
+        AFAlt = V;
+        return 4;
+      }
+      case 2: { // djnz
+        int8_t Disp = int8_t(fetch());
+        if (--B) {
+          PC += Disp;
+          return 13;
+        }
+        return 8;
+      }
+      case 3: { // jr
+        int8_t Disp = int8_t(fetch());
+        PC += Disp;
+        return 12;
+      }
+      default: { // jr cc
+        int8_t Disp = int8_t(fetch());
+        if (testCond(Y - 4)) {
+          PC += Disp;
+          return 12;
+        }
+        return 7;
+      }
+      }
+    case 1:
+      if (!Q) { // ld rr, nn
+        setRP(P, fetch16());
+        return 10;
+      }
+      // add hl, rr
+      setIdx(add16(getIdx(), getRP(P)));
+      return 11;
+    case 2:
+      switch (Y) {
+      case 0:
+        Bus.write(getBC(), A);
+        return 7;
+      case 1:
+        A = Bus.read(getBC());
+        return 7;
+      case 2:
+        Bus.write(getDE(), A);
+        return 7;
+      case 3:
+        A = Bus.read(getDE());
+        return 7;
+      case 4:
+        write16(fetch16(), getIdx());
+        return 16;
+      case 5:
+        setIdx(read16(fetch16()));
+        return 16;
+      case 6:
+        Bus.write(fetch16(), A);
+        return 13;
+      default:
+        A = Bus.read(fetch16());
+        return 13;
+      }
+    case 3: // inc rr, dec rr
+      setRP(P, getRP(P) + (Q ? -1 : 1));
+      return 6;
+    case 4:
+    case 5:
+      if (Y == 6) {
+        uint16_t Addr = getPtrAddr();
+        uint8_t V = Bus.read(Addr);
+        Bus.write(Addr, Z == 4 ? inc8(V) : dec8(V));
+        return 11 + DispT;
+      } else {
+        uint8_t &Reg = reg8(Y, true);
+        Reg = Z == 4 ? inc8(Reg) : dec8(Reg);
+        return 4;
+      }
+    case 6:
+      if (Y == 6) {
+        uint16_t Addr = getPtrAddr();
+        Bus.write(Addr, fetch());
+        return Idx == UseHL ? 10 : 15;
+      }
+      reg8(Y, true) = fetch();
+      return 7;
+    default:
+      switch (Y) {
+      case 4:
+        daa();
+        break;
+      case 5: // cpl
+        A = ~A;
+        F = (F & (FlagS | FlagZ | FlagPV | FlagC)) | FlagH | FlagN |
+            (A & (FlagY | FlagX));
+        break;
+      case 6: // scf
+        F = (F & (FlagS | FlagZ | FlagPV)) | FlagC | (A & (FlagY | FlagX));
+        break;
+      case 7: // ccf
+        F = (F & (FlagS | FlagZ | FlagPV)) | (F & FlagC ? FlagH : FlagC) |
+            (A & (FlagY | FlagX));
+        break;
+      default: { // rlca, rrca, rla, rra
+        uint8_t OldF = F;
+        A = rot(Y, A);
+        F = (OldF & (FlagS | FlagZ | FlagPV)) | (A & (FlagY | FlagX)) |
+            (F & FlagC);
+        break;
+      }
+      }
+      return 4;
+    }
+  case 1:
+    if (Op == 0x76) {
+      Halted = true;
+      return 4;
+    }
+    // With an (ix+d) operand, the other one is a plain register.
+    if (Y == 6) {
+      uint16_t Addr = getPtrAddr();
+      Bus.write(Addr, reg8(Z, false));
+      return 7 + DispT;
+    }
+    if (Z == 6) {
+      uint16_t Addr = getPtrAddr();
+      reg8(Y, false) = Bus.read(Addr);
+      return 7 + DispT;
+    }
+    reg8(Y, true) = reg8(Z, true);
+    return 4;
+  case 2:
+    if (Z == 6) {
+      alu(Y, Bus.read(getPtrAddr()));
+      return 7 + DispT;
+    }
+    alu(Y, reg8(Z, true));
+    return 4;
+  default:
+    switch (Z) {
+    case 0: // ret cc
+      if (testCond(Y)) {
+        PC = pop();
+        LastControl = CtlRet;
+        return 11;
+      }
+      return 5;
+    case 1:
+      if (!Q) { // pop
+        setRP2(P, pop());
+        return 10;
+      }
+      switch (P) {
+      case 0: // ret
+        PC = pop();
+        LastControl = CtlRet;
+        return 10;
+      case 1: { // exx, which the prefixes do not affect
+        uint16_t V = getBC();
+        setBC(BCAlt);
+        BCAlt = V;
+        V = getDE();
+        setDE(DEAlt);
+        DEAlt = V;
+        V = getHL();
+        setHL(HLAlt);
+        HLAlt = V;
+        return 4;
+      }
+      case 2: // jp (hl)
+        PC = getIdx();
+        return 4;
+      default: // ld sp, hl
+        SP = getIdx();
+        return 6;
+      }
+    case 2: { // jp cc, nn
+      uint16_t Target = fetch16();
+      if (testCond(Y))
+        PC = Target;
+      return 10;
+    }
+    case 3:
+      switch (Y) {
+      case 0: // jp nn
+        PC = fetch16();
+        return 10;
+      case 2: { // out (n), a
+        uint8_t N = fetch();
+        Bus.out(uint16_t(A << 8 | N), A);
+        return 11;
+      }
+      case 3: { // in a, (n)
+        uint8_t N = fetch();
+        A = Bus.in(uint16_t(A << 8 | N));
+        return 11;
+      }
+      case 4: { // ex (sp), hl
+        uint16_t V = read16(SP);
+        write16(SP, getIdx());
+        setIdx(V);
+        return 19;
+      }
+      case 5: { // ex de, hl, which the prefixes do not affect
+        uint16_t V = getDE();
+        setDE(getHL());
+        setHL(V);
+        return 4;
+      }
+      case 6: // di
+        IFF1 = IFF2 = false;
+        return 4;
+      case 7: // ei
+        IFF1 = IFF2 = true;
+        return 4;
+      default:
+        llvm_unreachable("cb prefix is decoded by step()");
+      }
+    case 4: { // call cc, nn
+      uint16_t Target = fetch16();
+      if (testCond(Y)) {
+        push(PC);
+        PC = Target;
+        LastControl = CtlCall;
+        return 17;
+      }
+      return 10;
+    }
+    case 5:
+      if (!Q) { // push
+        push(getRP2(P));
+        return 11;
+      }
+      if (P == 0) { // call nn
+        uint16_t Target = fetch16();
+        push(PC);
+        PC = Target;
+        LastControl = CtlCall;
+        return 17;
+      }
+      llvm_unreachable("Prefixes are decoded by step()");
+    case 6: // alu a, n
+      alu(Y, fetch());
+      return 7;
+    default: // rst
+      push(PC);
+      PC = uint16_t(Y * 8);
+      LastControl = CtlCall;
+      return 11;
+    }
+  }
+}
+
+unsigned Z80CPU::execCB() {
+  uint8_t Op = fetch();
+  incR();
+  LastKey = PageCB << 8 | Op;
+  unsigned X = Op >> 6, Y = Op >> 3 & 7, Z = Op & 7;
+  if (Z == 6) {
+    uint16_t Addr = getHL();
+    uint8_t V = Bus.read(Addr);
+    switch (X) {
+    case 0:
+      Bus.write(Addr, rot(Y, V));
+      return 15;
+    case 1:
+      bit(Y, V, H);
+      return 12;
+    case 2:
+      Bus.write(Addr, V & ~(1 << Y));
+      return 15;
+    default:
+      Bus.write(Addr, V | 1 << Y);
+      return 15;
+    }
+  }
+  uint8_t &Reg = reg8(Z, false);
+  switch (X) {
+  case 0:
+    Reg = rot(Y, Reg);
+    break;
+  case 1:
+    bit(Y, Reg, Reg);
+    break;
+  case 2:
+    Reg &= ~(1 << Y);
+    break;
+  default:
+    Reg |= 1 << Y;
+    break;
+  }
+  return 8;
+}
+
+unsigned Z80CPU::execIndexedCB() {
+  // Neither the displacement nor the opcode is an opcode fetch, so they
+  // leave r alone.
+  int8_t Disp = int8_t(fetch());
+  uint8_t Op = fetch();
+  LastKey = (Idx == UseIX ? PageDDCB : PageFDCB) << 8 | Op;
+  unsigned X = Op >> 6, Y = Op >> 3 & 7, Z = Op & 7;
+  uint16_t Addr = uint16_t(getIdx() + Disp);
+  uint8_t V = Bus.read(Addr);
+  uint8_t Res;
+  switch (X) {
+  case 0:
+    Res = rot(Y, V);
+    break;
+  case 1:
+    bit(Y, V, Addr >> 8);
+    return 16;
+  case 2:
+    Res = V & ~(1 << Y);
+    break;
+  default:
+    Res = V | 1 << Y;
+    break;
+  }
+  Bus.write(Addr, Res);
+  // Undocumented, the result is copied to a register too.
+  if (Z != 6)
+    reg8(Z, false) = Res;
+  return 19;
+}
+
+unsigned Z80CPU::execED() {
+  uint8_t Op = fetch();
+  incR();
+  LastKey = PageED << 8 | Op;
+  unsigned X = Op >> 6, Y = Op >> 3 & 7, Z = Op & 7, P = Y >> 1, Q = Y & 1;
+  if (X == 2 && Y >= 4 && Z <= 3)
+    return execBlock(Y, Z);
+  // Everything outside x = 1 is a two byte nop.
+  if (X != 1)
+    return 8;
+  switch (Z) {
+  case 0: { // in r, (c), in f, (c) for y = 6
+    uint8_t V = Bus.in(getBC());
+    if (Y != 6)
+      reg8(Y, false) = V;
+    F = (F & FlagC) | getSZ53P(V);
+    return 12;
+  }
+  case 1: // out (c), r, out (c), 0 for y = 6
+    Bus.out(getBC(), Y == 6 ? 0 : reg8(Y, false));
+    return 12;
+  case 2:
+    if (Q)
+      adc16(getRP(P));
+    else
+      sbc16(getRP(P));
+    return 15;
+  case 3: {
+    uint16_t Addr = fetch16();
+    if (Q)
+      setRP(P, read16(Addr));
+    else
+      write16(Addr, getRP(P));
+    return 20;
+  }
+  case 4: { // neg
+    uint8_t V = A;
+    A = 0;
+    alu(2, V);
+    return 8;
+  }
+  case 5: // retn, reti
+    PC = pop();
+    IFF1 = IFF2;
+    LastControl = CtlRet;
+    return 14;
+  case 6: {
+    static const uint8_t Modes[] = {0, 0, 1, 2};
+    IntMode = Modes[Y & 3];
+    return 8;
+  }
+  default:
+    switch (Y) {
+    case 0:
+      I = A;
+      return 9;
+    case 1:
+      R = A;
+      return 9;
+    case 2:
+    case 3:
+      A = Y == 2 ? I : R;
+      F = (F & FlagC) | getSZ53(A) | (IFF2 ? FlagPV : 0);
+      return 9;
+    case 4:
+    case 5: {
+      uint16_t Addr = getHL();
+      uint8_t V = Bus.read(Addr);
+      if (Y == 4) { // rrd
+        Bus.write(Addr, uint8_t(A << 4 | V >> 4));
+        A = (A & 0xF0) | (V & 0x0F);
+      } else { // rld
+        Bus.write(Addr, uint8_t(V << 4 | (A & 0x0F)));
+        A = (A & 0xF0) | V >> 4;
+      }
+      F = (F & FlagC) | getSZ53P(A);
+      return 18;
+    }
+    default:
+      return 8;
+    }
+  }
+}
+
+unsigned Z80CPU::execBlock(unsigned Y, unsigned Z) {
+  uint16_t Step = Y & 1 ? -1 : 1;
+  bool Repeat = Y >= 6;
+  bool Again;
+  switch (Z) {
+  case 0: { // ldi, ldd, ldir, lddr
+    uint8_t V = Bus.read(getHL());
+    Bus.write(getDE(), V);
+    setHL(getHL() + Step);
+    setDE(getDE() + Step);
+    setBC(getBC() - 1);
+    uint8_t N = V + A;
+    F = (F & (FlagS | FlagZ | FlagC)) | (N & FlagX) | (N << 4 & FlagY) |
+        (getBC() ? FlagPV : 0);
+    Again = getBC();
+    break;
+  }
+  case 1: { // cpi, cpd, cpir, cpdr
+    uint8_t V = Bus.read(getHL());
+    uint8_t Res = A - V;
+    uint8_t Half = (A ^ V ^ Res) & FlagH;
+    setHL(getHL() + Step);
+    setBC(getBC() - 1);
+    uint8_t N = Res - (Half ? 1 : 0);
+    F = (F & FlagC) | FlagN | (Res & FlagS) | (Res ? 0 : FlagZ) | Half |
+        (getBC() ? FlagPV : 0) | (N & FlagX) | (N << 4 & FlagY);
+    Again = getBC() && Res;
+    break;
+  }
+  case 2: { // ini, ind, inir, indr
+    uint8_t V = Bus.in(getBC());
+    Bus.write(getHL(), V);
+    setHL(getHL() + Step);
+    --B;
+    F = (F & FlagC) | FlagN | getSZ53(B);
+    Again = B;
+    break;
+  }
+  default: { // outi, outd, otir, otdr
+    uint8_t V = Bus.read(getHL());
+    --B;
+    Bus.out(getBC(), V);
+    setHL(getHL() + Step);
+    F = (F & FlagC) | FlagN | getSZ53(B);
+    Again = B;
+    break;
+  }
+  }
+  if (Repeat && Again) {
+    PC -= 2;
+    return 21;
+  }
+  return 16;
+}
@@ -0,0 +1,158 @@
+//===-- Z80CPU.h - Z80 instruction set simulator core -----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares Z80CPU, which executes Z80 instructions one at a time and
+// counts the T-states that each takes, and Z80Bus, through which it reaches
+// memory and I/O ports.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TOOLS_LLVM_Z80SIM_Z80CPU_H
+#define LLVM_TOOLS_LLVM_Z80SIM_Z80CPU_H
+
+#include <cstdint>
+
+namespace llvm {
+namespace z80sim {
+
+/// Memory and I/O ports as seen by the CPU.
+class Z80Bus {
+public:
+  virtual ~Z80Bus() = default;
+
+  virtual uint8_t read(uint16_t Addr) = 0;
+  virtual void write(uint16_t Addr, uint8_t Val) = 0;
+  /// Port is the full 16-bit address put on the bus, B or A in the high byte.
+  virtual uint8_t in(uint16_t Port) = 0;
+  virtual void out(uint16_t Port, uint8_t Val) = 0;
+};
+
+class Z80CPU {
+public:
+  enum Flag : uint8_t {
+    FlagC = 0x01,
+    FlagN = 0x02,
+    FlagPV = 0x04,
+    FlagX = 0x08, ///< Undocumented copy of bit 3.
+    FlagH = 0x10,
+    FlagY = 0x20, ///< Undocumented copy of bit 5.
+    FlagZ = 0x40,
+    FlagS = 0x80
+  };
+
+  /// How the last instruction transferred control, for call graph profiling.
+  enum ControlKind : uint8_t {
+    CtlNone,
+    CtlCall, ///< A taken call or rst, the return address has been pushed.
+    CtlRet   ///< A taken ret, reti or retn.
+  };
+
+  /// Opcode pages, the high byte of getLastOpcodeKey().
+  enum Page : uint8_t {
+    PageMain,
+    PageCB,
+    PageED,
+    PageDD,
+    PageFD,
+    PageDDCB,
+    PageFDCB
+  };
+
+  // Registers, with the 8-bit halves of each pair.
+  uint8_t A = 0xFF, F = 0xFF, B = 0, C = 0, D = 0, E = 0, H = 0, L = 0;
+  uint16_t AFAlt = 0, BCAlt = 0, DEAlt = 0, HLAlt = 0;
+  uint8_t IXH = 0, IXL = 0, IYH = 0, IYL = 0;
+  uint16_t SP = 0, PC = 0;
+  uint8_t I = 0, R = 0;
+  bool IFF1 = false, IFF2 = false;
+  uint8_t IntMode = 0;
+  bool Halted = false;
+
+  explicit Z80CPU(Z80Bus &Bus) : Bus(Bus) {}
+
+  /// Execute one instruction, and return the number of T-states it took.  A
+  /// halted CPU executes nothing and returns 0.
+  unsigned step();
+
+  /// T-states executed so far.
+  uint64_t getTStates() const { return TStates; }
+
+  ControlKind getLastControl() const { return LastControl; }
+  /// Page and opcode byte of the last instruction.  A dd or fd prefix that
+  /// acts as a nop is recorded as an opcode on its own.
+  uint16_t getLastOpcodeKey() const { return LastKey; }
+
+  uint16_t getBC() const { return uint16_t(B << 8 | C); }
+  uint16_t getDE() const { return uint16_t(D << 8 | E); }
+  uint16_t getHL() const { return uint16_t(H << 8 | L); }
+  uint16_t getAF() const { return uint16_t(A << 8 | F); }
+  uint16_t getIX() const { return uint16_t(IXH << 8 | IXL); }
+  uint16_t getIY() const { return uint16_t(IYH << 8 | IYL); }
+  void setBC(uint16_t V) { B = V >> 8; C = uint8_t(V); }
+  void setDE(uint16_t V) { D = V >> 8; E = uint8_t(V); }
+  void setHL(uint16_t V) { H = V >> 8; L = uint8_t(V); }
+  void setAF(uint16_t V) { A = V >> 8; F = uint8_t(V); }
+  void setIX(uint16_t V) { IXH = V >> 8; IXL = uint8_t(V); }
+  void setIY(uint16_t V) { IYH = V >> 8; IYL = uint8_t(V); }
+
+private:
+  /// Which register a dd or fd prefix substitutes for hl.
+  enum IndexMode : uint8_t { UseHL, UseIX, UseIY };
+
+  Z80Bus &Bus;
+  uint64_t TStates = 0;
+  ControlKind LastControl = CtlNone;
+  uint16_t LastKey = 0;
+  IndexMode Idx = UseHL;
+
+  uint8_t fetch() { return Bus.read(PC++); }
+  uint16_t fetch16();
+  uint16_t read16(uint16_t Addr);
+  void write16(uint16_t Addr, uint16_t Val);
+  void push(uint16_t Val);
+  uint16_t pop();
+  void incR() { R = (R & 0x80) | ((R + 1) & 0x7F); }
+
+  /// hl, ix or iy, as selected by the current prefix.
+  uint16_t getIdx() const;
+  void setIdx(uint16_t V);
+  /// Address of an (hl) operand, reading the displacement of (ix+d).
+  uint16_t getPtrAddr();
+  /// 8-bit register number Reg, which must not be 6.  With IdxHalves, h and l
+  /// are the halves of the index register.
+  uint8_t &reg8(unsigned Reg, bool IdxHalves);
+  /// Register pair P of ld rr, nn style instructions, with sp.
+  uint16_t getRP(unsigned P) const;
+  void setRP(unsigned P, uint16_t V);
+  /// Register pair P of push and pop, with af.
+  uint16_t getRP2(unsigned P) const;
+  void setRP2(unsigned P, uint16_t V);
+  bool testCond(unsigned CC) const;
+
+  void alu(unsigned Op, uint8_t V);
+  uint8_t inc8(uint8_t V);
+  uint8_t dec8(uint8_t V);
+  uint8_t rot(unsigned Op, uint8_t V);
+  void bit(unsigned Bit, uint8_t V, uint8_t XY);
+  uint16_t add16(uint16_t X, uint16_t Y);
+  void adc16(uint16_t V);
+  void sbc16(uint16_t V);
+  void daa();
+
+  unsigned execMain(uint8_t Op);
+  unsigned execCB();
+  unsigned execIndexedCB();
+  unsigned execED();
+  unsigned execBlock(unsigned Y, unsigned Z);
+};
+
+} // end namespace z80sim
+} // end namespace llvm
+
+#endif
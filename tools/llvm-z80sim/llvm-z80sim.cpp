@@ -0,0 +1,960 @@
+//===-- llvm-z80sim.cpp - Z80 instruction set simulator -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This program runs Z80 code produced by the Z80 backend on the host, and
+// reports how many T-states it took.
+//
+// The input is either flat binaries, or ELF files.  ELF executables are loaded
+// at the addresses of their sections.  Relocatable objects, as written by llc
+// -filetype=obj, are linked at --load-address: code first, then data, then
+// bss and common symbols.
+//
+// The entry point is called with the stack pointer at --stack, and the run
+// ends when it returns, when the CPU halts or when --exit-port is written.
+// Writes to --console-port go to stdout, reads from it come from stdin, and
+// every other port reads as --port-value.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Z80CPU.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCDisassembler/MCDisassembler.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstPrinter.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace llvm::object;
+using namespace llvm::z80sim;
+
+static cl::list<std::string> InputFilenames(cl::Positional, cl::OneOrMore,
+                                            cl::desc("<input files>"));
+
+static cl::opt<bool> FlatBinary("binary",
+                                cl::desc("Load the inputs as flat binaries"));
+
+static cl::opt<std::string>
+    LoadAddress("load-address", cl::init("0"),
+                cl::desc("Address of flat binaries and of the sections of "
+                         "relocatable objects"));
+
+static cl::opt<std::string>
+    EntryPoint("entry", cl::init("main"),
+               cl::desc("Symbol or address to call, the load address of a "
+                        "flat binary by default"));
+
+static cl::opt<std::string>
+    StackTop("stack", cl::init("0"),
+             cl::desc("Initial stack pointer, 0 to start at the top of "
+                      "memory"));
+
+static cl::list<std::string>
+    MemoryMap("memory", cl::ZeroOrMore,
+              cl::desc("Add the region <start>-<end>[:ro|:rw] to the memory "
+                       "map, which is all RAM when no region is given"));
+
+static cl::opt<int>
+    ConsolePort("console-port", cl::init(1),
+                cl::desc("Port connected to stdin and stdout, -1 for none"));
+
+static cl::opt<int>
+    ExitPort("exit-port", cl::init(-1),
+             cl::desc("Port whose writes end the run with the written value "
+                      "as exit code, -1 for none"));
+
+static cl::opt<unsigned>
+    PortValue("port-value", cl::init(0xFF),
+              cl::desc("Value read from ports other than the console"));
+
+static cl::opt<unsigned long long>
+    MaxTStates("max-tstates", cl::init(10000000000ULL),
+               cl::desc("Stop after this many T-states, 0 for no limit"));
+
+static cl::opt<bool> PrintFunctions("functions",
+                                    cl::desc("Print T-states per function"));
+
+static cl::opt<bool>
+    PrintHistogram("histogram",
+                   cl::desc("Print how often each instruction ran"));
+
+static cl::opt<bool> PrintPorts("ports",
+                                cl::desc("Print the traffic on each port"));
+
+static cl::opt<bool> Trace("trace",
+                           cl::desc("Print each instruction as it runs"));
+
+static StringRef ToolName;
+
+LLVM_ATTRIBUTE_NORETURN static void fail(const Twine &Message) {
+  WithColor::error(errs(), ToolName) << Message << '\n';
+  exit(1);
+}
+
+static void failIfError(Error E, StringRef Context) {
+  if (!E)
+    return;
+  std::string Buf;
+  raw_string_ostream OS(Buf);
+  logAllUnhandledErrors(std::move(E), OS, "");
+  fail(Context + ": " + OS.str());
+}
+
+template <typename T> static T failIfError(Expected<T> V, StringRef Context) {
+  if (!V)
+    failIfError(V.takeError(), Context);
+  return std::move(*V);
+}
+
+static uint16_t parseAddress(StringRef Str, StringRef Option) {
+  unsigned Val;
+  if (Str.getAsInteger(0, Val) || Val > 0xFFFF)
+    fail("invalid address '" + Str + "' for -" + Option);
+  return uint16_t(Val);
+}
+
+//===----------------------------------------------------------------------===//
+// Memory and ports
+//===----------------------------------------------------------------------===//
+
+namespace {
+class SimBus : public Z80Bus {
+public:
+  enum Access : uint8_t { NoAccess, ReadOnly, ReadWrite };
+
+  struct PortStats {
+    uint64_t Reads = 0, Writes = 0;
+  };
+
+  uint8_t Mem[0x10000] = {};
+  Access Map[0x10000];
+  std::map<uint8_t, PortStats> Ports;
+
+  /// Set by the first access outside the memory map or write to ROM.
+  bool Faulted = false;
+  bool FaultIsWrite = false;
+  uint16_t FaultAddr = 0;
+
+  bool ExitRequested = false;
+  uint8_t ExitCode = 0;
+
+  SimBus() { std::fill(std::begin(Map), std::end(Map), ReadWrite); }
+
+  void mapRegion(uint16_t Start, uint16_t End, Access Kind) {
+    for (unsigned Addr = Start; Addr <= End; ++Addr)
+      Map[Addr] = Kind;
+  }
+
+  uint8_t read(uint16_t Addr) override {
+    if (Map[Addr] == NoAccess)
+      fault(Addr, false);
+    return Mem[Addr];
+  }
+
+  void write(uint16_t Addr, uint8_t Val) override {
+    if (Map[Addr] != ReadWrite)
+      return fault(Addr, true);
+    Mem[Addr] = Val;
+  }
+
+  uint8_t in(uint16_t Port) override {
+    ++Ports[uint8_t(Port)].Reads;
+    if (ConsolePort >= 0 && uint8_t(Port) == ConsolePort) {
+      int C = getchar();
+      return C == EOF ? 0xFF : uint8_t(C);
+    }
+    return uint8_t(PortValue);
+  }
+
+  void out(uint16_t Port, uint8_t Val) override {
+    ++Ports[uint8_t(Port)].Writes;
+    if (ConsolePort >= 0 && uint8_t(Port) == ConsolePort)
+      outs() << char(Val);
+    if (ExitPort >= 0 && uint8_t(Port) == ExitPort) {
+      ExitRequested = true;
+      ExitCode = Val;
+    }
+  }
+
+private:
+  void fault(uint16_t Addr, bool IsWrite) {
+    if (Faulted)
+      return;
+    Faulted = true;
+    FaultAddr = Addr;
+    FaultIsWrite = IsWrite;
+  }
+};
+} // end anonymous namespace
+
+static void parseMemoryMap(SimBus &Bus) {
+  if (MemoryMap.empty())
+    return;
+  Bus.mapRegion(0, 0xFFFF, SimBus::NoAccess);
+  for (StringRef Region : MemoryMap) {
+    StringRef Range, Kind;
+    std::tie(Range, Kind) = Region.split(':');
+    StringRef Start, End;
+    std::tie(Start, End) = Range.split('-');
+    SimBus::Access Access = SimBus::ReadWrite;
+    if (Kind == "ro")
+      Access = SimBus::ReadOnly;
+    else if (!Kind.empty() && Kind != "rw")
+      fail("invalid access '" + Kind + "' in memory region '" + Region + "'");
+    uint16_t StartAddr = parseAddress(Start, "memory");
+    uint16_t EndAddr = parseAddress(End, "memory");
+    if (EndAddr < StartAddr)
+      fail("memory region '" + Region + "' ends before it starts");
+    Bus.mapRegion(StartAddr, EndAddr, Access);
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// Loading and linking
+//===----------------------------------------------------------------------===//
+
+namespace {
+struct Function {
+  std::string Name;
+  uint16_t Start;
+  /// One past the last byte, as a 32-bit value so a function can end at
+  /// 0x10000.
+  uint32_t End;
+};
+
+class Loader {
+public:
+  explicit Loader(SimBus &Bus) : Bus(Bus) {}
+
+  void loadBinary(StringRef Filename);
+  void loadObject(std::unique_ptr<ObjectFile> Obj, StringRef Filename);
+  /// Lay out the sections of the relocatable objects, resolve their symbols
+  /// and apply their relocations.
+  void link();
+
+  /// Address of the entry symbol or address Name.
+  uint16_t getEntry(StringRef Name, bool IsDefault) const;
+  /// Code ranges of the functions, sorted by start address.
+  std::vector<Function> getFunctions() const;
+
+private:
+  struct Input {
+    std::string Filename;
+    std::unique_ptr<ObjectFile> Obj;
+    /// Address of each allocated section, by section index.
+    DenseMap<uint64_t, uint16_t> SectionAddrs;
+  };
+
+  SimBus &Bus;
+  uint32_t NextAddr = 0;
+  bool NextAddrSet = false;
+  std::vector<Input> Inputs;
+  StringMap<uint16_t> Globals;
+  /// Symbols in code, with their size if known.
+  struct CodeSymbol {
+    std::string Name;
+    uint16_t Addr;
+    uint16_t Size;
+    uint32_t SectionEnd;
+  };
+  std::vector<CodeSymbol> CodeSymbols;
+
+  uint32_t allocate(uint64_t Size, uint64_t Align, StringRef What);
+  void place(const uint8_t *Data, uint64_t Size, uint32_t Addr,
+             StringRef What);
+  uint16_t getSymbolAddr(const Input &In, const SymbolRef &Sym) const;
+};
+} // end anonymous namespace
+
+uint32_t Loader::allocate(uint64_t Size, uint64_t Align, StringRef What) {
+  if (!NextAddrSet) {
+    NextAddr = parseAddress(LoadAddress, "load-address");
+    NextAddrSet = true;
+  }
+  if (Align > 1)
+    NextAddr = alignTo(NextAddr, Align);
+  uint32_t Addr = NextAddr;
+  NextAddr += Size;
+  if (NextAddr > 0x10000)
+    fail(What + " does not fit in memory");
+  return Addr;
+}
+
+void Loader::place(const uint8_t *Data, uint64_t Size, uint32_t Addr,
+                   StringRef What) {
+  if (Addr + Size > 0x10000)
+    fail(What + " does not fit in memory");
+  for (uint64_t I = 0; I != Size; ++I) {
+    if (Bus.Map[Addr + I] == SimBus::NoAccess)
+      fail(What + " is outside the memory map");
+    Bus.Mem[Addr + I] = Data ? Data[I] : 0;
+  }
+}
+
+void Loader::loadBinary(StringRef Filename) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buf =
+      MemoryBuffer::getFileOrSTDIN(Filename);
+  if (std::error_code EC = Buf.getError())
+    fail(Filename + ": " + EC.message());
+  StringRef Contents = (*Buf)->getBuffer();
+  uint32_t Addr = allocate(Contents.size(), 1, Filename);
+  place(Contents.bytes_begin(), Contents.size(), Addr, Filename);
+}
+
+void Loader::loadObject(std::unique_ptr<ObjectFile> Obj, StringRef Filename) {
+  auto *ELFObj = dyn_cast<ELFObjectFileBase>(Obj.get());
+  if (!ELFObj || Obj->getArch() != Triple::z80)
+    fail(Filename + ": not a Z80 ELF file");
+
+  if (!Obj->isRelocatableObject()) {
+    // Executables are loaded where their sections say.
+    for (const SectionRef &Sec : Obj->sections()) {
+      ELFSectionRef ESec(Sec);
+      if (!(ESec.getFlags() & ELF::SHF_ALLOC) || !Sec.getSize())
+        continue;
+      StringRef Contents;
+      if (!Sec.isBSS())
+        failIfError(errorCodeToError(Sec.getContents(Contents)), Filename);
+      place(Sec.isBSS() ? nullptr : Contents.bytes_begin(), Sec.getSize(),
+            uint32_t(Sec.getAddress()), Filename);
+    }
+    for (const SymbolRef &Sym : Obj->symbols()) {
+      if (Sym.getFlags() & SymbolRef::SF_Undefined)
+        continue;
+      StringRef Name = failIfError(Sym.getName(), Filename);
+      uint16_t Addr = uint16_t(failIfError(Sym.getAddress(), Filename));
+      if (Sym.getFlags() & SymbolRef::SF_Global)
+        Globals[Name] = Addr;
+      section_iterator Sec = failIfError(Sym.getSection(), Filename);
+      if (Sec != Obj->section_end() && Sec->isText() && !Name.empty() &&
+          failIfError(Sym.getType(), Filename) != SymbolRef::ST_Debug)
+        CodeSymbols.push_back(
+            {Name, Addr, uint16_t(ELFSymbolRef(Sym).getSize()),
+             uint32_t(Sec->getAddress() + Sec->getSize())});
+    }
+    return;
+  }
+
+  Inputs.emplace_back();
+  Inputs.back().Filename = Filename;
+  Inputs.back().Obj = std::move(Obj);
+}
+
+uint16_t Loader::getSymbolAddr(const Input &In, const SymbolRef &Sym) const {
+  uint32_t Flags = Sym.getFlags();
+  StringRef Name = failIfError(Sym.getName(), In.Filename);
+  if (Flags & (SymbolRef::SF_Undefined | SymbolRef::SF_Common)) {
+    auto I = Globals.find(Name);
+    if (I == Globals.end())
+      fail(In.Filename + ": undefined symbol '" + Name + "'");
+    return I->second;
+  }
+  if (Flags & SymbolRef::SF_Absolute)
+    return uint16_t(Sym.getValue());
+  section_iterator Sec = failIfError(Sym.getSection(), In.Filename);
+  auto I = In.SectionAddrs.find(Sec->getIndex());
+  if (I == In.SectionAddrs.end())
+    fail(In.Filename + ": symbol '" + Name + "' is in a section that is not "
+                                             "loaded");
+  return uint16_t(I->second + Sym.getValue());
+}
+
+void Loader::link() {
+  // Code, then initialized data, then bss, so that code starts at the load
+  // address.
+  enum { Code, Data, BSS };
+  for (unsigned Kind : {Code, Data, BSS}) {
+    for (Input &In : Inputs) {
+      for (const SectionRef &Sec : In.Obj->sections()) {
+        ELFSectionRef ESec(Sec);
+        if (!(ESec.getFlags() & ELF::SHF_ALLOC))
+          continue;
+        unsigned SecKind = Sec.isText() ? Code : Sec.isBSS() ? BSS : Data;
+        if (SecKind != Kind)
+          continue;
+        StringRef Name;
+        Sec.getName(Name);
+        std::string What = (In.Filename + ": section " + Name).str();
+        uint32_t Addr = allocate(Sec.getSize(), Sec.getAlignment(), What);
+        StringRef Contents;
+        if (Kind != BSS)
+          failIfError(errorCodeToError(Sec.getContents(Contents)), What);
+        place(Kind == BSS ? nullptr : Contents.bytes_begin(), Sec.getSize(),
+              Addr, What);
+        In.SectionAddrs[Sec.getIndex()] = uint16_t(Addr);
+      }
+    }
+
+    if (Kind != BSS)
+      continue;
+    // Common symbols go after bss, the first definition of each name.
+    for (Input &In : Inputs) {
+      for (const SymbolRef &Sym : In.Obj->symbols()) {
+        if (!(Sym.getFlags() & SymbolRef::SF_Common))
+          continue;
+        StringRef Name = failIfError(Sym.getName(), In.Filename);
+        if (Globals.count(Name))
+          continue;
+        std::string What = (In.Filename + ": common symbol " + Name).str();
+        uint32_t Addr =
+            allocate(Sym.getCommonSize(), Sym.getAlignment(), What);
+        place(nullptr, Sym.getCommonSize(), Addr, What);
+        Globals[Name] = uint16_t(Addr);
+      }
+    }
+  }
+
+  // Global symbols.  A strong definition overrides a weak one.
+  StringMap<bool> IsWeak;
+  for (Input &In : Inputs) {
+    for (const SymbolRef &Sym : In.Obj->symbols()) {
+      uint32_t Flags = Sym.getFlags();
+      if (!(Flags & SymbolRef::SF_Global) ||
+          Flags & (SymbolRef::SF_Undefined | SymbolRef::SF_Common))
+        continue;
+      StringRef Name = failIfError(Sym.getName(), In.Filename);
+      bool Weak = Flags & SymbolRef::SF_Weak;
+      auto I = IsWeak.find(Name);
+      if (I != IsWeak.end()) {
+        if (Weak)
+          continue;
+        if (!I->second)
+          fail(In.Filename + ": duplicate symbol '" + Name + "'");
+      }
+      IsWeak[Name] = Weak;
+      Globals[Name] = getSymbolAddr(In, Sym);
+    }
+  }
+
+  // Functions, for the profile.
+  for (Input &In : Inputs) {
+    for (const SymbolRef &Sym : In.Obj->symbols()) {
+      uint32_t Flags = Sym.getFlags();
+      if (Flags & (SymbolRef::SF_Undefined | SymbolRef::SF_Common |
+                   SymbolRef::SF_Absolute))
+        continue;
+      if (failIfError(Sym.getType(), In.Filename) == SymbolRef::ST_Debug)
+        continue;
+      section_iterator Sec = failIfError(Sym.getSection(), In.Filename);
+      if (Sec == In.Obj->section_end() || !Sec->isText())
+        continue;
+      StringRef Name = failIfError(Sym.getName(), In.Filename);
+      uint16_t SecAddr = In.SectionAddrs.lookup(Sec->getIndex());
+      CodeSymbols.push_back({Name, getSymbolAddr(In, Sym),
+                             uint16_t(ELFSymbolRef(Sym).getSize()),
+                             uint32_t(SecAddr + Sec->getSize())});
+    }
+  }
+
+  // Relocations.
+  for (Input &In : Inputs) {
+    for (const SectionRef &RelSec : In.Obj->sections()) {
+      section_iterator Target = RelSec.getRelocatedSection();
+      if (Target == In.Obj->section_end())
+        continue;
+      auto TargetAddr = In.SectionAddrs.find(Target->getIndex());
+      if (TargetAddr == In.SectionAddrs.end())
+        continue;
+      for (const RelocationRef &Rel : RelSec.relocations()) {
+        uint32_t P = TargetAddr->second + uint32_t(Rel.getOffset());
+        int64_t S = 0;
+        symbol_iterator Sym = Rel.getSymbol();
+        if (Sym != In.Obj->symbol_end())
+          S = getSymbolAddr(In, *Sym);
+        int64_t A = failIfError(ELFRelocationRef(Rel).getAddend(),
+                                In.Filename);
+        int64_t V = S + A;
+        unsigned Size = 1;
+        bool InRange = true;
+        switch (Rel.getType()) {
+        case ELF::R_Z80_NONE:
+          continue;
+        case ELF::R_Z80_8:
+        case ELF::R_Z80_BYTE0:
+          InRange = Rel.getType() != ELF::R_Z80_8 || isIntN(8, V) ||
+                    isUIntN(8, V);
+          break;
+        case ELF::R_Z80_BYTE1:
+          V >>= 8;
+          break;
+        case ELF::R_Z80_BYTE2:
+          V >>= 16;
+          break;
+        case ELF::R_Z80_BYTE3:
+          V >>= 24;
+          break;
+        case ELF::R_Z80_8_DIS:
+          InRange = isIntN(8, V);
+          break;
+        case ELF::R_Z80_8_PCREL:
+          // Relative to the end of the instruction, which is just past the
+          // displacement, the same as the fixup.
+          V -= P + 1;
+          InRange = isIntN(8, V);
+          break;
+        case ELF::R_Z80_16:
+        case ELF::R_Z80_WORD0:
+          Size = 2;
+          break;
+        case ELF::R_Z80_WORD1:
+          V >>= 16;
+          Size = 2;
+          break;
+        case ELF::R_Z80_16_BE:
+          V = (V >> 8 & 0xFF) | (V & 0xFF) << 8;
+          Size = 2;
+          break;
+        case ELF::R_Z80_24:
+          Size = 3;
+          break;
+        case ELF::R_Z80_32:
+          Size = 4;
+          break;
+        default:
+          fail(In.Filename + ": unsupported relocation type " +
+               Twine(Rel.getType()));
+        }
+        if (!InRange)
+          fail(In.Filename + ": relocation at " +
+               Twine::utohexstr(Rel.getOffset()) + " is out of range");
+        for (unsigned I = 0; I != Size; ++I)
+          Bus.Mem[uint16_t(P + I)] = uint8_t(V >> (I * 8));
+      }
+    }
+  }
+}
+
+uint16_t Loader::getEntry(StringRef Name, bool IsDefault) const {
+  unsigned Addr;
+  if (!Name.getAsInteger(0, Addr) && Addr <= 0xFFFF)
+    return uint16_t(Addr);
+  auto I = Globals.find(Name);
+  // C symbols carry the leading underscore of the target's name mangling.
+  if (I == Globals.end())
+    I = Globals.find(("_" + Name).str());
+  if (I != Globals.end())
+    return I->second;
+  // A flat binary starts where it is loaded.
+  if (IsDefault && FlatBinary)
+    return parseAddress(LoadAddress, "load-address");
+  for (const CodeSymbol &Sym : CodeSymbols)
+    if (Sym.Name == Name || Sym.Name == ("_" + Name).str())
+      return Sym.Addr;
+  fail("entry point '" + Name + "' not found");
+}
+
+std::vector<Function> Loader::getFunctions() const {
+  std::vector<CodeSymbol> Syms = CodeSymbols;
+  std::stable_sort(Syms.begin(), Syms.end(),
+                   [](const CodeSymbol &X, const CodeSymbol &Y) {
+                     return X.Addr < Y.Addr;
+                   });
+  // A function without a size runs up to the next symbol in its section.
+  std::vector<Function> Funcs;
+  for (unsigned I = 0, E = Syms.size(); I != E; ++I) {
+    if (I && Syms[I].Addr == Syms[I - 1].Addr)
+      continue;
+    uint32_t End = Syms[I].SectionEnd;
+    if (Syms[I].Size)
+      End = Syms[I].Addr + Syms[I].Size;
+    else if (I + 1 != E && Syms[I + 1].Addr < End)
+      End = Syms[I + 1].Addr;
+    Funcs.push_back({Syms[I].Name, Syms[I].Addr, End});
+  }
+  return Funcs;
+}
+
+//===----------------------------------------------------------------------===//
+// Disassembly, for the histogram and the trace
+//===----------------------------------------------------------------------===//
+
+namespace {
+class InstNamer {
+public:
+  InstNamer();
+
+  /// Disassemble the instruction at Addr, returning false if there is no Z80
+  /// disassembler or it does not decode.
+  bool decode(const SimBus &Bus, uint16_t Addr, MCInst &Inst,
+              uint64_t &Size) const;
+  /// Opcode name of the instruction at Addr.
+  std::string getName(const SimBus &Bus, uint16_t Addr) const;
+  /// Assembly of the instruction at Addr.
+  std::string print(const SimBus &Bus, uint16_t Addr) const;
+
+private:
+  std::unique_ptr<MCRegisterInfo> MRI;
+  std::unique_ptr<MCAsmInfo> MAI;
+  std::unique_ptr<MCSubtargetInfo> STI;
+  std::unique_ptr<MCInstrInfo> MII;
+  std::unique_ptr<MCContext> Ctx;
+  std::unique_ptr<MCDisassembler> DisAsm;
+  std::unique_ptr<MCInstPrinter> Printer;
+};
+} // end anonymous namespace
+
+InstNamer::InstNamer() {
+  InitializeAllTargetInfos();
+  InitializeAllTargetMCs();
+  InitializeAllDisassemblers();
+
+  Triple TheTriple("z80");
+  std::string Err;
+  const Target *TheTarget = TargetRegistry::lookupTarget("", TheTriple, Err);
+  if (!TheTarget)
+    return;
+  MRI.reset(TheTarget->createMCRegInfo(TheTriple.str()));
+  if (!MRI)
+    return;
+  MAI.reset(TheTarget->createMCAsmInfo(*MRI, TheTriple.str()));
+  // The simulator runs the undocumented instructions, so decode them too.
+  STI.reset(TheTarget->createMCSubtargetInfo(TheTriple.str(), "z80", ""));
+  MII.reset(TheTarget->createMCInstrInfo());
+  if (!MAI || !STI || !MII)
+    return;
+  Ctx = llvm::make_unique<MCContext>(MAI.get(), MRI.get(), nullptr);
+  DisAsm.reset(TheTarget->createMCDisassembler(*STI, *Ctx));
+  Printer.reset(TheTarget->createMCInstPrinter(
+      TheTriple, MAI->getAssemblerDialect(), *MAI, *MII, *MRI));
+}
+
+bool InstNamer::decode(const SimBus &Bus, uint16_t Addr, MCInst &Inst,
+                       uint64_t &Size) const {
+  if (!DisAsm)
+    return false;
+  uint8_t Bytes[4];
+  for (unsigned I = 0; I != array_lengthof(Bytes); ++I)
+    Bytes[I] = Bus.Mem[uint16_t(Addr + I)];
+  return DisAsm->getInstruction(Inst, Size, Bytes, Addr, nulls(), nulls()) ==
+         MCDisassembler::Success;
+}
+
+std::string InstNamer::getName(const SimBus &Bus, uint16_t Addr) const {
+  MCInst Inst;
+  uint64_t Size;
+  if (decode(Bus, Addr, Inst, Size))
+    return MII->getName(Inst.getOpcode());
+  return "<undecoded>";
+}
+
+std::string InstNamer::print(const SimBus &Bus, uint16_t Addr) const {
+  MCInst Inst;
+  uint64_t Size;
+  if (!decode(Bus, Addr, Inst, Size) || !Printer)
+    return "<undecoded>";
+  std::string Str;
+  raw_string_ostream OS(Str);
+  Printer->printInst(&Inst, OS, "", *STI);
+  return StringRef(OS.str()).trim();
+}
+
+/// Name of the opcode with key Key, as returned by getLastOpcodeKey(), if
+/// there is no disassembler to name it.
+static std::string getKeyName(uint16_t Key) {
+  static const char *const Prefixes[] = {"",      "cb ",    "ed ",   "dd ",
+                                         "fd ",   "dd cb ", "fd cb "};
+  std::string Str;
+  raw_string_ostream OS(Str);
+  OS << Prefixes[Key >> 8] << format_hex_no_prefix(Key & 0xFF, 2);
+  return OS.str();
+}
+
+//===----------------------------------------------------------------------===//
+// Simulation
+//===----------------------------------------------------------------------===//
+
+namespace {
+struct FunctionProfile {
+  uint64_t Calls = 0, SelfTStates = 0, TotalTStates = 0, Instructions = 0;
+  /// Number of frames of this function on the shadow stack, so recursion is
+  /// only counted once in TotalTStates.
+  unsigned Active = 0;
+};
+
+struct OpcodeProfile {
+  uint64_t Count = 0, TStates = 0;
+  uint16_t FirstAddr = 0;
+};
+
+/// A call in progress.
+struct Frame {
+  unsigned Func;
+  /// Stack depth just after the return address was pushed.
+  uint16_t Depth;
+  uint64_t Start;
+};
+
+class Profiler {
+public:
+  Profiler(std::vector<Function> Funcs, uint16_t InitialSP)
+      : Funcs(std::move(Funcs)), Profiles(this->Funcs.size() + 1),
+        InitialSP(InitialSP) {}
+
+  /// Index of the function containing Addr, or Funcs.size() if none does.
+  unsigned findFunction(uint16_t Addr) const;
+  void enter(uint16_t Addr, uint16_t SP, uint64_t Now);
+  void leave(uint16_t SP, uint64_t Now);
+  void finish(uint64_t Now) { leave(InitialSP, Now); }
+
+  std::vector<Function> Funcs;
+  /// By function index, the last one for code outside any function.
+  std::vector<FunctionProfile> Profiles;
+
+private:
+  uint16_t InitialSP;
+  std::vector<Frame> Stack;
+};
+} // end anonymous namespace
+
+unsigned Profiler::findFunction(uint16_t Addr) const {
+  auto I = std::upper_bound(
+      Funcs.begin(), Funcs.end(), Addr,
+      [](uint16_t Addr, const Function &F) { return Addr < F.Start; });
+  if (I == Funcs.begin() || Addr >= std::prev(I)->End)
+    return Funcs.size();
+  return std::prev(I) - Funcs.begin();
+}
+
+void Profiler::enter(uint16_t Addr, uint16_t SP, uint64_t Now) {
+  unsigned Func = findFunction(Addr);
+  FunctionProfile &Prof = Profiles[Func];
+  ++Prof.Calls;
+  ++Prof.Active;
+  Stack.push_back({Func, uint16_t(InitialSP - SP), Now});
+}
+
+void Profiler::leave(uint16_t SP, uint64_t Now) {
+  uint16_t Depth = InitialSP - SP;
+  while (!Stack.empty() && Stack.back().Depth > Depth) {
+    FunctionProfile &Prof = Profiles[Stack.back().Func];
+    if (!--Prof.Active)
+      Prof.TotalTStates += Now - Stack.back().Start;
+    Stack.pop_back();
+  }
+}
+
+static void printPercent(raw_ostream &OS, uint64_t Part, uint64_t Whole) {
+  OS << format("%6.2f%%", Whole ? 100.0 * Part / Whole : 0.0);
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  ToolName = argv[0];
+  cl::ParseCommandLineOptions(argc, argv, "Z80 instruction set simulator\n");
+
+  SimBus Bus;
+  parseMemoryMap(Bus);
+
+  Loader L(Bus);
+  // The objects refer to their buffers until the run ends.
+  std::vector<std::unique_ptr<MemoryBuffer>> Buffers;
+  for (StringRef Filename : InputFilenames) {
+    if (FlatBinary) {
+      L.loadBinary(Filename);
+      continue;
+    }
+    OwningBinary<Binary> OB = failIfError(createBinary(Filename), Filename);
+    std::unique_ptr<Binary> Bin;
+    std::unique_ptr<MemoryBuffer> Buf;
+    std::tie(Bin, Buf) = OB.takeBinary();
+    if (!isa<ObjectFile>(Bin.get()))
+      fail(Filename + ": not an object file");
+    L.loadObject(std::unique_ptr<ObjectFile>(cast<ObjectFile>(Bin.release())),
+                 Filename);
+    Buffers.push_back(std::move(Buf));
+  }
+  L.link();
+
+  uint16_t Entry = L.getEntry(EntryPoint, !EntryPoint.getNumOccurrences());
+  uint16_t InitialSP = parseAddress(StackTop, "stack");
+
+  Z80CPU CPU(Bus);
+  CPU.PC = Entry;
+  CPU.SP = InitialSP;
+  // The entry point returns to the address 0, but the run ends as soon as the
+  // stack pointer is back where it started.
+  CPU.SP -= 2;
+  Bus.write(CPU.SP, 0);
+  Bus.write(CPU.SP + 1, 0);
+  if (Bus.Faulted)
+    fail("the stack at " + Twine::utohexstr(CPU.SP) + " is not writable");
+
+  bool Profiling = PrintFunctions || PrintHistogram;
+  std::unique_ptr<InstNamer> Namer;
+  if (PrintHistogram || Trace)
+    Namer = llvm::make_unique<InstNamer>();
+  Profiler Prof(L.getFunctions(), InitialSP);
+  Prof.enter(Entry, CPU.SP, 0);
+  DenseMap<uint16_t, OpcodeProfile> Opcodes;
+
+  uint64_t Instructions = 0;
+  uint16_t MaxDepth = 2;
+  std::string Exit;
+  int ExitCode = 0;
+  while (true) {
+    uint16_t PC = CPU.PC;
+    if (Trace)
+      errs() << format_hex_no_prefix(PC, 4) << "  "
+             << Namer->print(Bus, PC) << '\n';
+    unsigned T = CPU.step();
+    ++Instructions;
+
+    uint16_t Depth = InitialSP - CPU.SP;
+    if (Depth < 0x8000)
+      MaxDepth = std::max(MaxDepth, Depth);
+
+    if (Profiling) {
+      FunctionProfile &FP = Prof.Profiles[Prof.findFunction(PC)];
+      FP.SelfTStates += T;
+      ++FP.Instructions;
+      OpcodeProfile &OP = Opcodes[CPU.getLastOpcodeKey()];
+      if (!OP.Count)
+        OP.FirstAddr = PC;
+      ++OP.Count;
+      OP.TStates += T;
+      if (CPU.getLastControl() == Z80CPU::CtlCall)
+        Prof.enter(CPU.PC, CPU.SP, CPU.getTStates());
+      else if (CPU.getLastControl() == Z80CPU::CtlRet)
+        Prof.leave(CPU.SP, CPU.getTStates());
+    }
+
+    if (Bus.Faulted) {
+      Exit = (Twine(Bus.FaultIsWrite ? "write to " : "read from ") +
+              Twine::utohexstr(Bus.FaultAddr) + " at " + Twine::utohexstr(PC) +
+              " is outside the memory map")
+                 .str();
+      ExitCode = 1;
+      break;
+    }
+    if (CPU.Halted) {
+      Exit = "halted";
+      break;
+    }
+    if (Bus.ExitRequested) {
+      Exit = "exit port written";
+      ExitCode = Bus.ExitCode;
+      break;
+    }
+    if (CPU.getLastControl() == Z80CPU::CtlRet && CPU.SP == InitialSP) {
+      Exit = "returned";
+      break;
+    }
+    if (MaxTStates && CPU.getTStates() >= MaxTStates) {
+      Exit = "T-state limit reached";
+      ExitCode = 1;
+      break;
+    }
+  }
+  Prof.finish(CPU.getTStates());
+  outs().flush();
+
+  raw_ostream &OS = outs();
+  OS << "Exit:            " << Exit;
+  if (Bus.ExitRequested)
+    OS << " (" << unsigned(Bus.ExitCode) << ')';
+  OS << '\n';
+  OS << "Result:          HL=" << format_hex(CPU.getHL(), 6)
+     << " A=" << format_hex(CPU.A, 4) << '\n';
+  OS << "Instructions:    " << Instructions << '\n';
+  OS << "T-states:        " << CPU.getTStates() << '\n';
+  OS << "Stack usage:     " << MaxDepth << " bytes\n";
+
+  uint64_t Total = CPU.getTStates();
+  if (PrintFunctions) {
+    std::vector<unsigned> Order(Prof.Profiles.size());
+    std::iota(Order.begin(), Order.end(), 0);
+    std::stable_sort(Order.begin(), Order.end(), [&](unsigned X, unsigned Y) {
+      return Prof.Profiles[X].SelfTStates > Prof.Profiles[Y].SelfTStates;
+    });
+    OS << "\nFunction profile:\n";
+    OS << "  Function                    Calls         Self                "
+          "Total         Instructions\n";
+    for (unsigned I : Order) {
+      const FunctionProfile &FP = Prof.Profiles[I];
+      if (!FP.Instructions)
+        continue;
+      std::string Name =
+          I == Prof.Funcs.size() ? "<unknown>" : Prof.Funcs[I].Name;
+      OS << format("  %-24s %8llu %12llu ", Name.c_str(),
+                   (unsigned long long)FP.Calls,
+                   (unsigned long long)FP.SelfTStates);
+      printPercent(OS, FP.SelfTStates, Total);
+      OS << format(" %12llu ", (unsigned long long)FP.TotalTStates);
+      printPercent(OS, FP.TotalTStates, Total);
+      OS << format(" %12llu\n", (unsigned long long)FP.Instructions);
+    }
+  }
+
+  if (PrintHistogram) {
+    // Opcodes that differ only in their registers or condition share a name.
+    StringMap<OpcodeProfile> ByName;
+    for (const auto &KV : Opcodes) {
+      std::string Name = Namer->getName(Bus, KV.second.FirstAddr);
+      if (Name == "<undecoded>")
+        Name = getKeyName(KV.first);
+      OpcodeProfile &OP = ByName[Name];
+      OP.Count += KV.second.Count;
+      OP.TStates += KV.second.TStates;
+    }
+    std::vector<std::pair<StringRef, OpcodeProfile>> Sorted;
+    for (const auto &KV : ByName)
+      Sorted.push_back({KV.getKey(), KV.getValue()});
+    std::stable_sort(Sorted.begin(), Sorted.end(),
+                     [](const std::pair<StringRef, OpcodeProfile> &X,
+                        const std::pair<StringRef, OpcodeProfile> &Y) {
+                       if (X.second.TStates != Y.second.TStates)
+                         return X.second.TStates > Y.second.TStates;
+                       return X.first < Y.first;
+                     });
+    OS << "\nInstruction histogram:\n";
+    OS << "  Instruction                     Count     T-states\n";
+    for (const auto &KV : Sorted) {
+      OS << format("  %-24s %12llu %12llu ", KV.first.str().c_str(),
+                   (unsigned long long)KV.second.Count,
+                   (unsigned long long)KV.second.TStates);
+      printPercent(OS, KV.second.TStates, Total);
+      OS << '\n';
+    }
+  }
+
+  if (PrintPorts) {
+    OS << "\nPorts:\n";
+    OS << "  Port            Reads       Writes\n";
+    for (const auto &KV : Bus.Ports)
+      OS << format("  0x%02x     %12llu %12llu\n", KV.first,
+                   (unsigned long long)KV.second.Reads,
+                   (unsigned long long)KV.second.Writes);
+  }
+
+  return ExitCode;
+}